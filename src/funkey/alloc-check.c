@@ -0,0 +1,50 @@
+/*
+ * alloc-check.c
+ * Debug-only heap call counter, to check that steady-state menu frames don't allocate
+ *
+ * Symbols defined in the executable take precedence over the libc ones, so
+ * these wrappers also see the allocations made inside SDL, SDL_ttf, etc.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stddef.h>
+
+#include "alloc-check.h"
+
+#ifdef MENU_ALLOC_CHECK
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread unsigned long nb_heap_calls = 0;
+
+unsigned long get_nb_heap_calls(){
+    return nb_heap_calls;
+}
+
+void *malloc(size_t size){
+    nb_heap_calls++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size){
+    nb_heap_calls++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size){
+    nb_heap_calls++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr){
+    if(ptr){
+        nb_heap_calls++;
+    }
+    __libc_free(ptr);
+}
+
+#endif //MENU_ALLOC_CHECK
@@ -0,0 +1,21 @@
+/*
+ * alloc-check.h
+ * Debug-only heap call counter, to check that steady-state menu frames don't allocate
+ *
+ * When MENU_ALLOC_CHECK is defined, malloc/calloc/realloc/free are interposed
+ * by alloc-check.c and counted per thread, before being forwarded to glibc.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_ALLOC_CHECK_H
+#define FUNKEY_ALLOC_CHECK_H
+
+//#define MENU_ALLOC_CHECK
+
+#ifdef MENU_ALLOC_CHECK
+// Number of heap calls made by the calling thread so far
+unsigned long get_nb_heap_calls();
+#endif //MENU_ALLOC_CHECK
+
+#endif //FUNKEY_ALLOC_CHECK_H
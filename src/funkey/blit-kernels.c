@@ -0,0 +1,540 @@
+/*
+ * blit-kernels.c
+ * Row kernels for the menu blits: alpha blending and opaque copies
+ *
+ * All versions compute exactly the same result as the scalar reference:
+ * x = s*a + d*(255-a) + 128, then (x + (x >> 8)) >> 8 is x/255 rounded to
+ * nearest, in 16-bit lanes for SSE2 and with vraddhn/vrshr on NEON.
+ * Blocks that are fully transparent are skipped by every version.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL/SDL.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define BLIT_KERNELS_SSE2
+#define SSE2_TARGET                 __attribute__((target("sse2")))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLIT_KERNELS_NEON
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON                  (1 << 12)
+#endif
+#endif
+#endif
+
+#include "blit-kernels.h"
+
+/// -------------- DEFINES --------------
+//#define BLIT_DEBUG
+#define BLIT_ERROR
+
+#ifdef BLIT_DEBUG
+#define BLIT_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define BLIT_DEBUG_PRINTF(...)
+#endif //BLIT_DEBUG
+
+#ifdef BLIT_ERROR
+#define BLIT_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define BLIT_ERROR_PRINTF(...)
+#endif //BLIT_ERROR
+
+#define ARGB8888_AMASK              0xff000000
+#define ARGB8888_RMASK              0x00ff0000
+#define ARGB8888_GMASK              0x0000ff00
+#define ARGB8888_BMASK              0x000000ff
+#define RGB565_RMASK                0xf800
+#define RGB565_GMASK                0x07e0
+#define RGB565_BMASK                0x001f
+
+typedef enum{
+    BLIT_KERNEL_NONE,
+    BLIT_KERNEL_BLEND_XRGB8888,
+    BLIT_KERNEL_BLEND_RGB565,
+    BLIT_KERNEL_COPY,
+} ENUM_BLIT_KERNEL;
+
+
+/// --------------------------------------------
+/// ------------  SCALAR reference  ------------
+/// --------------------------------------------
+
+static inline uint32_t blend_channel(uint32_t s, uint32_t d, uint32_t a){
+    uint32_t x = s*a + d*(255-a) + 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void blend_argb8888_xrgb8888_scalar(uint32_t *dst, const uint32_t *src, int w){
+    for(int i = 0; i < w; i++){
+        uint32_t s = src[i];
+        uint32_t d = dst[i];
+        uint32_t a = s >> 24;
+        if(!a){
+            continue;
+        }
+        dst[i] = (d & ARGB8888_AMASK) |
+            (blend_channel((s >> 16) & 0xff, (d >> 16) & 0xff, a) << 16) |
+            (blend_channel((s >> 8) & 0xff, (d >> 8) & 0xff, a) << 8) |
+            blend_channel(s & 0xff, d & 0xff, a);
+    }
+}
+
+static void blend_argb8888_rgb565_scalar(uint16_t *dst, const uint32_t *src, int w){
+    for(int i = 0; i < w; i++){
+        uint32_t s = src[i];
+        uint32_t a = s >> 24;
+        if(!a){
+            continue;
+        }
+        uint32_t r5 = dst[i] >> 11;
+        uint32_t g6 = (dst[i] >> 5) & 0x3f;
+        uint32_t b5 = dst[i] & 0x1f;
+        uint32_t r = blend_channel((s >> 16) & 0xff, (r5 << 3) | (r5 >> 2), a);
+        uint32_t g = blend_channel((s >> 8) & 0xff, (g6 << 2) | (g6 >> 4), a);
+        uint32_t b = blend_channel(s & 0xff, (b5 << 3) | (b5 >> 2), a);
+        dst[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+static void copy_row_scalar(uint8_t *dst, const uint8_t *src, int nb_bytes){
+    memcpy(dst, src, nb_bytes);
+}
+
+static const blit_kernels_t blit_kernels_scalar = {
+    "scalar",
+    blend_argb8888_xrgb8888_scalar,
+    blend_argb8888_rgb565_scalar,
+    copy_row_scalar,
+};
+
+
+/// --------------------------------------------
+/// ----------------  SSE2  --------------------
+/// --------------------------------------------
+#ifdef BLIT_KERNELS_SSE2
+
+SSE2_TARGET static inline __m128i blend_epi16_sse2(__m128i s, __m128i d, __m128i a){
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+SSE2_TARGET static void blend_argb8888_xrgb8888_sse2(uint32_t *dst, const uint32_t *src, int w){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32(ARGB8888_AMASK);
+
+    for(; w >= 4; w -= 4, src += 4, dst += 4){
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i sa = _mm_and_si128(s, alpha_mask);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xffff){
+            continue;
+        }
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i res = s;
+
+        /// ------ Opaque blocks keep src, others are blended 2 pixels per register ------
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alpha_mask)) != 0xffff){
+            __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+            __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+            __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xff), 0xff);
+            __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xff), 0xff);
+            res = _mm_packus_epi16(
+                blend_epi16_sse2(s_lo, _mm_unpacklo_epi8(d, zero), a_lo),
+                blend_epi16_sse2(s_hi, _mm_unpackhi_epi8(d, zero), a_hi));
+        }
+        res = _mm_or_si128(_mm_andnot_si128(alpha_mask, res), _mm_and_si128(d, alpha_mask));
+        _mm_storeu_si128((__m128i*)dst, res);
+    }
+    blend_argb8888_xrgb8888_scalar(dst, src, w);
+}
+
+SSE2_TARGET static void blend_argb8888_rgb565_sse2(uint16_t *dst, const uint32_t *src, int w){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask_ff = _mm_set1_epi32(0xff);
+    const __m128i mask_3f = _mm_set1_epi16(0x3f);
+    const __m128i mask_1f = _mm_set1_epi16(0x1f);
+
+    for(; w >= 8; w -= 8, src += 8, dst += 8){
+        __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)(src+4));
+        __m128i a = _mm_packs_epi32(_mm_srli_epi32(s0, 24), _mm_srli_epi32(s1, 24));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xffff){
+            continue;
+        }
+
+        /// ------ Split src and dst in 8-bit channels, 8 pixels per register ------
+        __m128i sr = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(s0, 16), mask_ff), _mm_and_si128(_mm_srli_epi32(s1, 16), mask_ff));
+        __m128i sg = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(s0, 8), mask_ff), _mm_and_si128(_mm_srli_epi32(s1, 8), mask_ff));
+        __m128i sb = _mm_packs_epi32(_mm_and_si128(s0, mask_ff), _mm_and_si128(s1, mask_ff));
+
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i r5 = _mm_srli_epi16(d, 11);
+        __m128i g6 = _mm_and_si128(_mm_srli_epi16(d, 5), mask_3f);
+        __m128i b5 = _mm_and_si128(d, mask_1f);
+        __m128i dr = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+        __m128i dg = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+        __m128i db = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+
+        __m128i r = blend_epi16_sse2(sr, dr, a);
+        __m128i g = blend_epi16_sse2(sg, dg, a);
+        __m128i b = blend_epi16_sse2(sb, db, a);
+        __m128i res = _mm_or_si128(_mm_or_si128(
+            _mm_slli_epi16(_mm_srli_epi16(r, 3), 11),
+            _mm_slli_epi16(_mm_srli_epi16(g, 2), 5)),
+            _mm_srli_epi16(b, 3));
+        _mm_storeu_si128((__m128i*)dst, res);
+    }
+    blend_argb8888_rgb565_scalar(dst, src, w);
+}
+
+SSE2_TARGET static void copy_row_sse2(uint8_t *dst, const uint8_t *src, int nb_bytes){
+    for(; nb_bytes >= 64; nb_bytes -= 64, src += 64, dst += 64){
+        __m128i v0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(src+16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(src+32));
+        __m128i v3 = _mm_loadu_si128((const __m128i*)(src+48));
+        _mm_storeu_si128((__m128i*)dst, v0);
+        _mm_storeu_si128((__m128i*)(dst+16), v1);
+        _mm_storeu_si128((__m128i*)(dst+32), v2);
+        _mm_storeu_si128((__m128i*)(dst+48), v3);
+    }
+    memcpy(dst, src, nb_bytes);
+}
+
+static const blit_kernels_t blit_kernels_sse2 = {
+    "sse2",
+    blend_argb8888_xrgb8888_sse2,
+    blend_argb8888_rgb565_sse2,
+    copy_row_sse2,
+};
+#endif //BLIT_KERNELS_SSE2
+
+
+/// --------------------------------------------
+/// ----------------  NEON  --------------------
+/// --------------------------------------------
+#ifdef BLIT_KERNELS_NEON
+
+static inline uint8x8_t blend_u8_neon(uint8x8_t s, uint8x8_t d, uint8x8_t a, uint8x8_t inv_a){
+    uint16x8_t x = vmlal_u8(vmull_u8(s, a), d, inv_a);
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+static void blend_argb8888_xrgb8888_neon(uint32_t *dst, const uint32_t *src, int w){
+    for(; w >= 8; w -= 8, src += 8, dst += 8){
+        uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+        if(!vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0)){
+            continue;
+        }
+        uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+        uint8x8_t inv_a = vmvn_u8(s.val[3]);
+
+        /// ------ Bytes are B, G, R, A in memory, alpha (val[3]) stays dst's ------
+        d.val[0] = blend_u8_neon(s.val[0], d.val[0], s.val[3], inv_a);
+        d.val[1] = blend_u8_neon(s.val[1], d.val[1], s.val[3], inv_a);
+        d.val[2] = blend_u8_neon(s.val[2], d.val[2], s.val[3], inv_a);
+        vst4_u8((uint8_t*)dst, d);
+    }
+    blend_argb8888_xrgb8888_scalar(dst, src, w);
+}
+
+static void blend_argb8888_rgb565_neon(uint16_t *dst, const uint32_t *src, int w){
+    for(; w >= 8; w -= 8, src += 8, dst += 8){
+        uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+        if(!vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0)){
+            continue;
+        }
+        uint8x8_t inv_a = vmvn_u8(s.val[3]);
+
+        uint16x8_t d = vld1q_u16(dst);
+        uint8x8_t r5 = vmovn_u16(vshrq_n_u16(d, 11));
+        uint8x8_t g6 = vmovn_u16(vandq_u16(vshrq_n_u16(d, 5), vdupq_n_u16(0x3f)));
+        uint8x8_t b5 = vmovn_u16(vandq_u16(d, vdupq_n_u16(0x1f)));
+        uint8x8_t dr = vorr_u8(vshl_n_u8(r5, 3), vshr_n_u8(r5, 2));
+        uint8x8_t dg = vorr_u8(vshl_n_u8(g6, 2), vshr_n_u8(g6, 4));
+        uint8x8_t db = vorr_u8(vshl_n_u8(b5, 3), vshr_n_u8(b5, 2));
+
+        uint8x8_t r = blend_u8_neon(s.val[2], dr, s.val[3], inv_a);
+        uint8x8_t g = blend_u8_neon(s.val[1], dg, s.val[3], inv_a);
+        uint8x8_t b = blend_u8_neon(s.val[0], db, s.val[3], inv_a);
+        uint16x8_t res = vorrq_u16(
+            vandq_u16(vshll_n_u8(r, 8), vdupq_n_u16(RGB565_RMASK)),
+            vandq_u16(vshll_n_u8(g, 3), vdupq_n_u16(RGB565_GMASK)));
+        res = vorrq_u16(res, vmovl_u8(vshr_n_u8(b, 3)));
+        vst1q_u16(dst, res);
+    }
+    blend_argb8888_rgb565_scalar(dst, src, w);
+}
+
+static void copy_row_neon(uint8_t *dst, const uint8_t *src, int nb_bytes){
+    for(; nb_bytes >= 64; nb_bytes -= 64, src += 64, dst += 64){
+        uint8x16_t v0 = vld1q_u8(src);
+        uint8x16_t v1 = vld1q_u8(src+16);
+        uint8x16_t v2 = vld1q_u8(src+32);
+        uint8x16_t v3 = vld1q_u8(src+48);
+        vst1q_u8(dst, v0);
+        vst1q_u8(dst+16, v1);
+        vst1q_u8(dst+32, v2);
+        vst1q_u8(dst+48, v3);
+    }
+    memcpy(dst, src, nb_bytes);
+}
+
+static const blit_kernels_t blit_kernels_neon = {
+    "neon",
+    blend_argb8888_xrgb8888_neon,
+    blend_argb8888_rgb565_neon,
+    copy_row_neon,
+};
+#endif //BLIT_KERNELS_NEON
+
+
+/// -------------- GLOBAL VARIABLES --------------
+blit_kernels_t blit_kernels = {
+    "scalar",
+    blend_argb8888_xrgb8888_scalar,
+    blend_argb8888_rgb565_scalar,
+    copy_row_scalar,
+};
+
+
+/// --------------------------------------------
+/// -------------  SELF TEST  ------------------
+/// --------------------------------------------
+#ifdef BLIT_KERNELS_SELF_TEST
+
+#define SELF_TEST_ROW               256
+
+/* Exhaustive on alpha and one channel of src and dst, then every row length/alignment for the tails */
+static int self_test_blit_kernels(){
+    static uint32_t src[SELF_TEST_ROW+4], dst[SELF_TEST_ROW+4], ref[SELF_TEST_ROW+4];
+    static uint16_t dst16[SELF_TEST_ROW+8], ref16[SELF_TEST_ROW+8];
+    static uint8_t bytes_src[SELF_TEST_ROW+64], bytes_dst[SELF_TEST_ROW+64], bytes_ref[SELF_TEST_ROW+64];
+    uint32_t seed = 1;
+    int nb_errors = 0;
+
+    /// ------ ARGB8888 over XRGB8888: every (alpha, src red, dst red) ------
+    for(uint32_t a = 0; a < 256; a++){
+        for(uint32_t s = 0; s < 256; s++){
+            for(uint32_t d = 0; d < SELF_TEST_ROW; d++){
+                src[d] = (a << 24) | (s << 16) | (((s*7) & 0xff) << 8) | (s ^ 0xa5);
+                dst[d] = ref[d] = (0x5a << 24) | (d << 16) | ((255-d) << 8) | ((d*13) & 0xff);
+            }
+            blit_kernels.blend_argb8888_xrgb8888(dst, src, SELF_TEST_ROW);
+            blend_argb8888_xrgb8888_scalar(ref, src, SELF_TEST_ROW);
+            nb_errors += memcmp(dst, ref, SELF_TEST_ROW*sizeof(uint32_t)) != 0;
+        }
+    }
+
+    /// ------ ARGB8888 over RGB565: every (alpha, dst), pseudo-random src ------
+    for(uint32_t a = 0; a < 256; a++){
+        for(uint32_t d_hi = 0; d_hi < 65536/SELF_TEST_ROW; d_hi++){
+            for(uint32_t d = 0; d < SELF_TEST_ROW; d++){
+                seed = seed*1103515245 + 12345;
+                src[d] = (a << 24) | (seed >> 8);
+                dst16[d] = ref16[d] = d_hi*SELF_TEST_ROW + d;
+            }
+            blit_kernels.blend_argb8888_rgb565(dst16, src, SELF_TEST_ROW);
+            blend_argb8888_rgb565_scalar(ref16, src, SELF_TEST_ROW);
+            nb_errors += memcmp(dst16, ref16, SELF_TEST_ROW*sizeof(uint16_t)) != 0;
+        }
+    }
+
+    /// ------ Every length and alignment, for the vector/scalar tails ------
+    for(int offset = 0; offset < 4; offset++){
+        for(int w = 0; w <= 2*SELF_TEST_ROW/8; w++){
+            for(int i = 0; i < SELF_TEST_ROW+4; i++){
+                seed = seed*1103515245 + 12345;
+                src[i] = seed ^ (seed << 13);
+                if(i & 4) src[i] |= ARGB8888_AMASK;
+                if(i & 8) src[i] &= ~ARGB8888_AMASK;
+                dst[i] = ref[i] = seed*31;
+                dst16[i] = ref16[i] = seed >> 16;
+                bytes_src[i] = seed >> 24;
+                bytes_dst[i] = bytes_ref[i] = 0;
+            }
+            blit_kernels.blend_argb8888_xrgb8888(dst + offset, src + offset, w);
+            blend_argb8888_xrgb8888_scalar(ref + offset, src + offset, w);
+            blit_kernels.blend_argb8888_rgb565(dst16 + offset, src + offset, w);
+            blend_argb8888_rgb565_scalar(ref16 + offset, src + offset, w);
+            blit_kernels.copy_row(bytes_dst + offset, bytes_src + offset, w*3);
+            copy_row_scalar(bytes_ref + offset, bytes_src + offset, w*3);
+            nb_errors += memcmp(dst, ref, sizeof(dst)) != 0;
+            nb_errors += memcmp(dst16, ref16, sizeof(dst16)) != 0;
+            nb_errors += memcmp(bytes_dst, bytes_ref, sizeof(bytes_dst)) != 0;
+        }
+    }
+    return nb_errors;
+}
+#endif //BLIT_KERNELS_SELF_TEST
+
+
+/// --------------------------------------------
+/// -------------  BLIT functions  -------------
+/// --------------------------------------------
+
+int init_blit_kernels(){
+    int nb_errors = 0;
+    const char *env = getenv("FUNKEY_BLIT_KERNELS");
+    blit_kernels = blit_kernels_scalar;
+
+    if(env == NULL || strcmp(env, "scalar")){
+#if defined(BLIT_KERNELS_SSE2)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse2")){
+            blit_kernels = blit_kernels_sse2;
+        }
+#elif defined(BLIT_KERNELS_NEON) && defined(__aarch64__)
+        blit_kernels = blit_kernels_neon;
+#elif defined(BLIT_KERNELS_NEON)
+        if(getauxval(AT_HWCAP) & HWCAP_NEON){
+            blit_kernels = blit_kernels_neon;
+        }
+#endif
+    }
+
+#ifdef BLIT_KERNELS_SELF_TEST
+    nb_errors = self_test_blit_kernels();
+    printf("Blit kernels: %s self-test %s (%d errors)\n", blit_kernels.name, nb_errors?"FAILED":"passed", nb_errors);
+    if(nb_errors){
+        blit_kernels = blit_kernels_scalar;
+    }
+#endif //BLIT_KERNELS_SELF_TEST
+    BLIT_DEBUG_PRINTF("Blit kernels: using %s\n", blit_kernels.name);
+    return nb_errors;
+}
+
+static int is_argb8888(SDL_PixelFormat *format){
+    return format->BitsPerPixel == 32 && format->Rmask == ARGB8888_RMASK &&
+        format->Gmask == ARGB8888_GMASK && format->Bmask == ARGB8888_BMASK;
+}
+
+static ENUM_BLIT_KERNEL get_blit_kernel(SDL_Surface *src, SDL_Surface *dst){
+    SDL_PixelFormat *sf = src->format;
+    SDL_PixelFormat *df = dst->format;
+
+    /// ------ Per-pixel alpha, without colorkey or per-surface alpha ------
+    if(src->flags & SDL_SRCALPHA){
+        if((src->flags & SDL_SRCCOLORKEY) || sf->alpha != SDL_ALPHA_OPAQUE ||
+            !is_argb8888(sf) || sf->Amask != ARGB8888_AMASK){
+            return BLIT_KERNEL_NONE;
+        }
+        if(is_argb8888(df)){
+            return BLIT_KERNEL_BLEND_XRGB8888;
+        }
+        if(df->BitsPerPixel == 16 && df->Rmask == RGB565_RMASK &&
+            df->Gmask == RGB565_GMASK && df->Bmask == RGB565_BMASK){
+            return BLIT_KERNEL_BLEND_RGB565;
+        }
+        return BLIT_KERNEL_NONE;
+    }
+
+    /// ------ Plain copy between identical formats ------
+    if(!(src->flags & SDL_SRCCOLORKEY) && sf->BitsPerPixel == df->BitsPerPixel &&
+        (sf->BytesPerPixel == 2 || sf->BytesPerPixel == 4) &&
+        sf->Rmask == df->Rmask && sf->Gmask == df->Gmask && sf->Bmask == df->Bmask && sf->Amask == df->Amask){
+        return BLIT_KERNEL_COPY;
+    }
+    return BLIT_KERNEL_NONE;
+}
+
+int blit_surface_fast(SDL_Surface *src, SDL_Rect *src_rect, SDL_Surface *dst, SDL_Rect *dst_rect){
+    ENUM_BLIT_KERNEL kernel = get_blit_kernel(src, dst);
+    if(kernel == BLIT_KERNEL_NONE){
+        return SDL_BlitSurface(src, src_rect, dst, dst_rect);
+    }
+
+    /// ------ Clip to src, then to dst's clip rect, like SDL_BlitSurface() ------
+    int sx = src_rect?src_rect->x:0;
+    int sy = src_rect?src_rect->y:0;
+    int w = src_rect?src_rect->w:src->w;
+    int h = src_rect?src_rect->h:src->h;
+    int dx = dst_rect?dst_rect->x:0;
+    int dy = dst_rect?dst_rect->y:0;
+    SDL_Rect *clip = &dst->clip_rect;
+
+    if(sx < 0){ w += sx; dx -= sx; sx = 0; }
+    if(sy < 0){ h += sy; dy -= sy; sy = 0; }
+    if(sx + w > src->w) w = src->w - sx;
+    if(sy + h > src->h) h = src->h - sy;
+    if(dx < clip->x){ w -= clip->x - dx; sx += clip->x - dx; dx = clip->x; }
+    if(dy < clip->y){ h -= clip->y - dy; sy += clip->y - dy; dy = clip->y; }
+    if(dx + w > clip->x + clip->w) w = clip->x + clip->w - dx;
+    if(dy + h > clip->y + clip->h) h = clip->y + clip->h - dy;
+    if(w < 0) w = 0;
+    if(h < 0) h = 0;
+
+    if(dst_rect){
+        dst_rect->x = dx;
+        dst_rect->y = dy;
+        dst_rect->w = w;
+        dst_rect->h = h;
+    }
+    if(!w || !h){
+        return 0;
+    }
+
+    if(SDL_MUSTLOCK(src)){
+        SDL_LockSurface(src);
+    }
+    if(SDL_MUSTLOCK(dst)){
+        SDL_LockSurface(dst);
+    }
+
+    int src_bpp = src->format->BytesPerPixel;
+    int dst_bpp = dst->format->BytesPerPixel;
+    const uint8_t *src_row = (const uint8_t*)src->pixels + sy*src->pitch + sx*src_bpp;
+    uint8_t *dst_row = (uint8_t*)dst->pixels + dy*dst->pitch + dx*dst_bpp;
+
+    for(int y = 0; y < h; y++, src_row += src->pitch, dst_row += dst->pitch){
+        switch(kernel){
+        case BLIT_KERNEL_BLEND_XRGB8888:
+            blit_kernels.blend_argb8888_xrgb8888((uint32_t*)dst_row, (const uint32_t*)src_row, w);
+            break;
+        case BLIT_KERNEL_BLEND_RGB565:
+            blit_kernels.blend_argb8888_rgb565((uint16_t*)dst_row, (const uint32_t*)src_row, w);
+            break;
+        default:
+            blit_kernels.copy_row(dst_row, src_row, w*dst_bpp);
+            break;
+        }
+    }
+
+    if(SDL_MUSTLOCK(dst)){
+        SDL_UnlockSurface(dst);
+    }
+    if(SDL_MUSTLOCK(src)){
+        SDL_UnlockSurface(src);
+    }
+    return 0;
+}
+
+SDL_Surface *convert_to_argb8888(SDL_Surface *surface){
+    if(surface == NULL || (is_argb8888(surface->format) && surface->format->Amask == ARGB8888_AMASK)){
+        return surface;
+    }
+
+    SDL_Surface *argb = SDL_CreateRGBSurface(SDL_SWSURFACE, surface->w, surface->h, 32,
+        ARGB8888_RMASK, ARGB8888_GMASK, ARGB8888_BMASK, ARGB8888_AMASK);
+    if(argb == NULL){
+        BLIT_ERROR_PRINTF("ERROR in convert_to_argb8888: Could not create surface: %s\n", SDL_GetError());
+        return surface;
+    }
+
+    /// ------ Copy alpha as is rather than blending ------
+    SDL_SetAlpha(surface, 0, SDL_ALPHA_OPAQUE);
+    SDL_BlitSurface(surface, NULL, argb, NULL);
+    SDL_SetAlpha(argb, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+    SDL_FreeSurface(surface);
+    return argb;
+}
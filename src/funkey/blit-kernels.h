@@ -0,0 +1,50 @@
+/*
+ * blit-kernels.h
+ * Row kernels for the menu blits: alpha blending and opaque copies
+ *
+ * Covers the blits the menu does every frame: ARGB8888 (text, arrows, zone
+ * backgrounds) blended over an XRGB8888 or RGB565 screen, and opaque copies
+ * between surfaces of the same format. Each kernel has a scalar reference,
+ * an SSE2 and a NEON version, picked at runtime in init_blit_kernels().
+ * NEON versions are only built when the compiler targets it (-mfpu=neon on
+ * 32-bit ARM).
+ *
+ * Blending is dst = (src*a + dst*(255-a))/255 per channel, rounded to
+ * nearest, destination alpha untouched. RGB565 destinations are expanded to
+ * 8 bits per channel by bit replication, and truncated back.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_BLIT_KERNELS_H
+#define FUNKEY_BLIT_KERNELS_H
+
+#include <stdint.h>
+#include <SDL/SDL.h>
+
+//#define BLIT_KERNELS_SELF_TEST                                /* Check every kernel against the scalar one at init */
+
+typedef struct{
+    const char *name;
+    void (*blend_argb8888_xrgb8888)(uint32_t *dst, const uint32_t *src, int w);
+    void (*blend_argb8888_rgb565)(uint16_t *dst, const uint32_t *src, int w);
+    void (*copy_row)(uint8_t *dst, const uint8_t *src, int nb_bytes);
+} blit_kernels_t;
+
+////------ Global variables -------
+
+extern blit_kernels_t blit_kernels;                             /* Kernels selected for this CPU */
+
+////------ Functions -------
+
+// Select kernels for this CPU, FUNKEY_BLIT_KERNELS=scalar forces the reference ones.
+// Returns the number of self-test mismatches (always 0 without BLIT_KERNELS_SELF_TEST).
+int init_blit_kernels();
+
+// Same as SDL_BlitSurface(), using the kernels for the formats they cover
+int blit_surface_fast(SDL_Surface *src, SDL_Rect *src_rect, SDL_Surface *dst, SDL_Rect *dst_rect);
+
+// Convert surface to ARGB8888 with per-pixel alpha, freeing it. Returns it as is on failure.
+SDL_Surface *convert_to_argb8888(SDL_Surface *surface);
+
+#endif //FUNKEY_BLIT_KERNELS_H
@@ -0,0 +1,219 @@
+/*
+ * configfile_fk.c
+ * Per-app menu settings (aspect ratio, save slot), persisted in a compact binary file
+ *
+ * Cycling a setting in the menu only marks the config dirty. The file is
+ * written by a short-lived thread once no change happened for
+ * CFG_SAVE_DEBOUNCE_MS, or when the menu closes, so the UI never waits on
+ * flash writes.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include <SDL/SDL.h>
+
+#include "configfile_fk.h"
+#include "sdl-menu.h"
+#include "crc32c.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define CFG_DEBUG
+#define CFG_ERROR
+
+#ifdef CFG_DEBUG
+#define CFG_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CFG_DEBUG_PRINTF(...)
+#endif //CFG_DEBUG
+
+#ifdef CFG_ERROR
+#define CFG_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CFG_ERROR_PRINTF(...)
+#endif //CFG_ERROR
+
+#define CFG_MAX_PATH_LEN            512
+
+extern int saveslot;
+
+
+/// -------------- STATIC VARIABLES --------------
+static char cfg_path[CFG_MAX_PATH_LEN] = {0};
+static int cfg_dirty = 0;
+static uint32_t cfg_last_change_ms = 0;
+
+static SDL_Thread *cfg_writer_thread = NULL;
+static int cfg_writer_busy = 0;                                 /* Only accessed atomically */
+static configfile_fk_file_t cfg_to_write;                       /* Snapshot taken when the write starts */
+
+
+/// --------------------------------------------
+/// -----------  CONFIGFILE functions  ---------
+/// --------------------------------------------
+
+/**
+ * Read the config with a single pread(), keeps the current values if it's missing, invalid or corrupted
+ */
+void configfile_load(const char *cfg_file_path){
+    configfile_fk_file_t file;
+    configfile_fk_t *cfg = &file.cfg;
+
+    if(cfg_file_path == NULL){
+        return;
+    }
+    snprintf(cfg_path, sizeof(cfg_path), "%s", cfg_file_path);
+    TRACE_SCOPE("configfile_load");
+
+    int fd = open(cfg_path, O_RDONLY);
+    if(fd < 0){
+        CFG_DEBUG_PRINTF("No config file %s, using defaults\n", cfg_path);
+        return;
+    }
+    ssize_t len = pread(fd, &file, sizeof(file), 0);
+    close(fd);
+
+    if(len != sizeof(file) || crc32c_header_check(&file.header, crc32c(0, cfg, sizeof(*cfg)), sizeof(*cfg)) ||
+        memcmp(cfg->magic, CFG_FILE_MAGIC, sizeof(cfg->magic)) ||
+        cfg->version != CFG_FILE_VERSION || cfg->size != sizeof(*cfg)){
+        CFG_ERROR_PRINTF("ERROR in configfile_load: Invalid config file %s, using defaults\n", cfg_path);
+        return;
+    }
+
+    aspect_ratio = (cfg->aspect_ratio < NB_ASPECT_RATIOS_TYPES)?cfg->aspect_ratio:aspect_ratio;
+    aspect_ratio_factor_percent = (cfg->aspect_ratio_factor_percent <= 100)?
+        cfg->aspect_ratio_factor_percent:aspect_ratio_factor_percent;
+    saveslot = (cfg->saveslot >= 0 && cfg->saveslot < MAX_SAVE_SLOTS)?cfg->saveslot:saveslot;
+    CFG_DEBUG_PRINTF("Loaded config %s: aspect ratio %u, factor %u%%, save slot %d\n",
+        cfg_path, aspect_ratio, aspect_ratio_factor_percent, saveslot);
+}
+
+static int configfile_write(void *data){
+    char tmp_path[CFG_MAX_PATH_LEN + 8];
+    char dir_path[CFG_MAX_PATH_LEN];
+    TRACE_SCOPE("configfile_write");
+
+    /// ------ Write a temp file, then rename it over the config so it's never half written ------
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cfg_path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        CFG_ERROR_PRINTF("ERROR in configfile_write: Could not open %s\n", tmp_path);
+        __atomic_store_n(&cfg_writer_busy, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    if(write(fd, &cfg_to_write, sizeof(cfg_to_write)) != sizeof(cfg_to_write) || fsync(fd)){
+        CFG_ERROR_PRINTF("ERROR in configfile_write: Could not write %s\n", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        __atomic_store_n(&cfg_writer_busy, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    close(fd);
+
+    if(rename(tmp_path, cfg_path)){
+        CFG_ERROR_PRINTF("ERROR in configfile_write: Could not rename %s\n", tmp_path);
+        unlink(tmp_path);
+    }
+    else{
+        /// ------ Make the rename itself durable ------
+        snprintf(dir_path, sizeof(dir_path), "%s", cfg_path);
+        int dir_fd = open(dirname(dir_path), O_RDONLY);
+        if(dir_fd >= 0){
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+        CFG_DEBUG_PRINTF("Saved config %s\n", cfg_path);
+    }
+
+    __atomic_store_n(&cfg_writer_busy, 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void configfile_start_write(){
+    /// ------ Previous write still running, retry on next poll ------
+    if(__atomic_load_n(&cfg_writer_busy, __ATOMIC_ACQUIRE)){
+        return;
+    }
+    if(cfg_writer_thread){
+        SDL_WaitThread(cfg_writer_thread, NULL);
+        cfg_writer_thread = NULL;
+    }
+
+    configfile_fk_t *cfg = &cfg_to_write.cfg;
+    memset(&cfg_to_write, 0, sizeof(cfg_to_write));
+    memcpy(cfg->magic, CFG_FILE_MAGIC, sizeof(cfg->magic));
+    cfg->version = CFG_FILE_VERSION;
+    cfg->size = sizeof(*cfg);
+    cfg->aspect_ratio = aspect_ratio;
+    cfg->aspect_ratio_factor_percent = aspect_ratio_factor_percent;
+    cfg->saveslot = saveslot;
+    crc32c_header_set(&cfg_to_write.header, crc32c(0, cfg, sizeof(*cfg)), sizeof(*cfg));
+    cfg_dirty = 0;
+
+    __atomic_store_n(&cfg_writer_busy, 1, __ATOMIC_RELEASE);
+    cfg_writer_thread = SDL_CreateThread(configfile_write, NULL);
+    if(cfg_writer_thread == NULL){
+        CFG_ERROR_PRINTF("ERROR in configfile_start_write: Could not create thread: %s\n", SDL_GetError());
+        __atomic_store_n(&cfg_writer_busy, 0, __ATOMIC_RELEASE);
+        cfg_dirty = 1;
+    }
+}
+
+/**
+ * A persisted setting changed, only restarts the debounce delay
+ */
+void configfile_changed(){
+    if(!cfg_path[0]){
+        return;
+    }
+    cfg_dirty = 1;
+    cfg_last_change_ms = SDL_GetTicks();
+}
+
+/**
+ * Start writing the config once nothing changed for CFG_SAVE_DEBOUNCE_MS, call once per frame
+ */
+void configfile_poll(){
+    if(cfg_dirty && SDL_GetTicks() - cfg_last_change_ms >= CFG_SAVE_DEBOUNCE_MS){
+        configfile_start_write();
+    }
+}
+
+/**
+ * Start writing pending changes now (menu closing), without waiting for that write
+ * A previous write still in flight is waited for, otherwise the changes would only be written on the next poll
+ */
+void configfile_flush(){
+    if(!cfg_dirty){
+        return;
+    }
+    if(cfg_writer_thread){
+        SDL_WaitThread(cfg_writer_thread, NULL);
+        cfg_writer_thread = NULL;
+    }
+    configfile_start_write();
+}
+
+/**
+ * Wait for the last write, and write changes still pending (app exiting)
+ */
+void configfile_wait(){
+    if(cfg_writer_thread){
+        SDL_WaitThread(cfg_writer_thread, NULL);
+        cfg_writer_thread = NULL;
+    }
+    if(cfg_dirty){
+        configfile_start_write();
+        if(cfg_writer_thread){
+            SDL_WaitThread(cfg_writer_thread, NULL);
+            cfg_writer_thread = NULL;
+        }
+    }
+}
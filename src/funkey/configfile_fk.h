@@ -0,0 +1,47 @@
+/*
+ * configfile_fk.h
+ * Per-app menu settings (aspect ratio, save slot), persisted in a compact binary file
+ *
+ * Read once at init, written back in the background only after a debounce
+ * delay or when the menu closes, with an atomic replace of the file.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_CONFIGFILE_FK_H
+#define FUNKEY_CONFIGFILE_FK_H
+
+#include <stdint.h>
+
+#include "crc32c.h"
+
+#define CFG_FILE_MAGIC              "FKCF"
+#define CFG_FILE_VERSION            2                           /* 2: behind a crc32c_header_t */
+#define CFG_SAVE_DEBOUNCE_MS        2000                        /* Quiet time after the last change before writing */
+
+/* Fixed layout, little endian, read and written in a single call */
+typedef struct{
+    char magic[4];
+    uint16_t version;
+    uint16_t size;
+    uint32_t aspect_ratio;
+    uint32_t aspect_ratio_factor_percent;
+    int32_t saveslot;
+    uint32_t reserved;
+} configfile_fk_t;
+
+/* The whole file */
+typedef struct{
+    crc32c_header_t header;
+    configfile_fk_t cfg;
+} configfile_fk_file_t;
+
+////------ Functions -------
+
+void configfile_load(const char *cfg_file_path);
+void configfile_changed();
+void configfile_poll();
+void configfile_flush();
+void configfile_wait();
+
+#endif //FUNKEY_CONFIGFILE_FK_H
@@ -0,0 +1,278 @@
+/*
+ * crc32c.c
+ * CRC32C (Castagnoli) for the integrity of save states and configs
+ *
+ * The CRC is kept inverted between calls, like zlib's crc32(), so calls can
+ * be chained over chunks. Hardware versions consume 8 bytes per instruction
+ * (4 on 32-bit x86) and finish with bytes, slicing-by-8 looks up 8 tables of
+ * 256 entries (8KB, built at init) per 8 bytes.
+ *
+ * The FunKey S (Cortex-A7, ARMv7) has no CRC instructions: it runs the
+ * tables. The ARMv8 version is only built with __ARM_FEATURE_CRC32
+ * (-march=armv8-a+crc).
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#define SSE42_TARGET                __attribute__((target("sse4.2")))
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define CRC32C_ARMV8
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32                 (1 << 7)                    /* aarch64 */
+#endif
+#ifndef HWCAP2_CRC32
+#define HWCAP2_CRC32                (1 << 4)                    /* 32-bit ARM */
+#endif
+#endif
+
+#include "crc32c.h"
+#include "time-utils.h"
+
+/// -------------- DEFINES --------------
+//#define CRC32C_DEBUG
+#define CRC32C_ERROR
+
+#ifdef CRC32C_DEBUG
+#define CRC32C_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CRC32C_DEBUG_PRINTF(...)
+#endif //CRC32C_DEBUG
+
+#ifdef CRC32C_ERROR
+#define CRC32C_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CRC32C_ERROR_PRINTF(...)
+#endif //CRC32C_ERROR
+
+#define CRC32C_POLY                 0x82F63B78                  /* Reflected */
+#define CRC32C_BENCH_CHUNK_SIZE     (64*1024)                   /* Like the menu's slot reads */
+
+typedef uint32_t (*crc32c_kernel_t)(uint32_t crc, const uint8_t *data, size_t size);
+
+
+/// -------------- STATIC VARIABLES --------------
+static uint32_t crc32c_tables[8][256];
+static crc32c_kernel_t crc32c_kernel = NULL;                    /* NULL until init_crc32c() */
+static const char *kernel_name = "none";
+
+
+/// --------------------------------------------
+/// -------------  CRC32C functions  -----------
+/// --------------------------------------------
+
+static void init_crc32c_tables(){
+    for(int i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for(int bit = 0; bit < 8; bit++){
+            crc = (crc >> 1) ^ ((crc & 1)?CRC32C_POLY:0);
+        }
+        crc32c_tables[0][i] = crc;
+    }
+    for(int i = 0; i < 256; i++){
+        for(int t = 1; t < 8; t++){
+            crc32c_tables[t][i] = (crc32c_tables[t-1][i] >> 8) ^ crc32c_tables[0][crc32c_tables[t-1][i] & 0xff];
+        }
+    }
+}
+
+static uint32_t crc32c_slicing8(uint32_t crc, const uint8_t *data, size_t size){
+    /// ------ Bytes until 4-byte aligned, then 8 bytes per round ------
+    while(size && ((uintptr_t)data & 3)){
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *data++) & 0xff];
+        size--;
+    }
+    while(size >= 8){
+        uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+        uint32_t hi = data[4] | data[5] << 8 | data[6] << 16 | (uint32_t)data[7] << 24;
+        crc = crc32c_tables[7][lo & 0xff] ^ crc32c_tables[6][(lo >> 8) & 0xff] ^
+            crc32c_tables[5][(lo >> 16) & 0xff] ^ crc32c_tables[4][lo >> 24] ^
+            crc32c_tables[3][hi & 0xff] ^ crc32c_tables[2][(hi >> 8) & 0xff] ^
+            crc32c_tables[1][(hi >> 16) & 0xff] ^ crc32c_tables[0][hi >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while(size--){
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(CRC32C_SSE42)
+SSE42_TARGET static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size){
+    while(size && ((uintptr_t)data & 7)){
+        crc = _mm_crc32_u8(crc, *data++);
+        size--;
+    }
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for(; size >= 8; data += 8, size -= 8){
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for(; size >= 4; data += 4, size -= 4){
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while(size--){
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#elif defined(CRC32C_ARMV8)
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *data, size_t size){
+    while(size && ((uintptr_t)data & 7)){
+        crc = __crc32cb(crc, *data++);
+        size--;
+    }
+    for(; size >= 8; data += 8, size -= 8){
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+    }
+    while(size--){
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+#ifdef CRC32C_SELF_TEST
+/* Selected kernel against the tables, over every alignment and a few sizes */
+static int self_test_crc32c(){
+    uint8_t buf[1024 + 8];
+    int nb_errors = 0;
+    for(size_t i = 0; i < sizeof(buf); i++){
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+    for(int offset = 0; offset < 8; offset++){
+        for(size_t size = 0; size <= 1024; size += 1 + size/4){
+            uint32_t ref = crc32c_slicing8(0xFFFFFFFF, buf + offset, size);
+            nb_errors += (crc32c_kernel(0xFFFFFFFF, buf + offset, size) != ref);
+        }
+    }
+    nb_errors += (crc32c(0, "123456789", 9) != 0xE3069283);
+    return nb_errors;
+}
+#endif //CRC32C_SELF_TEST
+
+int init_crc32c(){
+    int nb_errors = 0;
+    const char *env = getenv("FUNKEY_CRC32C");
+    init_crc32c_tables();
+    crc32c_kernel = crc32c_slicing8;
+    kernel_name = "slicing-by-8";
+
+    if(env == NULL || strcmp(env, "slicing8")){
+#if defined(CRC32C_SSE42)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse4.2")){
+            crc32c_kernel = crc32c_sse42;
+            kernel_name = "sse4.2";
+        }
+#elif defined(CRC32C_ARMV8) && defined(__aarch64__)
+        if(getauxval(AT_HWCAP) & HWCAP_CRC32){
+            crc32c_kernel = crc32c_armv8;
+            kernel_name = "armv8";
+        }
+#elif defined(CRC32C_ARMV8)
+        if(getauxval(AT_HWCAP2) & HWCAP2_CRC32){
+            crc32c_kernel = crc32c_armv8;
+            kernel_name = "armv8";
+        }
+#endif
+    }
+
+#ifdef CRC32C_SELF_TEST
+    nb_errors = self_test_crc32c();
+    printf("CRC32C: %s self-test %s (%d errors)\n", kernel_name, nb_errors?"FAILED":"passed", nb_errors);
+    if(nb_errors){
+        crc32c_kernel = crc32c_slicing8;
+        kernel_name = "slicing-by-8";
+    }
+#endif //CRC32C_SELF_TEST
+    CRC32C_DEBUG_PRINTF("CRC32C: using %s\n", kernel_name);
+    return nb_errors;
+}
+
+const char *crc32c_kernel_name(){
+    return kernel_name;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size){
+    if(crc32c_kernel == NULL){
+        init_crc32c();
+    }
+    return ~crc32c_kernel(~crc, (const uint8_t*)data, size);
+}
+
+void crc32c_header_set(crc32c_header_t *header, uint32_t crc, size_t size){
+    header->magic = CRC32C_HEADER_MAGIC;
+    header->size = size;
+    header->crc = crc;
+    header->reserved = 0;
+}
+
+int crc32c_header_check(const crc32c_header_t *header, uint32_t crc, size_t size){
+    if(header->magic != CRC32C_HEADER_MAGIC || header->size != size){
+        CRC32C_ERROR_PRINTF("ERROR: %zu bytes instead of %u, file truncated or not checksummed\n", size, header->size);
+        return -1;
+    }
+    if(header->crc != crc){
+        CRC32C_ERROR_PRINTF("ERROR: CRC32C %08x instead of %08x, file corrupted\n", crc, header->crc);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Same streaming as slot loads, on any file (multi-MB states): the CRC must
+ * stay well above the read speed for checking to be free
+ */
+int crc32c_bench_file(const char *path){
+    static uint8_t buf[CRC32C_BENCH_CHUNK_SIZE];
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        CRC32C_ERROR_PRINTF("ERROR in crc32c_bench_file: Could not open %s\n", path);
+        return -1;
+    }
+
+    uint32_t crc = 0;
+    uint64_t size = 0, read_us = 0, crc_us = 0;
+    ssize_t res;
+    do{
+        uint64_t start_us = get_time_us();
+        res = read(fd, buf, sizeof(buf));
+        uint64_t crc_start_us = get_time_us();
+        read_us += crc_start_us - start_us;
+        if(res > 0){
+            crc = crc32c(crc, buf, res);
+            crc_us += get_time_us() - crc_start_us;
+            size += res;
+        }
+    } while(res > 0);
+    close(fd);
+    if(res < 0){
+        CRC32C_ERROR_PRINTF("ERROR in crc32c_bench_file: Could not read %s\n", path);
+        return -1;
+    }
+
+    printf("CRC32C: %s, %llu bytes, crc %08x, read %.1fMB/s, %s %.1fMB/s\n", path, (unsigned long long)size, crc,
+        read_us?size/(double)read_us:0.0, kernel_name, crc_us?size/(double)crc_us:0.0);
+    return 0;
+}
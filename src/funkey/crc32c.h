@@ -0,0 +1,53 @@
+/*
+ * crc32c.h
+ * CRC32C (Castagnoli) for the integrity of save states and configs
+ *
+ * Uses the CPU's CRC instructions when available (SSE4.2, or ARMv8 CRC when
+ * built for it), slicing-by-8 tables otherwise. All give the same result,
+ * crc32c(0, "123456789", 9) is 0xE3069283.
+ *
+ * Files written by the Funkey integration start with a crc32c_header_t: the
+ * length of what follows and its CRC32C, so a truncated or corrupted file
+ * (power cut while writing) is refused instead of loaded. Readers compute
+ * the CRC while the data streams in, chunk by chunk, to avoid a second pass.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_CRC32C_H
+#define FUNKEY_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//#define CRC32C_SELF_TEST                                      /* Check the selected kernel against the tables at init */
+
+#define CRC32C_HEADER_MAGIC         0x4B434B46                  /* "FKCK" */
+
+typedef struct{
+    uint32_t magic;
+    uint32_t size;                                              /* Bytes following this header */
+    uint32_t crc;                                               /* CRC32C of them */
+    uint32_t reserved;
+} crc32c_header_t;
+
+////------ Functions -------
+
+// Select the kernel for this CPU, FUNKEY_CRC32C=slicing8 forces the tables.
+// Runs on first use otherwise, call it at init before CRCs are computed from several threads.
+// Returns the number of self-test mismatches (always 0 without CRC32C_SELF_TEST).
+int init_crc32c();
+const char *crc32c_kernel_name();
+
+// Continue crc (0 to start) over size bytes of data
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+void crc32c_header_set(crc32c_header_t *header, uint32_t crc, size_t size);
+
+// Returns 0 if header describes exactly size bytes with this crc
+int crc32c_header_check(const crc32c_header_t *header, uint32_t crc, size_t size);
+
+// Read path in chunks, checksumming each one, and print read and CRC32C throughputs. Returns 0 on success.
+int crc32c_bench_file(const char *path);
+
+#endif //FUNKEY_CRC32C_H
@@ -0,0 +1,217 @@
+/*
+ * frame-capture.c
+ * Records every presented frame to a file, for QA and performance triage
+ *
+ * Single producer (the thread calling the present path), single consumer
+ * (the writer thread): the producer only advances capture_head and the
+ * writer only advances capture_tail, so the ring needs no lock.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL/SDL.h>
+
+#include "frame-capture.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define CAPTURE_DEBUG
+#define CAPTURE_ERROR
+
+#ifdef CAPTURE_DEBUG
+#define CAPTURE_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CAPTURE_DEBUG_PRINTF(...)
+#endif //CAPTURE_DEBUG
+
+#ifdef CAPTURE_ERROR
+#define CAPTURE_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CAPTURE_ERROR_PRINTF(...)
+#endif //CAPTURE_ERROR
+
+//#define CAPTURE_PERF
+
+#ifdef CAPTURE_PERF
+#define CAPTURE_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define CAPTURE_PERF_PRINTF(...)
+#endif //CAPTURE_PERF
+
+#define CAPTURE_FILE_BUFFER_SIZE    (256*1024)
+
+
+/// -------------- STATIC VARIABLES --------------
+static FILE *capture_file = NULL;
+static SDL_Thread *capture_thread = NULL;
+static SDL_sem *capture_sem = NULL;
+static volatile int capture_thread_quit = 0;
+
+static uint8_t *capture_pixels = NULL;                          /* NB_FRAME_CAPTURE_SLOTS frames, allocated once */
+static frame_capture_frame_t capture_frames[NB_FRAME_CAPTURE_SLOTS];
+static uint32_t capture_frame_size = 0;
+static uint32_t capture_row_size = 0;
+static int capture_height = 0;
+
+static uint32_t capture_head = 0;                               /* Written by the producer, read atomically by the writer */
+static uint32_t capture_tail = 0;                               /* Written by the writer, read atomically by the producer */
+static uint32_t nb_frames_presented = 0;
+static uint32_t nb_frames_dropped = 0;
+static uint32_t nb_frames_written = 0;
+
+
+/// --------------------------------------------
+/// -------------  CAPTURE functions  ----------
+/// --------------------------------------------
+
+static int capture_writer_loop(void *data){
+    while(1){
+        SDL_SemWait(capture_sem);
+
+        uint32_t head = __atomic_load_n(&capture_head, __ATOMIC_ACQUIRE);
+        while(capture_tail != head){
+            uint32_t slot = capture_tail % NB_FRAME_CAPTURE_SLOTS;
+            TRACE_SCOPE("frame capture: write");
+
+            if(fwrite(&capture_frames[slot], sizeof(frame_capture_frame_t), 1, capture_file) != 1 ||
+                fwrite(capture_pixels + (size_t)slot*capture_frame_size, capture_frame_size, 1, capture_file) != 1){
+                CAPTURE_ERROR_PRINTF("ERROR in frame capture: Could not write frame %u\n", capture_frames[slot].frame_idx);
+            }
+            else{
+                nb_frames_written++;
+            }
+            __atomic_store_n(&capture_tail, capture_tail+1, __ATOMIC_RELEASE);
+        }
+
+        if(capture_thread_quit){
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Start recording frames presented on screen to output_path. Returns 0 on success.
+ */
+int init_frame_capture(SDL_Surface* screen, const char *output_path){
+    frame_capture_header_t header;
+
+    if(capture_thread){
+        return 0;
+    }
+
+    capture_file = fopen(output_path, "wb");
+    if(capture_file == NULL){
+        CAPTURE_ERROR_PRINTF("ERROR in init_frame_capture: Could not open %s\n", output_path);
+        return -1;
+    }
+    setvbuf(capture_file, NULL, _IOFBF, CAPTURE_FILE_BUFFER_SIZE);
+
+    capture_row_size = screen->w * screen->format->BytesPerPixel;
+    capture_height = screen->h;
+    capture_frame_size = capture_row_size * screen->h;
+    capture_pixels = (uint8_t*) malloc((size_t)capture_frame_size * NB_FRAME_CAPTURE_SLOTS);
+    if(capture_pixels == NULL){
+        CAPTURE_ERROR_PRINTF("ERROR in init_frame_capture: Could not allocate %d frames\n", NB_FRAME_CAPTURE_SLOTS);
+        deinit_frame_capture();
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_CAPTURE_MAGIC, sizeof(header.magic));
+    header.width = screen->w;
+    header.height = screen->h;
+    header.bytes_per_pixel = screen->format->BytesPerPixel;
+    header.rmask = screen->format->Rmask;
+    header.gmask = screen->format->Gmask;
+    header.bmask = screen->format->Bmask;
+    fwrite(&header, sizeof(header), 1, capture_file);
+
+    capture_head = capture_tail = 0;
+    nb_frames_presented = nb_frames_dropped = nb_frames_written = 0;
+    capture_thread_quit = 0;
+
+    capture_sem = SDL_CreateSemaphore(0);
+    if(capture_sem != NULL){
+        capture_thread = SDL_CreateThread(capture_writer_loop, NULL);
+    }
+    if(capture_thread == NULL){
+        CAPTURE_ERROR_PRINTF("ERROR in init_frame_capture: Could not create writer thread: %s\n", SDL_GetError());
+        deinit_frame_capture();
+        return -1;
+    }
+
+    CAPTURE_DEBUG_PRINTF("Capturing frames to %s\n", output_path);
+    return 0;
+}
+
+/**
+ * Write remaining frames and stop recording
+ */
+void deinit_frame_capture(){
+    if(capture_thread){
+        capture_thread_quit = 1;
+        SDL_SemPost(capture_sem);
+        SDL_WaitThread(capture_thread, NULL);
+        capture_thread = NULL;
+
+        CAPTURE_PERF_PRINTF("Frame capture: %u frames presented, %u written, %u dropped\n",
+            nb_frames_presented, nb_frames_written, nb_frames_dropped);
+    }
+    if(capture_sem){
+        SDL_DestroySemaphore(capture_sem);
+        capture_sem = NULL;
+    }
+    if(capture_file){
+        fclose(capture_file);
+        capture_file = NULL;
+    }
+    if(capture_pixels){
+        free(capture_pixels);
+        capture_pixels = NULL;
+    }
+}
+
+int frame_capture_running(){
+    return capture_thread != NULL;
+}
+
+void frame_capture_push(SDL_Surface* frame){
+    if(!capture_thread){
+        return;
+    }
+    uint32_t frame_idx = nb_frames_presented++;
+
+    /// ------ Writer behind, drop rather than wait ------
+    uint32_t tail = __atomic_load_n(&capture_tail, __ATOMIC_ACQUIRE);
+    if(capture_head - tail >= NB_FRAME_CAPTURE_SLOTS){
+        nb_frames_dropped++;
+        return;
+    }
+
+    TRACE_SCOPE("frame capture: copy");
+    uint32_t slot = capture_head % NB_FRAME_CAPTURE_SLOTS;
+    uint8_t *dst = capture_pixels + (size_t)slot*capture_frame_size;
+
+    if(SDL_MUSTLOCK(frame)){
+        SDL_LockSurface(frame);
+    }
+    for(int y = 0; y < capture_height; y++){
+        memcpy(dst + y*capture_row_size, (uint8_t*)frame->pixels + y*frame->pitch, capture_row_size);
+    }
+    if(SDL_MUSTLOCK(frame)){
+        SDL_UnlockSurface(frame);
+    }
+
+    capture_frames[slot].timestamp_us = get_time_us();
+    capture_frames[slot].frame_idx = frame_idx;
+    capture_frames[slot].size = capture_frame_size;
+
+    __atomic_store_n(&capture_head, capture_head+1, __ATOMIC_RELEASE);
+    SDL_SemPost(capture_sem);
+}
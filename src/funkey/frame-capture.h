@@ -0,0 +1,49 @@
+/*
+ * frame-capture.h
+ * Records every presented frame to a file, for QA and performance triage
+ *
+ * Frames are copied into a preallocated ring from the present path and
+ * written by a background thread. Capture never blocks rendering: when the
+ * writer falls behind, frames are dropped and counted.
+ *
+ * File layout (little endian, see tools/capture-convert.py):
+ *   header: frame_capture_header_t
+ *   frames: frame_capture_frame_t, followed by height*width*bytes_per_pixel bytes of pixels
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_FRAME_CAPTURE_H
+#define FUNKEY_FRAME_CAPTURE_H
+
+#include <stdint.h>
+#include <SDL/SDL.h>
+
+#define FRAME_CAPTURE_MAGIC         "FKCAPTR1"
+#define NB_FRAME_CAPTURE_SLOTS      16                          /* Frames buffered while the writer catches up */
+
+typedef struct{
+    char magic[8];
+    uint16_t width;
+    uint16_t height;
+    uint8_t bytes_per_pixel;
+    uint8_t reserved[3];
+    uint32_t rmask, gmask, bmask;
+} frame_capture_header_t;
+
+typedef struct{
+    uint64_t timestamp_us;                                      /* Monotonic, when the frame was presented */
+    uint32_t frame_idx;                                         /* Gaps are dropped frames */
+    uint32_t size;                                              /* Bytes of pixels that follow */
+} frame_capture_frame_t;
+
+////------ Functions -------
+
+int init_frame_capture(SDL_Surface* screen, const char *output_path);
+void deinit_frame_capture();
+int frame_capture_running();
+
+// Called from the present path with the frame about to be shown, never blocks
+void frame_capture_push(SDL_Surface* frame);
+
+#endif //FUNKEY_FRAME_CAPTURE_H
@@ -0,0 +1,120 @@
+/*
+ * instant-play.c
+ * Native writer for the Instant Play resume record
+ *
+ * The record is formatted into a single block-aligned buffer, zero padded to
+ * INSTANT_PLAY_BLOCK_SIZE so it can go through O_DIRECT in one write(), then
+ * the file is truncated to the record's length. fsync() runs once, before the
+ * rename: the powerdown that follows syncs the directory.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#define _GNU_SOURCE                                             /* O_DIRECT */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "instant-play.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define INSTANT_PLAY_DEBUG
+#define INSTANT_PLAY_ERROR
+
+#ifdef INSTANT_PLAY_DEBUG
+#define INSTANT_PLAY_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define INSTANT_PLAY_DEBUG_PRINTF(...)
+#endif //INSTANT_PLAY_DEBUG
+
+#ifdef INSTANT_PLAY_ERROR
+#define INSTANT_PLAY_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define INSTANT_PLAY_ERROR_PRINTF(...)
+#endif //INSTANT_PLAY_ERROR
+
+#define MAXPATHLEN                  512
+
+
+/// -------------- STATIC VARIABLES --------------
+static char record_buf[INSTANT_PLAY_BLOCK_SIZE] __attribute__((aligned(INSTANT_PLAY_BLOCK_SIZE)));
+
+
+/// --------------------------------------------
+/// ----------  INSTANT PLAY functions  --------
+/// --------------------------------------------
+
+int instant_play_format(char *buf, size_t size, int argc, const char *const argv[]){
+    size_t len = 0;
+
+    /// ------ Same as the script: echo -n "'${arg}' " for each argument ------
+    for(int i = 0; i < argc; i++){
+        size_t arg_len = strlen(argv[i]);
+        if(strchr(argv[i], '\'') || len + arg_len + 3 > size){
+            return -1;
+        }
+        buf[len++] = '\'';
+        memcpy(buf + len, argv[i], arg_len);
+        len += arg_len;
+        buf[len++] = '\'';
+        buf[len++] = ' ';
+    }
+
+    if(len + sizeof(INSTANT_PLAY_TRAILER)-1 > size){
+        return -1;
+    }
+    memcpy(buf + len, INSTANT_PLAY_TRAILER, sizeof(INSTANT_PLAY_TRAILER)-1);
+    return len + sizeof(INSTANT_PLAY_TRAILER)-1;
+}
+
+/* O_DIRECT isn't supported everywhere (tmpfs), buffered writes are fine there */
+static int open_direct(const char *path){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if(fd < 0 && errno == EINVAL){
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    return fd;
+}
+
+int instant_play_write(const char *path, int argc, const char *const argv[]){
+    TRACE_SCOPE("instant play: write");
+
+    int len = instant_play_format(record_buf, sizeof(record_buf), argc, argv);
+    if(len < 0){
+        INSTANT_PLAY_ERROR_PRINTF("ERROR in instant_play_write: Command line can't be written as a record\n");
+        return -1;
+    }
+    memset(record_buf + len, 0, sizeof(record_buf) - len);
+
+    char tmp_path[MAXPATHLEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open_direct(tmp_path);
+    if(fd < 0){
+        INSTANT_PLAY_ERROR_PRINTF("ERROR in instant_play_write: Could not open %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    int res = 0;
+    if(write(fd, record_buf, sizeof(record_buf)) != (ssize_t)sizeof(record_buf) ||
+        ftruncate(fd, len) || fsync(fd)){
+        INSTANT_PLAY_ERROR_PRINTF("ERROR in instant_play_write: Could not write %s: %s\n", tmp_path, strerror(errno));
+        res = -1;
+    }
+    close(fd);
+
+    if(!res && rename(tmp_path, path)){
+        INSTANT_PLAY_ERROR_PRINTF("ERROR in instant_play_write: Could not rename %s: %s\n", tmp_path, strerror(errno));
+        res = -1;
+    }
+    if(res){
+        unlink(tmp_path);
+    }
+    INSTANT_PLAY_DEBUG_PRINTF("Instant Play: %d bytes record written to %s\n", len, path);
+    return res;
+}
@@ -0,0 +1,33 @@
+/*
+ * instant-play.h
+ * Native writer for the Instant Play resume record
+ *
+ * The record is what `instant_play save <command line>` writes to
+ * /mnt/instant_play: every argument single-quoted and followed by a space,
+ * then the lines that relaunch the app in the background on next boot and
+ * track its PID. Writing it from the app removes the shell spawn from the
+ * quick save deadline, the bytes must stay identical to the script's:
+ * tools/instant-play-compare.sh checks them against the installed script.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_INSTANT_PLAY_H
+#define FUNKEY_INSTANT_PLAY_H
+
+#include <stddef.h>
+
+#define INSTANT_PLAY_PATH           "/mnt/instant_play"
+#define INSTANT_PLAY_BLOCK_SIZE     4096                        /* Record is written as one aligned block, then truncated */
+#define INSTANT_PLAY_TRAILER        "&\npid record $!\nwait $!\npid erase\n"
+
+////------ Functions -------
+
+// Format the record for argv[0..argc-1] into buf. Returns its length, or -1 if it
+// doesn't fit or an argument contains a single quote (the script doesn't escape them)
+int instant_play_format(char *buf, size_t size, int argc, const char *const argv[]);
+
+// Write the record atomically (temporary file, single fsync, rename). Returns 0 on success.
+int instant_play_write(const char *path, int argc, const char *const argv[]);
+
+#endif //FUNKEY_INSTANT_PLAY_H
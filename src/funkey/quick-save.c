@@ -0,0 +1,547 @@
+/*
+ * quick-save.c
+ * Quick save when the console is closed, within the time left before power is cut
+ *
+ * Before each stage that can be dropped, its cost is estimated from what was
+ * measured so far in this attempt (write throughput, fsync time, compression
+ * speed), or from conservative defaults, and compared to the time left minus
+ * QUICK_SAVE_RESERVE_MS. Levels only go down within an attempt.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <SDL/SDL.h>
+
+#include "quick-save.h"
+#include "instant-play.h"
+#include "crc32c.h"
+#include "sdl-menu.h"
+#include "rle.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+//#define QUICK_SAVE_DEBUG
+#define QUICK_SAVE_ERROR
+
+#ifdef QUICK_SAVE_DEBUG
+#define QUICK_SAVE_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define QUICK_SAVE_DEBUG_PRINTF(...)
+#endif //QUICK_SAVE_DEBUG
+
+#ifdef QUICK_SAVE_ERROR
+#define QUICK_SAVE_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define QUICK_SAVE_ERROR_PRINTF(...)
+#endif //QUICK_SAVE_ERROR
+
+#define MAXPATHLEN                  512
+#define QUICK_SAVE_WRITE_SIZE       (64*1024)                   /* Per write() call, to measure throughput as we go */
+#define QUICK_SAVE_READ_SIZE        (64*1024)                   /* Per fread() call, checksummed while the next is read */
+#define QUICK_SAVE_DEFAULT_WRITE_KBPS   1024                    /* Until a write was measured */
+#define QUICK_SAVE_DEFAULT_FSYNC_MS     50                      /* Until an fsync was measured */
+#define QUICK_SAVE_THUMBNAIL_SCALE  2                           /* Thumbnail is the frame downscaled by this */
+#define QUICK_SAVE_THUMBNAIL_MAGIC  0x4E544B46                  /* "FKTN" */
+
+#define QUICK_SAVE_STAGES \
+    X(QUICK_SAVE_STAGE_HANDLE, "handle") \
+    X(QUICK_SAVE_STAGE_SNAPSHOT, "snapshot") \
+    X(QUICK_SAVE_STAGE_COMPRESS, "compress") \
+    X(QUICK_SAVE_STAGE_WRITE, "write") \
+    X(QUICK_SAVE_STAGE_FSYNC, "fsync") \
+    X(QUICK_SAVE_STAGE_THUMBNAIL, "thumbnail") \
+    X(QUICK_SAVE_STAGE_INSTANT_PLAY, "instant play") \
+    X(NB_QUICK_SAVE_STAGES, "")
+
+#undef X
+#define X(a, b) a,
+typedef enum {QUICK_SAVE_STAGES} ENUM_QUICK_SAVE_STAGE;
+
+#undef X
+#define X(a, b) b,
+static const char *quick_save_stage_name[] = {QUICK_SAVE_STAGES};
+static const char *quick_save_level_name[] = {QUICK_SAVE_LEVELS};
+
+typedef struct{
+    uint32_t magic;
+    uint16_t w, h;
+    uint32_t bytes_per_pixel;
+} quick_save_thumbnail_header_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static uint8_t *quick_save_memory = NULL;                       /* Single allocation: state, compressed state, thumbnail */
+static uint8_t *state_buf = NULL;
+static uint8_t *compressed_buf = NULL;
+static uint8_t *thumbnail_buf = NULL;
+static size_t state_size = 0;
+static size_t thumbnail_size = 0;                               /* Max, for a 32bpp frame */
+
+static char save_path[MAXPATHLEN];
+static char save_tmp_path[MAXPATHLEN];
+static char save_dir_path[MAXPATHLEN];
+static char thumbnail_path[MAXPATHLEN];
+static quick_save_state_t quick_save_state = NULL;
+static uint64_t deadline_us = 0;
+static int write_delay_ms = 0;
+static int dry_run = 0;
+static const char *log_path = QUICK_SAVE_LOG_PATH;
+
+static volatile uint64_t signal_us = 0;                         /* Set by quick_save_signal(), 0 if not signaled */
+
+/* This attempt */
+static ENUM_QUICK_SAVE_LEVEL level;
+static uint64_t start_us;
+static uint64_t stage_start_us;                                 /* End of the previous stage */
+static uint64_t stage_us[NB_QUICK_SAVE_STAGES];
+static int stage_skipped[NB_QUICK_SAVE_STAGES];
+static uint64_t written_bytes, written_us;                      /* Measured write throughput */
+static uint64_t fsync_us;                                       /* Longest fsync measured */
+
+
+/// --------------------------------------------
+/// -----------  QUICK SAVE functions  ---------
+/// --------------------------------------------
+
+int init_quick_save(const char *path, const char *thumb_path, size_t size,
+    quick_save_state_t save_state, int deadline_ms){
+    if(quick_save_memory){
+        return 0;
+    }
+
+    size_t nb_chunks = (size + QUICK_SAVE_CHUNK_SIZE-1)/QUICK_SAVE_CHUNK_SIZE;
+    size_t compressed_size = nb_chunks * rle_max_encoded_size(QUICK_SAVE_CHUNK_SIZE);
+    thumbnail_size = thumb_path?(size_t)(SCREEN_HORIZONTAL_SIZE/QUICK_SAVE_THUMBNAIL_SCALE)*
+        (SCREEN_VERTICAL_SIZE/QUICK_SAVE_THUMBNAIL_SCALE)*4:0;
+
+    quick_save_memory = (uint8_t*) calloc(1, size + compressed_size + thumbnail_size);
+    if(quick_save_memory == NULL){
+        QUICK_SAVE_ERROR_PRINTF("ERROR in init_quick_save: Could not allocate %zu bytes\n",
+            size + compressed_size + thumbnail_size);
+        return -1;
+    }
+    state_buf = quick_save_memory;
+    compressed_buf = state_buf + size;
+    thumbnail_buf = thumb_path?(compressed_buf + compressed_size):NULL;
+    state_size = size;
+
+    /// ------ Paths are built now, nothing is formatted while saving ------
+    snprintf(save_path, sizeof(save_path), "%s", path);
+    snprintf(save_tmp_path, sizeof(save_tmp_path), "%s.tmp", path);
+    snprintf(save_dir_path, sizeof(save_dir_path), "%s", path);
+    char *slash = strrchr(save_dir_path, '/');
+    if(slash){
+        slash[(slash == save_dir_path)?1:0] = '\0';
+    }
+    else{
+        snprintf(save_dir_path, sizeof(save_dir_path), ".");
+    }
+    snprintf(thumbnail_path, sizeof(thumbnail_path), "%s", thumb_path?thumb_path:"");
+
+    quick_save_state = save_state;
+    deadline_us = (uint64_t)deadline_ms * 1000;
+    return 0;
+}
+
+void deinit_quick_save(){
+    if(quick_save_memory){
+        free(quick_save_memory);
+        quick_save_memory = NULL;
+    }
+}
+
+void quick_save_signal(){
+    if(!signal_us){
+        signal_us = get_time_us();
+    }
+}
+
+void quick_save_set_write_delay(int delay_ms){
+    write_delay_ms = delay_ms;
+}
+
+void quick_save_set_dry_run(int enable){
+    dry_run = enable;
+}
+
+void quick_save_set_log_path(const char *path){
+    log_path = path;
+}
+
+/* Time left before the deadline, minus the reserve for the Instant Play record and powerdown */
+static int64_t get_time_left_us(){
+    return (int64_t)deadline_us - (int64_t)(get_time_us() - start_us) - QUICK_SAVE_RESERVE_MS*1000;
+}
+
+static uint64_t estimate_write_us(size_t nb_bytes){
+    if(written_bytes){
+        return nb_bytes * written_us / written_bytes;
+    }
+    return (uint64_t)nb_bytes * 1000000 / (QUICK_SAVE_DEFAULT_WRITE_KBPS*1024);
+}
+
+static uint64_t estimate_fsync_us(){
+    return fsync_us?fsync_us:QUICK_SAVE_DEFAULT_FSYNC_MS*1000;
+}
+
+/* Adds the time since the end of the previous stage to this one */
+static void end_stage(ENUM_QUICK_SAVE_STAGE stage){
+    uint64_t now_us = get_time_us();
+    stage_us[stage] += now_us - stage_start_us;
+    stage_start_us = now_us;
+}
+
+/* Drop to at least new_level */
+static void fall_back(ENUM_QUICK_SAVE_LEVEL new_level){
+    if(new_level > level){
+        QUICK_SAVE_DEBUG_PRINTF("Quick save: falling back to %s, %lldus left\n",
+            quick_save_level_name[new_level], (long long)get_time_left_us());
+        level = new_level;
+    }
+}
+
+static int write_all(int fd, const void *buf, size_t size){
+    const uint8_t *data = (const uint8_t*) buf;
+    while(size){
+        size_t nb_bytes = (size > QUICK_SAVE_WRITE_SIZE)?QUICK_SAVE_WRITE_SIZE:size;
+        uint64_t write_start_us = get_time_us();
+        if(write_delay_ms){
+            usleep(write_delay_ms*1000);
+        }
+        ssize_t res = write(fd, data, nb_bytes);
+        if(res < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            QUICK_SAVE_ERROR_PRINTF("ERROR in quick save: write failed: %s\n", strerror(errno));
+            return -1;
+        }
+        written_bytes += res;
+        written_us += get_time_us() - write_start_us;
+        data += res;
+        size -= res;
+    }
+    return 0;
+}
+
+static int fsync_timed(int fd){
+    uint64_t fsync_start_us = get_time_us();
+    int res = fsync(fd);
+    uint64_t elapsed_us = get_time_us() - fsync_start_us;
+    if(elapsed_us > fsync_us){
+        fsync_us = elapsed_us;
+    }
+    return res;
+}
+
+/* Compress chunk by chunk, giving up as soon as it wouldn't leave time to write. Returns the size, 0 if given up. */
+static size_t compress_state(){
+    size_t nb_bytes = 0;
+    for(size_t pos = 0; pos < state_size; pos += QUICK_SAVE_CHUNK_SIZE){
+        static const uint8_t zeros[QUICK_SAVE_CHUNK_SIZE];
+        size_t size = state_size - pos;
+        size = (size > QUICK_SAVE_CHUNK_SIZE)?QUICK_SAVE_CHUNK_SIZE:size;
+        nb_bytes += rle_encode_xor(compressed_buf + nb_bytes, state_buf + pos, zeros, size);
+
+        /// ------ Project the rest from this attempt's speed and ratio ------
+        size_t done = pos + size;
+        uint64_t elapsed_us = get_time_us() - stage_start_us;
+        uint64_t compress_left_us = elapsed_us * (state_size - done) / done;
+        size_t projected_size = (size_t)((uint64_t)nb_bytes * state_size / done);
+        if(compress_left_us + estimate_write_us(projected_size) + 2*estimate_fsync_us() > (uint64_t)MAX(get_time_left_us(), 0)){
+            return 0;
+        }
+    }
+    return nb_bytes;
+}
+
+static int write_state(const void *data, size_t data_size, uint32_t flags){
+    quick_save_header_t header = {QUICK_SAVE_MAGIC, QUICK_SAVE_VERSION, flags, state_size, data_size};
+
+    /// ------ Never truncate the last good save, even when time is short ------
+    int fd = open(save_tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        QUICK_SAVE_ERROR_PRINTF("ERROR in quick save: Could not open %s: %s\n", save_tmp_path, strerror(errno));
+        return -1;
+    }
+    /// ------ Checksummed, so a state cut short by the power is refused when loading ------
+    crc32c_header_t crc_header;
+    crc32c_header_set(&crc_header, crc32c(crc32c(0, &header, sizeof(header)), data, data_size),
+        sizeof(header) + data_size);
+    int res = write_all(fd, &crc_header, sizeof(crc_header));
+    res = res?res:write_all(fd, &header, sizeof(header));
+    res = res?res:write_all(fd, data, data_size);
+    end_stage(QUICK_SAVE_STAGE_WRITE);
+
+    /// ------ Make it durable, then atomically replace the previous save ------
+    res = res?res:fsync_timed(fd);
+    close(fd);
+    res = res?res:rename(save_tmp_path, save_path);
+
+    /// ------ The rename itself is only durable once the directory is synced, skipped when time is short ------
+    if(!res && level < QUICK_SAVE_RAW_STATE){
+        int dir_fd = open(save_dir_path, O_RDONLY);
+        if(dir_fd >= 0){
+            fsync_timed(dir_fd);
+            close(dir_fd);
+        }
+    }
+    end_stage(QUICK_SAVE_STAGE_FSYNC);
+    return res;
+}
+
+static int write_thumbnail(SDL_Surface *frame){
+    int bpp = frame->format->BytesPerPixel;
+    quick_save_thumbnail_header_t header = {QUICK_SAVE_THUMBNAIL_MAGIC,
+        MIN(frame->w, SCREEN_HORIZONTAL_SIZE)/QUICK_SAVE_THUMBNAIL_SCALE,
+        MIN(frame->h, SCREEN_VERTICAL_SIZE)/QUICK_SAVE_THUMBNAIL_SCALE, bpp};
+    size_t size = (size_t)header.w * header.h * bpp;
+    if(bpp > 4 || size > thumbnail_size){
+        return -1;
+    }
+
+    /// ------ Nearest neighbour downscale ------
+    if(SDL_MUSTLOCK(frame)){
+        SDL_LockSurface(frame);
+    }
+    uint8_t *out = thumbnail_buf;
+    for(int y = 0; y < header.h; y++){
+        const uint8_t *row = (const uint8_t*)frame->pixels + y*QUICK_SAVE_THUMBNAIL_SCALE*frame->pitch;
+        for(int x = 0; x < header.w; x++, out += bpp){
+            memcpy(out, row + x*QUICK_SAVE_THUMBNAIL_SCALE*bpp, bpp);
+        }
+    }
+    if(SDL_MUSTLOCK(frame)){
+        SDL_UnlockSurface(frame);
+    }
+
+    int fd = open(thumbnail_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        QUICK_SAVE_ERROR_PRINTF("ERROR in quick save: Could not open %s: %s\n", thumbnail_path, strerror(errno));
+        return -1;
+    }
+    int res = write_all(fd, &header, sizeof(header));
+    res = res?res:write_all(fd, thumbnail_buf, size);
+    res = res?res:fsync_timed(fd);
+    close(fd);
+    return res;
+}
+
+/* Print this attempt, and append it to the log file if there's time for it */
+static void log_attempt(int res, size_t data_size){
+    char line[512];
+    int len = snprintf(line, sizeof(line), "Quick save %s: level %s, %zu bytes state, %zu bytes written, "
+        "%lldms left of %llums -",
+        res?"FAILED":"done", quick_save_level_name[level], state_size, data_size,
+        (long long)((int64_t)deadline_us - (int64_t)(get_time_us() - start_us))/1000,
+        (unsigned long long)(deadline_us/1000));
+    for(int i = 0; i < NB_QUICK_SAVE_STAGES && len < (int)sizeof(line); i++){
+        if(stage_skipped[i]){
+            len += snprintf(line + len, sizeof(line) - len, " %s skipped", quick_save_stage_name[i]);
+        }
+        else{
+            len += snprintf(line + len, sizeof(line) - len, " %s %lluus", quick_save_stage_name[i],
+                (unsigned long long)stage_us[i]);
+        }
+    }
+    printf("%s\n", line);
+    fflush(stdout);
+
+    if(log_path == NULL || len >= (int)sizeof(line) - 1 ||
+        get_time_left_us() < (int64_t)(estimate_write_us(len) + estimate_fsync_us())){
+        return;
+    }
+    line[len++] = '\n';
+    int fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd >= 0){
+        if(write(fd, line, len) == len){
+            fsync(fd);
+        }
+        close(fd);
+    }
+}
+
+int quick_save_and_poweroff(const char *prog_name, SDL_Surface *frame){
+    if(!quick_save_memory){
+        QUICK_SAVE_ERROR_PRINTF("ERROR in quick_save_and_poweroff: init_quick_save() wasn't called\n");
+        return -1;
+    }
+    TRACE_SCOPE("quick save");
+
+    /// ------ Reset this attempt, the deadline started with the signal ------
+    level = QUICK_SAVE_FULL;
+    start_us = signal_us?signal_us:get_time_us();
+    signal_us = 0;
+    stage_start_us = get_time_us();
+    memset(stage_us, 0, sizeof(stage_us));
+    memset(stage_skipped, 0, sizeof(stage_skipped));
+    written_bytes = written_us = fsync_us = 0;
+
+    /// ------ Tell the system we're handling the powerdown ------
+    if(!dry_run){
+        if(popen(SHELL_CMD_POWERDOWN_HANDLE, "r") == NULL){
+            QUICK_SAVE_ERROR_PRINTF("Failed to run command %s\n", SHELL_CMD_POWERDOWN_HANDLE);
+        }
+    }
+    else{
+        stage_skipped[QUICK_SAVE_STAGE_HANDLE] = 1;
+    }
+    end_stage(QUICK_SAVE_STAGE_HANDLE);
+
+    /// ------ Snapshot ------
+    TRACE_BEGIN("quick save: snapshot");
+    quick_save_state(state_buf, state_size);
+    TRACE_END("quick save: snapshot");
+    end_stage(QUICK_SAVE_STAGE_SNAPSHOT);
+
+    /// ------ Compress, unless it would leave no time to write ------
+    const uint8_t *data = state_buf;
+    size_t data_size = state_size;
+    uint32_t flags = 0;
+    TRACE_BEGIN("quick save: compress");
+    size_t compressed_size = compress_state();
+    TRACE_END("quick save: compress");
+    end_stage(QUICK_SAVE_STAGE_COMPRESS);
+    if(!compressed_size){
+        fall_back(QUICK_SAVE_NO_COMPRESSION);
+    }
+    else if(compressed_size < state_size){
+        data = compressed_buf;
+        data_size = compressed_size;
+        flags |= QUICK_SAVE_FLAG_COMPRESSED;
+    }
+
+    /// ------ Write the state, without the directory fsync if there's no time for it ------
+    if(estimate_write_us(data_size) + 2*estimate_fsync_us() > (uint64_t)MAX(get_time_left_us(), 0)){
+        fall_back(QUICK_SAVE_RAW_STATE);
+    }
+    TRACE_BEGIN("quick save: write");
+    int res = write_state(data, data_size, flags);
+    TRACE_END("quick save: write");
+
+    /// ------ Thumbnail, if there's time left ------
+    size_t thumb_size = frame?(size_t)frame->w*frame->h*frame->format->BytesPerPixel/
+        (QUICK_SAVE_THUMBNAIL_SCALE*QUICK_SAVE_THUMBNAIL_SCALE):0;
+    if(level < QUICK_SAVE_NO_THUMBNAIL &&
+        estimate_write_us(thumb_size) + estimate_fsync_us() > (uint64_t)MAX(get_time_left_us(), 0)){
+        fall_back(QUICK_SAVE_NO_THUMBNAIL);
+    }
+    if(level < QUICK_SAVE_NO_THUMBNAIL && frame && thumbnail_buf){
+        TRACE_BEGIN("quick save: thumbnail");
+        write_thumbnail(frame);
+        TRACE_END("quick save: thumbnail");
+    }
+    else{
+        stage_skipped[QUICK_SAVE_STAGE_THUMBNAIL] = 1;
+    }
+    end_stage(QUICK_SAVE_STAGE_THUMBNAIL);
+
+    /// ------ Instant Play record, written here instead of spawning the script ------
+    int instant_play_written = 0;
+    if(!dry_run){
+        const char *instant_play_args[] = {prog_name, "-loadStateFile", save_path};
+        instant_play_written = !instant_play_write(INSTANT_PLAY_PATH, 3, instant_play_args);
+    }
+    else{
+        stage_skipped[QUICK_SAVE_STAGE_INSTANT_PLAY] = 1;
+    }
+    end_stage(QUICK_SAVE_STAGE_INSTANT_PLAY);
+
+    log_attempt(res, data_size);
+    if(dry_run){
+        return level;
+    }
+
+    /// ------ Shutdown, through the script if the record couldn't be written ------
+    if(instant_play_written){
+        execlp(SHELL_CMD_POWERDOWN, SHELL_CMD_POWERDOWN, NULL);
+        QUICK_SAVE_ERROR_PRINTF("Failed to run command %s: %s\n", SHELL_CMD_POWERDOWN, strerror(errno));
+    }
+    else{
+        execlp(SHELL_CMD_INSTANT_PLAY, SHELL_CMD_INSTANT_PLAY, "save", prog_name, "-loadStateFile", save_path, NULL);
+        QUICK_SAVE_ERROR_PRINTF("Failed to run command %s: %s\n", SHELL_CMD_INSTANT_PLAY, strerror(errno));
+    }
+
+    /// ------ Should not be reached ------
+    if(system(SHELL_CMD_POWERDOWN) < 0){
+        QUICK_SAVE_ERROR_PRINTF("Failed to run command %s\n", SHELL_CMD_POWERDOWN);
+    }
+    return level;
+}
+
+int quick_save_decode_state(const void *file, size_t file_size, void *buf, size_t size){
+    quick_save_header_t header;
+    if(file_size < sizeof(header)){
+        return -1;
+    }
+    memcpy(&header, file, sizeof(header));
+    const uint8_t *data = (const uint8_t*)file + sizeof(header);
+    if(header.magic != QUICK_SAVE_MAGIC || header.version != QUICK_SAVE_VERSION || header.state_size != size ||
+        header.data_size > file_size - sizeof(header)){
+        QUICK_SAVE_ERROR_PRINTF("ERROR in quick_save_decode_state: Not a %zu bytes state\n", size);
+        return -1;
+    }
+    if(!(header.flags & QUICK_SAVE_FLAG_COMPRESSED)){
+        if(header.data_size != size){
+            return -1;
+        }
+        memcpy(buf, data, size);
+        return 0;
+    }
+
+    /// ------ Chunks are XORed against zeros ------
+    const uint8_t *in = data;
+    memset(buf, 0, size);
+    for(size_t pos = 0; pos < size && in < data + header.data_size; pos += QUICK_SAVE_CHUNK_SIZE){
+        size_t chunk_size = size - pos;
+        in += rle_decode_xor((uint8_t*)buf + pos, in, (chunk_size > QUICK_SAVE_CHUNK_SIZE)?QUICK_SAVE_CHUNK_SIZE:chunk_size);
+    }
+    return (in == data + header.data_size)?0:-1;
+}
+
+int quick_save_load_state(const char *path, void *buf, size_t size){
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL){
+        return -1;
+    }
+
+    /// ------ Integrity header, then the whole state file checksummed as it's read ------
+    int res = -1;
+    uint8_t *file = NULL;
+    crc32c_header_t crc_header;
+    uint32_t crc = 0;
+    size_t file_size = 0;
+    size_t max_size = sizeof(quick_save_header_t) +
+        (size + QUICK_SAVE_CHUNK_SIZE-1)/QUICK_SAVE_CHUNK_SIZE * rle_max_encoded_size(QUICK_SAVE_CHUNK_SIZE);
+    if(fread(&crc_header, sizeof(crc_header), 1, fp) == 1 && crc_header.magic == CRC32C_HEADER_MAGIC &&
+        crc_header.size <= max_size &&
+        (file = (uint8_t*) malloc(crc_header.size + 1)) != NULL){
+        size_t nb_bytes;
+        while(file_size <= crc_header.size &&
+            (nb_bytes = fread(file + file_size, 1, MIN(crc_header.size + 1 - file_size, QUICK_SAVE_READ_SIZE), fp)) > 0){
+            crc = crc32c(crc, file + file_size, nb_bytes);
+            file_size += nb_bytes;
+        }
+        if(!crc32c_header_check(&crc_header, crc, file_size)){
+            res = quick_save_decode_state(file, file_size, buf, size);
+        }
+    }
+    else{
+        QUICK_SAVE_ERROR_PRINTF("ERROR in quick_save_load_state: Could not read %s\n", path);
+    }
+    free(file);
+    fclose(fp);
+    return res;
+}
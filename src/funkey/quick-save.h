@@ -0,0 +1,90 @@
+/*
+ * quick-save.h
+ * Quick save when the console is closed, within the time left before power is cut
+ *
+ * After SIGUSR1 the hardware only gives a fixed window before cutting power.
+ * quick_save_and_poweroff() runs the save stages (snapshot, compress, write,
+ * fsync, thumbnail, Instant Play record, powerdown), timing each one against the
+ * deadline, and drops to cheaper strategies when the next stage wouldn't fit:
+ *   - QUICK_SAVE_NO_COMPRESSION: the state is written raw
+ *   - QUICK_SAVE_NO_THUMBNAIL:   no thumbnail either
+ *   - QUICK_SAVE_RAW_STATE:      no directory fsync after the rename either
+ *
+ * States are always written to a temporary file renamed over the previous
+ * save, so the last good save survives a write cut short.
+ * Every attempt is printed, with the timing of each stage, and appended to a
+ * log file if there's time left.
+ *
+ * State files start with a crc32c_header_t covering the rest of the file, then
+ * a quick_save_header_t, see quick_save_load_state().
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_QUICK_SAVE_H
+#define FUNKEY_QUICK_SAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL/SDL.h>
+
+#define QUICK_SAVE_MAGIC            0x53514B46                  /* "FKQS" */
+#define QUICK_SAVE_VERSION          1
+#define QUICK_SAVE_FLAG_COMPRESSED  (1 << 0)                    /* Data is rle_encode_xor() of each chunk against zeros */
+#define QUICK_SAVE_CHUNK_SIZE       4096                        /* Compressed independently */
+#define QUICK_SAVE_RESERVE_MS       300                         /* Kept for the Instant Play record and powerdown */
+#define QUICK_SAVE_LOG_PATH         "/mnt/quick_save.log"
+
+#define QUICK_SAVE_LEVELS \
+    X(QUICK_SAVE_FULL, "full") \
+    X(QUICK_SAVE_NO_COMPRESSION, "no compression") \
+    X(QUICK_SAVE_NO_THUMBNAIL, "no thumbnail") \
+    X(QUICK_SAVE_RAW_STATE, "raw state only") \
+    X(NB_QUICK_SAVE_LEVELS, "")
+
+#undef X
+#define X(a, b) a,
+typedef enum {QUICK_SAVE_LEVELS} ENUM_QUICK_SAVE_LEVEL;
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t state_size;                                        /* Once loaded */
+    uint32_t data_size;                                         /* In the file, after this header */
+} quick_save_header_t;
+
+// Copy the current state into buf (state_size bytes)
+typedef void (*quick_save_state_t)(void *buf, size_t size);
+
+////------ Functions -------
+
+// Buffers are allocated here, nothing is allocated when saving. thumbnail_path can be NULL.
+int init_quick_save(const char *save_path, const char *thumbnail_path, size_t state_size,
+    quick_save_state_t save_state, int deadline_ms);
+void deinit_quick_save();
+
+// Call from the SIGUSR1 handler, the deadline counts from there (async-signal-safe)
+void quick_save_signal();
+
+// Simulate slow storage: sleep before each write() (0 to disable)
+void quick_save_set_write_delay(int delay_ms);
+
+// Log the attempt and return instead of writing the Instant Play record and powering down
+void quick_save_set_dry_run(int enable);
+
+// Append attempts to this file instead of QUICK_SAVE_LOG_PATH (NULL to only print them), kept as is
+void quick_save_set_log_path(const char *path);
+
+// Save (frame is used for the thumbnail, can be NULL), write the Instant Play record and power down
+// (falls back to the instant_play script if the record couldn't be written).
+// Only returns on dry runs or if powering down failed, with the level reached.
+int quick_save_and_poweroff(const char *prog_name, SDL_Surface *frame);
+
+// Read a state file written by quick_save_and_poweroff() into buf, checking its CRC32C. Returns 0 on success.
+int quick_save_load_state(const char *path, void *buf, size_t size);
+
+// Same, from the file's content already in memory and checked, after the crc32c_header_t
+int quick_save_decode_state(const void *file, size_t file_size, void *buf, size_t size);
+
+#endif //FUNKEY_QUICK_SAVE_H
@@ -0,0 +1,459 @@
+/*
+ * render.c
+ * Retained 2D renderer for Funkey apps
+ *
+ * Commands of the current and previous frames are compared one by one: for
+ * each one that differs, both its old and new rects are marked dirty as a
+ * [x0, x1) span per canvas row. Rows with identical spans are then merged
+ * into rects, and every command overlapping a rect is replayed clipped to it.
+ *
+ * Destination buffers are recognized by their pixels pointer (SDL_DOUBLEBUF
+ * pages, present thread buffers, shadow buffer), with the frame they were
+ * last updated at. A destination that is a few frames old gets the union of
+ * the dirty bounds of the frames it missed, an unknown one a full copy.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SDL/SDL.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "render.h"
+#include "blit-kernels.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define RENDER_DEBUG
+#define RENDER_ERROR
+
+#ifdef RENDER_DEBUG
+#define RENDER_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RENDER_DEBUG_PRINTF(...)
+#endif //RENDER_DEBUG
+
+#ifdef RENDER_ERROR
+#define RENDER_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RENDER_ERROR_PRINTF(...)
+#endif //RENDER_ERROR
+
+//#define RENDER_PERF
+
+#ifdef RENDER_PERF
+#define RENDER_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RENDER_PERF_PRINTF(...)
+#endif //RENDER_PERF
+
+typedef struct{
+    void *pixels;                                               /* Identifies the destination buffer */
+    uint32_t frame;                                             /* Frame it was last updated at */
+} render_target_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static SDL_Surface *render_canvas = NULL;
+static render_cmd_t render_cmds[2][RENDER_MAX_CMDS];
+static int nb_render_cmds[2] = {0, 0};
+static int cur_cmds = 0;                                        /* Index of the frame being submitted in render_cmds */
+
+static int16_t *dirty_x0 = NULL;                                /* Per canvas row, x1 <= x0 when clean */
+static int16_t *dirty_x1 = NULL;
+static SDL_Rect dirty_history[RENDER_DIRTY_HISTORY];            /* Dirty bounds of the last frames, by frame number */
+static int render_full_redraw = 1;
+static int render_changed = 0;                                  /* Last frame differs from the one before */
+static SDL_Rect render_damage = {0, 0, 0, 0};                   /* Drawn over by someone else since the last frame */
+
+static render_target_t render_targets[RENDER_MAX_TARGETS];
+static uint32_t render_frame = 0;
+
+static uint32_t nb_frames_rendered = 0;
+static uint64_t nb_pixels_drawn = 0;
+static uint64_t nb_pixels_copied = 0;
+
+
+/// --------------------------------------------
+/// -------------  RENDER functions  -----------
+/// --------------------------------------------
+
+/**
+ * Create the canvas, in the same format as screen. Returns 0 on success.
+ */
+int init_renderer(SDL_Surface* screen){
+    if(render_canvas){
+        return 0;
+    }
+
+    render_canvas = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h,
+        screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask,
+        screen->format->Bmask, screen->format->Amask);
+    dirty_x0 = (int16_t*) malloc(screen->h * sizeof(int16_t));
+    dirty_x1 = (int16_t*) malloc(screen->h * sizeof(int16_t));
+    if(render_canvas == NULL || dirty_x0 == NULL || dirty_x1 == NULL){
+        RENDER_ERROR_PRINTF("ERROR in init_renderer: Could not create canvas: %s\n", SDL_GetError());
+        deinit_renderer();
+        return -1;
+    }
+
+    nb_render_cmds[0] = nb_render_cmds[1] = 0;
+    nb_frames_rendered = 0;
+    nb_pixels_drawn = nb_pixels_copied = 0;
+    render_invalidate();
+    return 0;
+}
+
+void deinit_renderer(){
+    if(render_canvas && nb_frames_rendered){
+        RENDER_PERF_PRINTF("Renderer: %u frames, %llu pixels drawn and %llu copied per frame on average\n",
+            nb_frames_rendered, (unsigned long long)(nb_pixels_drawn/nb_frames_rendered),
+            (unsigned long long)(nb_pixels_copied/nb_frames_rendered));
+    }
+    if(render_canvas){
+        SDL_FreeSurface(render_canvas);
+        render_canvas = NULL;
+    }
+    free(dirty_x0);
+    free(dirty_x1);
+    dirty_x0 = dirty_x1 = NULL;
+}
+
+void render_invalidate(){
+    render_full_redraw = 1;
+    render_damage = (SDL_Rect){0, 0, 0, 0};
+    memset(render_targets, 0, sizeof(render_targets));
+}
+
+int render_last_frame_changed(){
+    return render_changed;
+}
+
+void render_begin_frame(){
+    cur_cmds ^= 1;
+    nb_render_cmds[cur_cmds] = 0;
+}
+
+static render_cmd_t *add_render_cmd(ENUM_RENDER_CMD type, SDL_Rect *rect){
+    if(!render_canvas || nb_render_cmds[cur_cmds] >= RENDER_MAX_CMDS){
+        return NULL;
+    }
+
+    /// ------ Clip to the canvas, skip if nothing left ------
+    int x0 = rect?rect->x:0;
+    int y0 = rect?rect->y:0;
+    int x1 = rect?(rect->x + rect->w):render_canvas->w;
+    int y1 = rect?(rect->y + rect->h):render_canvas->h;
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 > render_canvas->w) x1 = render_canvas->w;
+    if(y1 > render_canvas->h) y1 = render_canvas->h;
+    if(x1 <= x0 || y1 <= y0){
+        return NULL;
+    }
+
+    /* Zeroed so that commands can be compared with memcmp */
+    render_cmd_t *cmd = &render_cmds[cur_cmds][nb_render_cmds[cur_cmds]++];
+    memset(cmd, 0, sizeof(render_cmd_t));
+    cmd->type = type;
+    cmd->rect.x = x0;
+    cmd->rect.y = y0;
+    cmd->rect.w = x1 - x0;
+    cmd->rect.h = y1 - y0;
+    return cmd;
+}
+
+/**
+ * Fill rect (NULL for the whole canvas) with color, already mapped to the screen format
+ */
+void render_fill(SDL_Rect *rect, Uint32 color){
+    render_cmd_t *cmd = add_render_cmd(RENDER_CMD_FILL, rect);
+    if(cmd){
+        cmd->color = color;
+    }
+}
+
+/**
+ * Blit src_rect of src (NULL for all of it) at x, y, with SDL's blending rules
+ */
+void render_blit(SDL_Surface *src, SDL_Rect *src_rect, Sint16 x, Sint16 y){
+    SDL_Rect full_rect = {0, 0, src->w, src->h};
+    if(src_rect == NULL){
+        src_rect = &full_rect;
+    }
+
+    SDL_Rect rect = {x, y, src_rect->w, src_rect->h};
+    render_cmd_t *cmd = add_render_cmd(RENDER_CMD_BLIT, &rect);
+    if(cmd){
+        cmd->src = src;
+        cmd->src_rect = *src_rect;
+        /* Skip the part of the source clipped out of the canvas */
+        cmd->src_rect.x += cmd->rect.x - x;
+        cmd->src_rect.y += cmd->rect.y - y;
+    }
+}
+
+/// ------ Span fill, the only drawing done for static colors ------
+static void fill_span32(uint32_t *dst, int w, uint32_t color){
+#if defined(__SSE2__)
+    __m128i c = _mm_set1_epi32((int)color);
+    while(w && ((uintptr_t)dst & 15)){
+        *dst++ = color;
+        w--;
+    }
+    for(; w >= 8; w -= 8, dst += 8){
+        _mm_store_si128((__m128i*)dst, c);
+        _mm_store_si128((__m128i*)(dst+4), c);
+    }
+#elif defined(__ARM_NEON)
+    uint32x4_t c = vdupq_n_u32(color);
+    for(; w >= 8; w -= 8, dst += 8){
+        vst1q_u32(dst, c);
+        vst1q_u32(dst+4, c);
+    }
+#endif
+    while(w--){
+        *dst++ = color;
+    }
+}
+
+static void fill_span16(uint16_t *dst, int w, uint16_t color){
+    if(w && ((uintptr_t)dst & 2)){
+        *dst++ = color;
+        w--;
+    }
+    fill_span32((uint32_t*)dst, w/2, ((uint32_t)color << 16) | color);
+    if(w & 1){
+        dst[w-1] = color;
+    }
+}
+
+static void fill_rect(SDL_Rect *rect, Uint32 color){
+    int bpp = render_canvas->format->BytesPerPixel;
+    uint8_t *row = (uint8_t*)render_canvas->pixels + rect->y*render_canvas->pitch + rect->x*bpp;
+
+    for(int y = 0; y < rect->h; y++, row += render_canvas->pitch){
+        if(bpp == 4){
+            fill_span32((uint32_t*)row, rect->w, color);
+        }
+        else if(bpp == 2){
+            fill_span16((uint16_t*)row, rect->w, (uint16_t)color);
+        }
+        else{
+            SDL_Rect row_rect = {rect->x, rect->y + y, rect->w, 1};
+            SDL_FillRect(render_canvas, &row_rect, color);
+        }
+    }
+}
+
+static int intersect_rects(SDL_Rect *a, SDL_Rect *b, SDL_Rect *res){
+    int x0 = (a->x > b->x)?a->x:b->x;
+    int y0 = (a->y > b->y)?a->y:b->y;
+    int x1 = (a->x + a->w < b->x + b->w)?(a->x + a->w):(b->x + b->w);
+    int y1 = (a->y + a->h < b->y + b->h)?(a->y + a->h):(b->y + b->h);
+    if(x1 <= x0 || y1 <= y0){
+        return 0;
+    }
+    res->x = x0;
+    res->y = y0;
+    res->w = x1 - x0;
+    res->h = y1 - y0;
+    return 1;
+}
+
+static void union_rects(SDL_Rect *acc, SDL_Rect *r){
+    if(!r->w || !r->h){
+        return;
+    }
+    if(!acc->w || !acc->h){
+        *acc = *r;
+        return;
+    }
+    int x0 = (acc->x < r->x)?acc->x:r->x;
+    int y0 = (acc->y < r->y)?acc->y:r->y;
+    int x1 = (acc->x + acc->w > r->x + r->w)?(acc->x + acc->w):(r->x + r->w);
+    int y1 = (acc->y + acc->h > r->y + r->h)?(acc->y + acc->h):(r->y + r->h);
+    acc->x = x0;
+    acc->y = y0;
+    acc->w = x1 - x0;
+    acc->h = y1 - y0;
+}
+
+static void mark_dirty(SDL_Rect *rect, SDL_Rect *bounds){
+    for(int y = rect->y; y < rect->y + rect->h; y++){
+        if(dirty_x1[y] <= dirty_x0[y]){
+            dirty_x0[y] = rect->x;
+            dirty_x1[y] = rect->x + rect->w;
+        }
+        else{
+            if(rect->x < dirty_x0[y]) dirty_x0[y] = rect->x;
+            if(rect->x + rect->w > dirty_x1[y]) dirty_x1[y] = rect->x + rect->w;
+        }
+    }
+    union_rects(bounds, rect);
+}
+
+void render_invalidate_rect(SDL_Rect *rect){
+    union_rects(&render_damage, rect);
+}
+
+/* Replay the current commands clipped to rect */
+static void redraw_rect(SDL_Rect *rect){
+    render_cmd_t *cmds = render_cmds[cur_cmds];
+
+    for(int i = 0; i < nb_render_cmds[cur_cmds]; i++){
+        SDL_Rect clip;
+        if(!intersect_rects(&cmds[i].rect, rect, &clip)){
+            continue;
+        }
+
+        if(cmds[i].type == RENDER_CMD_FILL){
+            fill_rect(&clip, cmds[i].color);
+        }
+        else{
+            SDL_Rect src_rect = cmds[i].src_rect;
+            SDL_Rect dst_rect = {cmds[i].rect.x, cmds[i].rect.y, 0, 0};
+            SDL_SetClipRect(render_canvas, &clip);
+            blit_surface_fast(cmds[i].src, &src_rect, render_canvas, &dst_rect);
+        }
+    }
+    SDL_SetClipRect(render_canvas, NULL);
+    nb_pixels_drawn += rect->w * rect->h;
+}
+
+static int copy_rect(SDL_Surface *dst, SDL_Rect *rect){
+    if(!rect->w || !rect->h){
+        return 0;
+    }
+    if(dst->format->BitsPerPixel != render_canvas->format->BitsPerPixel){
+        SDL_Rect dst_rect = *rect;
+        SDL_BlitSurface(render_canvas, rect, dst, &dst_rect);
+        return rect->w * rect->h;
+    }
+
+    if(SDL_MUSTLOCK(dst)){
+        SDL_LockSurface(dst);
+    }
+    int bpp = render_canvas->format->BytesPerPixel;
+    uint8_t *src_row = (uint8_t*)render_canvas->pixels + rect->y*render_canvas->pitch + rect->x*bpp;
+    uint8_t *dst_row = (uint8_t*)dst->pixels + rect->y*dst->pitch + rect->x*bpp;
+    for(int y = 0; y < rect->h; y++){
+        memcpy(dst_row, src_row, rect->w*bpp);
+        src_row += render_canvas->pitch;
+        dst_row += dst->pitch;
+    }
+    if(SDL_MUSTLOCK(dst)){
+        SDL_UnlockSurface(dst);
+    }
+    return rect->w * rect->h;
+}
+
+int render_end_frame(SDL_Surface* dst){
+    if(!render_canvas){
+        return 0;
+    }
+    TRACE_SCOPE("render: end frame");
+
+    render_cmd_t *cmds = render_cmds[cur_cmds];
+    render_cmd_t *prev_cmds = render_cmds[cur_cmds^1];
+    int nb_cmds = nb_render_cmds[cur_cmds];
+    int nb_prev_cmds = nb_render_cmds[cur_cmds^1];
+    SDL_Rect canvas_rect = {0, 0, render_canvas->w, render_canvas->h};
+    SDL_Rect dirty_bounds = {0, 0, 0, 0};
+
+    render_frame++;
+    nb_frames_rendered++;
+
+    /// ------ Diff against the previous frame ------
+    TRACE_BEGIN("render: diff");
+    for(int y = 0; y < render_canvas->h; y++){
+        dirty_x0[y] = dirty_x1[y] = 0;
+    }
+    if(render_full_redraw){
+        mark_dirty(&canvas_rect, &dirty_bounds);
+        render_full_redraw = 0;
+    }
+    else{
+        for(int i = 0; i < nb_cmds || i < nb_prev_cmds; i++){
+            if(i < nb_cmds && i < nb_prev_cmds && !memcmp(&cmds[i], &prev_cmds[i], sizeof(render_cmd_t))){
+                continue;
+            }
+            if(i < nb_cmds){
+                mark_dirty(&cmds[i].rect, &dirty_bounds);
+            }
+            if(i < nb_prev_cmds){
+                mark_dirty(&prev_cmds[i].rect, &dirty_bounds);
+            }
+        }
+        SDL_Rect damage;
+        if(intersect_rects(&render_damage, &canvas_rect, &damage)){
+            mark_dirty(&damage, &dirty_bounds);
+        }
+    }
+    render_damage = (SDL_Rect){0, 0, 0, 0};
+    dirty_history[render_frame % RENDER_DIRTY_HISTORY] = dirty_bounds;
+    render_changed = dirty_bounds.w && dirty_bounds.h;
+    TRACE_END("render: diff");
+
+    /// ------ Redraw dirty spans, merging rows with the same span ------
+    TRACE_BEGIN("render: draw");
+    for(int y = dirty_bounds.y; y < dirty_bounds.y + dirty_bounds.h; ){
+        if(dirty_x1[y] <= dirty_x0[y]){
+            y++;
+            continue;
+        }
+        SDL_Rect rect = {dirty_x0[y], y, dirty_x1[y] - dirty_x0[y], 1};
+        for(y++; y < dirty_bounds.y + dirty_bounds.h && dirty_x0[y] == rect.x && dirty_x1[y] == rect.x + rect.w; y++){
+            rect.h++;
+        }
+        redraw_rect(&rect);
+    }
+    TRACE_END("render: draw");
+
+    /// ------ Bring dst up to date ------
+    TRACE_BEGIN("render: copy");
+    render_target_t *target = NULL;
+    for(int i = 0; i < RENDER_MAX_TARGETS; i++){
+        if(render_targets[i].pixels == dst->pixels){
+            target = &render_targets[i];
+            break;
+        }
+    }
+
+    SDL_Rect copy_bounds = {0, 0, 0, 0};
+    if(target && render_frame - target->frame <= RENDER_DIRTY_HISTORY){
+        for(uint32_t frame = target->frame + 1; frame != render_frame + 1; frame++){
+            union_rects(&copy_bounds, &dirty_history[frame % RENDER_DIRTY_HISTORY]);
+        }
+    }
+    else{
+        /// ------ Unknown (or too old) buffer: replace the least recently updated one ------
+        if(!target){
+            target = &render_targets[0];
+            for(int i = 1; i < RENDER_MAX_TARGETS; i++){
+                if(render_targets[i].frame < target->frame){
+                    target = &render_targets[i];
+                }
+            }
+        }
+        copy_bounds = canvas_rect;
+        RENDER_DEBUG_PRINTF("Renderer: full copy to %p\n", dst->pixels);
+    }
+    target->pixels = dst->pixels;
+    target->frame = render_frame;
+
+    int nb_copied = copy_rect(dst, &copy_bounds);
+    nb_pixels_copied += nb_copied;
+    TRACE_END("render: copy");
+
+    return nb_copied;
+}
@@ -0,0 +1,65 @@
+/*
+ * render.h
+ * Retained 2D renderer for Funkey apps
+ *
+ * Each frame the app submits its fill/blit commands between
+ * render_begin_frame() and render_end_frame(). The renderer keeps its own
+ * canvas, diffs the commands against the previous frame and only redraws
+ * the spans that changed, then copies to the destination surface only what
+ * it doesn't already hold. A static scene costs a few comparisons per frame.
+ *
+ * Commands are painted in order and nothing is cleared implicitly: the
+ * first command should cover the whole canvas (e.g. render_fill(NULL, color)).
+ * Blits are compared by source surface and rects, not by pixels: call
+ * render_invalidate() when a source surface's content changes, or when
+ * anything else draws into the destination surfaces (the menu for instance),
+ * or render_invalidate_rect() when it only drew over a part of them (toasts).
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_RENDER_H
+#define FUNKEY_RENDER_H
+
+#include <SDL/SDL.h>
+
+#define RENDER_MAX_CMDS             256                         /* Per frame, extra commands are ignored */
+#define RENDER_MAX_TARGETS          4                           /* Destination buffers tracked (double/triple buffering) */
+#define RENDER_DIRTY_HISTORY        4                           /* Frames of dirty areas kept to update older targets */
+
+typedef enum{
+    RENDER_CMD_FILL,
+    RENDER_CMD_BLIT,
+} ENUM_RENDER_CMD;
+
+typedef struct{
+    ENUM_RENDER_CMD type;
+    SDL_Rect rect;                                              /* Destination, clipped to the canvas */
+    Uint32 color;                                               /* Fill: color in the canvas format */
+    SDL_Surface *src;                                           /* Blit: source surface */
+    SDL_Rect src_rect;                                          /* Blit: part of the source, before clipping */
+} render_cmd_t;
+
+////------ Functions -------
+
+int init_renderer(SDL_Surface* screen);
+void deinit_renderer();
+
+void render_begin_frame();
+void render_fill(SDL_Rect *rect, Uint32 color);
+void render_blit(SDL_Surface *src, SDL_Rect *src_rect, Sint16 x, Sint16 y);
+
+// Redraw what changed and update dst (same format as the screen given at init)
+// Returns the number of pixels copied to dst, 0 if it was already up to date
+int render_end_frame(SDL_Surface* dst);
+
+// Whether the last render_end_frame() redrew anything, 0 for a frame identical to the previous one
+int render_last_frame_changed();
+
+// Redraw everything next frame, and forget what the destination surfaces hold
+void render_invalidate();
+
+// Redraw rect next frame in every destination surface, after something else drew over it
+void render_invalidate_rect(SDL_Rect *rect);
+
+#endif //FUNKEY_RENDER_H
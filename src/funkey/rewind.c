@@ -0,0 +1,298 @@
+/*
+ * rewind.c
+ * In-memory history of recent app/emulator states, for Quick Reload
+ *
+ * Snapshot n is stored as delta_n = S(n) XOR S(n-1), so S(n-k) is S(n)
+ * XORed with the k newest deltas. The very first delta is against zeros.
+ *
+ * Deltas are written one after the other in the arena, wrapping to its start
+ * when the worst case size of the next one doesn't fit before its end. Room
+ * for that worst case is made before encoding starts, by dropping the oldest
+ * deltas, so encoding can write straight into the arena.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rewind.h"
+#include "rle.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define REWIND_DEBUG
+#define REWIND_ERROR
+
+#ifdef REWIND_DEBUG
+#define REWIND_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define REWIND_DEBUG_PRINTF(...)
+#endif //REWIND_DEBUG
+
+#ifdef REWIND_ERROR
+#define REWIND_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define REWIND_ERROR_PRINTF(...)
+#endif //REWIND_ERROR
+
+//#define REWIND_PERF
+
+#ifdef REWIND_PERF
+#define REWIND_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define REWIND_PERF_PRINTF(...)
+#endif //REWIND_PERF
+
+typedef struct{
+    size_t offset;                                              /* In rewind_arena */
+    size_t size;
+} rewind_entry_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static uint8_t *rewind_memory = NULL;                           /* Single allocation: both states, then the arena */
+static uint8_t *newest_state = NULL;                            /* Last snapshot fully encoded */
+static uint8_t *next_state = NULL;                              /* Snapshot being encoded, or restore buffer */
+static uint8_t *rewind_arena = NULL;
+static size_t rewind_state_size = 0;
+static size_t rewind_arena_size = 0;
+static size_t entry_max_size = 0;                               /* Worst case encoded size of a snapshot */
+
+static rewind_save_state_t rewind_save_state = NULL;
+static rewind_load_state_t rewind_load_state = NULL;
+static int rewind_capture_interval = 1;
+static int rewind_fps = 1;
+
+static rewind_entry_t rewind_entries[REWIND_MAX_SNAPSHOTS];     /* Ring, oldest at first_entry */
+static int first_entry = 0;
+static int nb_entries = 0;
+static size_t write_offset = 0;                                 /* Where the next delta starts in the arena */
+
+static int frames_since_capture = 0;
+static int encoding = 0;
+static size_t encode_pos = 0;                                   /* In the state */
+static size_t encode_start = 0;                                 /* In the arena */
+static size_t encode_end = 0;
+static int chunks_per_frame = 1;
+
+static uint32_t nb_captures = 0;
+static uint32_t nb_frames = 0;
+static uint64_t frame_time_us = 0;
+static uint64_t max_frame_time_us = 0;
+static uint64_t save_state_time_us = 0;
+static uint64_t nb_bytes_stored = 0;
+
+
+/// --------------------------------------------
+/// -------------  REWIND functions  -----------
+/// --------------------------------------------
+
+/**
+ * Start capturing state_size bytes of state every capture_interval frames, in
+ * an arena of arena_size bytes. Returns 0 on success.
+ */
+int init_rewind(size_t state_size, size_t arena_size, int capture_interval, int fps,
+    rewind_save_state_t save_state, rewind_load_state_t load_state){
+    if(rewind_memory){
+        return 0;
+    }
+
+    size_t nb_chunks = (state_size + REWIND_CHUNK_SIZE-1)/REWIND_CHUNK_SIZE;
+    entry_max_size = nb_chunks * rle_max_encoded_size(REWIND_CHUNK_SIZE);
+    if(!state_size || arena_size < entry_max_size){
+        REWIND_ERROR_PRINTF("ERROR in init_rewind: Arena of %zu bytes too small for states of %zu bytes (needs %zu)\n",
+            arena_size, state_size, entry_max_size);
+        return -1;
+    }
+
+    rewind_memory = (uint8_t*) calloc(1, 2*state_size + arena_size);
+    if(rewind_memory == NULL){
+        REWIND_ERROR_PRINTF("ERROR in init_rewind: Could not allocate %zu bytes\n", 2*state_size + arena_size);
+        return -1;
+    }
+    newest_state = rewind_memory;
+    next_state = rewind_memory + state_size;
+    rewind_arena = rewind_memory + 2*state_size;
+
+    rewind_state_size = state_size;
+    rewind_arena_size = arena_size;
+    rewind_save_state = save_state;
+    rewind_load_state = load_state;
+    rewind_capture_interval = (capture_interval > 0)?capture_interval:1;
+    rewind_fps = (fps > 0)?fps:1;
+
+    /* Spread encoding over the frames until the next capture */
+    int nb_encode_frames = (rewind_capture_interval > 1)?(rewind_capture_interval-1):1;
+    chunks_per_frame = (nb_chunks + nb_encode_frames-1)/nb_encode_frames;
+
+    first_entry = nb_entries = 0;
+    write_offset = 0;
+    frames_since_capture = 0;
+    encoding = 0;
+    nb_captures = nb_frames = 0;
+    frame_time_us = max_frame_time_us = save_state_time_us = nb_bytes_stored = 0;
+    return 0;
+}
+
+void deinit_rewind(){
+    if(rewind_memory){
+        rewind_print_stats();
+        free(rewind_memory);
+        rewind_memory = NULL;
+    }
+}
+
+int rewind_running(){
+    return rewind_memory != NULL;
+}
+
+static rewind_entry_t *get_entry(int idx_from_oldest){
+    return &rewind_entries[(first_entry + idx_from_oldest) % REWIND_MAX_SNAPSHOTS];
+}
+
+static void drop_oldest_entry(){
+    first_entry = (first_entry + 1) % REWIND_MAX_SNAPSHOTS;
+    nb_entries--;
+}
+
+/* Make room for the worst case of the next delta at write_offset */
+static void reserve_entry(){
+    if(write_offset + entry_max_size > rewind_arena_size){
+        /// ------ Wrap: deltas left at the end of the arena are the oldest ones ------
+        while(nb_entries && get_entry(0)->offset >= write_offset){
+            drop_oldest_entry();
+        }
+        write_offset = 0;
+    }
+    while(nb_entries && get_entry(0)->offset < write_offset + entry_max_size &&
+        get_entry(0)->offset + get_entry(0)->size > write_offset){
+        drop_oldest_entry();
+    }
+    if(nb_entries == REWIND_MAX_SNAPSHOTS){
+        drop_oldest_entry();
+    }
+}
+
+static void encode_chunks(int nb_chunks){
+    TRACE_SCOPE("rewind: encode");
+    while(nb_chunks-- && encode_pos < rewind_state_size){
+        size_t size = rewind_state_size - encode_pos;
+        if(size > REWIND_CHUNK_SIZE){
+            size = REWIND_CHUNK_SIZE;
+        }
+        encode_end += rle_encode_xor(rewind_arena + encode_end,
+            next_state + encode_pos, newest_state + encode_pos, size);
+        encode_pos += size;
+    }
+
+    /// ------ Done, this snapshot becomes the newest one ------
+    if(encode_pos >= rewind_state_size){
+        rewind_entry_t *entry = get_entry(nb_entries++);
+        entry->offset = encode_start;
+        entry->size = encode_end - encode_start;
+        write_offset = encode_end;
+        nb_bytes_stored += entry->size;
+        nb_captures++;
+
+        uint8_t *tmp = newest_state;
+        newest_state = next_state;
+        next_state = tmp;
+        encoding = 0;
+        REWIND_DEBUG_PRINTF("Rewind: snapshot of %zu bytes, %d in history\n", entry->size, nb_entries);
+    }
+}
+
+void rewind_frame(){
+    if(!rewind_memory){
+        return;
+    }
+    uint64_t start_us = get_time_us();
+    frames_since_capture++;
+
+    if(encoding){
+        encode_chunks(chunks_per_frame);
+    }
+    else if(frames_since_capture >= rewind_capture_interval){
+        TRACE_BEGIN("rewind: save state");
+        rewind_save_state(next_state, rewind_state_size);
+        TRACE_END("rewind: save state");
+        save_state_time_us += get_time_us() - start_us;
+
+        reserve_entry();
+        encoding = 1;
+        encode_pos = 0;
+        encode_start = encode_end = write_offset;
+        frames_since_capture = 0;
+    }
+
+    uint64_t elapsed_us = get_time_us() - start_us;
+    frame_time_us += elapsed_us;
+    if(elapsed_us > max_frame_time_us){
+        max_frame_time_us = elapsed_us;
+    }
+    nb_frames++;
+}
+
+int rewind_seconds_available(){
+    return nb_entries * rewind_capture_interval / rewind_fps;
+}
+
+int rewind_load_seconds(int nb_seconds){
+    if(!rewind_memory || !nb_entries){
+        return -1;
+    }
+    TRACE_SCOPE("rewind: load");
+
+    /// ------ Drop the snapshot being encoded, newest_state is the latest complete one ------
+    encoding = 0;
+    frames_since_capture = 0;
+
+    /* 0 deltas back is the newest snapshot, up to a capture interval ago */
+    int nb_back = nb_seconds*rewind_fps/rewind_capture_interval - 1;
+    nb_back = (nb_back < 0)?0:((nb_back > nb_entries-1)?(nb_entries-1):nb_back);
+
+    /// ------ Apply deltas backwards, from the newest ------
+    memcpy(next_state, newest_state, rewind_state_size);
+    for(int i = 0; i < nb_back; i++){
+        rewind_entry_t *entry = get_entry(nb_entries-1 - i);
+        const uint8_t *in = rewind_arena + entry->offset;
+        for(size_t pos = 0; pos < rewind_state_size; pos += REWIND_CHUNK_SIZE){
+            size_t size = rewind_state_size - pos;
+            in += rle_decode_xor(next_state + pos, in, (size > REWIND_CHUNK_SIZE)?REWIND_CHUNK_SIZE:size);
+        }
+    }
+    rewind_load_state(next_state, rewind_state_size);
+
+    /// ------ History continues from the restored snapshot ------
+    nb_entries -= nb_back;
+    rewind_entry_t *newest = get_entry(nb_entries-1);
+    write_offset = newest->offset + newest->size;
+    uint8_t *tmp = newest_state;
+    newest_state = next_state;
+    next_state = tmp;
+
+    REWIND_DEBUG_PRINTF("Rewind: restored %d snapshots back, %d left\n", nb_back, nb_entries);
+    return (nb_back + 1)*rewind_capture_interval/rewind_fps;
+}
+
+/**
+ * Print per-frame capture cost and memory per second of history
+ */
+void rewind_print_stats(){
+    if(!nb_captures || !nb_frames){
+        return;
+    }
+#ifdef REWIND_PERF
+    uint64_t bytes_per_snapshot = nb_bytes_stored / nb_captures;
+#endif //REWIND_PERF
+    REWIND_PERF_PRINTF("Rewind: %u snapshots of %zu bytes, %llu bytes each encoded (%llu bytes per second of history), "
+        "%d s in history, frame cost %lluus on average, %lluus max, save state %lluus\n",
+        nb_captures, rewind_state_size, (unsigned long long)bytes_per_snapshot,
+        (unsigned long long)(bytes_per_snapshot*rewind_fps/rewind_capture_interval),
+        rewind_seconds_available(), (unsigned long long)(frame_time_us/nb_frames),
+        (unsigned long long)max_frame_time_us, (unsigned long long)(save_state_time_us/nb_captures));
+}
@@ -0,0 +1,50 @@
+/*
+ * rewind.h
+ * In-memory history of recent app/emulator states, for Quick Reload
+ *
+ * Every capture_interval frames, the app's save callback copies its state
+ * into a buffer. The XOR with the previous snapshot is then RLE encoded
+ * (see rle.h) a few chunks per frame until the next capture, so capturing
+ * never causes a frame spike, into a ring in a preallocated arena: the
+ * oldest snapshots are dropped when it is full.
+ *
+ * Only the newest snapshot is kept whole, older ones are rebuilt by applying
+ * deltas backwards from it.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_REWIND_H
+#define FUNKEY_REWIND_H
+
+#include <stddef.h>
+
+#define REWIND_MAX_SNAPSHOTS        1024
+#define REWIND_CHUNK_SIZE           4096                        /* Encoded independently, the unit of per-frame work */
+
+// Copy the current state into buf (state_size bytes)
+typedef void (*rewind_save_state_t)(void *buf, size_t size);
+
+// Restore the state from buf (state_size bytes)
+typedef void (*rewind_load_state_t)(const void *buf, size_t size);
+
+////------ Functions -------
+
+int init_rewind(size_t state_size, size_t arena_size, int capture_interval, int fps,
+    rewind_save_state_t save_state, rewind_load_state_t load_state);
+void deinit_rewind();
+int rewind_running();
+
+// Call once per app frame, captures and encodes incrementally
+void rewind_frame();
+
+// Seconds of history currently available
+int rewind_seconds_available();
+
+// Restore the state from about nb_seconds ago (or the oldest one), dropping
+// the newer history. Returns the nb of seconds actually rewound, -1 if none.
+int rewind_load_seconds(int nb_seconds);
+
+void rewind_print_stats();
+
+#endif //FUNKEY_REWIND_H
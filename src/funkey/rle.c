@@ -0,0 +1,104 @@
+/*
+ * rle.c
+ * Zero-run RLE of the XOR of two buffers, for state deltas
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <string.h>
+
+#include "rle.h"
+
+/// --------------------------------------------
+/// ---------------  RLE functions  ------------
+/// --------------------------------------------
+
+static uint8_t *put_varint(uint8_t *out, size_t value){
+    while(value >= 0x80){
+        *out++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static const uint8_t *get_varint(const uint8_t *in, size_t *value){
+    size_t res = 0;
+    int shift = 0;
+    uint8_t byte;
+    do{
+        byte = *in++;
+        res |= (size_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    *value = res;
+    return in;
+}
+
+/**
+ * Every token but the first starts with at least RLE_MIN_ZERO_RUN zeros and
+ * has at least one literal, so a token never takes more than 1.5x its input
+ */
+size_t rle_max_encoded_size(size_t size){
+    return size + size/2 + 16;
+}
+
+size_t rle_encode_xor(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t size){
+    uint8_t *start = out;
+    size_t i = 0;
+
+    while(i < size){
+        /// ------ Zero run, skipping 8 bytes at a time ------
+        size_t zero_start = i;
+        while(i + 8 <= size){
+            uint64_t va, vb;
+            memcpy(&va, a + i, sizeof(va));
+            memcpy(&vb, b + i, sizeof(vb));
+            if(va != vb){
+                break;
+            }
+            i += 8;
+        }
+        while(i < size && a[i] == b[i]){
+            i++;
+        }
+        size_t nb_zeros = i - zero_start;
+
+        /// ------ Literals, until RLE_MIN_ZERO_RUN equal bytes in a row ------
+        size_t literal_start = i;
+        size_t literal_end = i;
+        while(i < size && i - literal_end < RLE_MIN_ZERO_RUN){
+            if(a[i] != b[i]){
+                literal_end = i + 1;
+            }
+            i++;
+        }
+        i = literal_end;
+
+        out = put_varint(out, nb_zeros);
+        out = put_varint(out, literal_end - literal_start);
+        for(size_t k = literal_start; k < literal_end; k++){
+            *out++ = a[k] ^ b[k];
+        }
+    }
+    return out - start;
+}
+
+size_t rle_decode_xor(uint8_t *dst, const uint8_t *in, size_t size){
+    const uint8_t *start = in;
+    size_t i = 0;
+
+    while(i < size){
+        size_t nb_zeros, nb_literals;
+        in = get_varint(in, &nb_zeros);
+        in = get_varint(in, &nb_literals);
+        i += nb_zeros;
+        if(i + nb_literals > size){
+            break;
+        }
+        for(size_t k = 0; k < nb_literals; k++){
+            dst[i++] ^= *in++;
+        }
+    }
+    return in - start;
+}
@@ -0,0 +1,33 @@
+/*
+ * rle.h
+ * Zero-run RLE of the XOR of two buffers, for state deltas
+ *
+ * Consecutive snapshots of an app/emulator state mostly differ in a few
+ * places, so their XOR is mostly zeros. Encoded as a sequence of
+ * (zero run, literal length, literal bytes) with varint lengths. Short zero
+ * runs are kept inside literals, so the output never grows past
+ * rle_max_encoded_size().
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_RLE_H
+#define FUNKEY_RLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RLE_MIN_ZERO_RUN            4                           /* Shorter runs of equal bytes stay in literals */
+
+////------ Functions -------
+
+// Worst case size of rle_encode_xor() output for size input bytes
+size_t rle_max_encoded_size(size_t size);
+
+// Encode a XOR b (size bytes) into out, returns the encoded size
+size_t rle_encode_xor(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t size);
+
+// XOR the decoded size bytes into dst, returns the nb of encoded bytes read from in
+size_t rle_decode_xor(uint8_t *dst, const uint8_t *in, size_t size);
+
+#endif //FUNKEY_RLE_H
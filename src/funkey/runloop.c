@@ -0,0 +1,195 @@
+/*
+ * runloop.c
+ * Fixed-timestep main loop for Funkey apps
+ *
+ * Time is kept in microseconds from get_time_us(). The step is rounded to
+ * the microsecond (20000us at 50Hz), sleeps are SDL_Delay()s rounded up to
+ * the millisecond then the accumulator decides, so sleeping short or long
+ * only shifts when an update runs, not how many run.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SDL/SDL.h>
+
+#include "runloop.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define RUNLOOP_DEBUG
+#define RUNLOOP_ERROR
+
+#ifdef RUNLOOP_DEBUG
+#define RUNLOOP_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RUNLOOP_DEBUG_PRINTF(...)
+#endif //RUNLOOP_DEBUG
+
+#ifdef RUNLOOP_ERROR
+#define RUNLOOP_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RUNLOOP_ERROR_PRINTF(...)
+#endif //RUNLOOP_ERROR
+
+//#define RUNLOOP_PERF
+
+#ifdef RUNLOOP_PERF
+#define RUNLOOP_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define RUNLOOP_PERF_PRINTF(...)
+#endif //RUNLOOP_PERF
+
+
+/// -------------- STATIC VARIABLES --------------
+static runloop_update_t runloop_update = NULL;                  /* NULL when not initialized */
+static runloop_render_t runloop_render = NULL;
+static void *runloop_data = NULL;
+static uint64_t step_us = 20000;
+static int runloop_max_skip = RUNLOOP_DEFAULT_MAX_SKIP;
+static int render_load_us = 0;
+
+static uint64_t last_us = 0;                                    /* Accumulated up to there */
+static uint64_t accumulator_us = 0;
+static int paused = 0;
+static uint32_t renders_skipped_in_a_row = 0;
+
+static runloop_stats_t runloop_stats;
+
+
+/// --------------------------------------------
+/// ------------  RUNLOOP functions  -----------
+/// --------------------------------------------
+
+int init_runloop(int update_hz, int max_skip, runloop_update_t update, runloop_render_t render, void *data){
+    if(update_hz <= 0 || update == NULL || render == NULL){
+        RUNLOOP_ERROR_PRINTF("ERROR in init_runloop: Invalid update rate %d or callbacks\n", update_hz);
+        return -1;
+    }
+    runloop_update = update;
+    runloop_render = render;
+    runloop_data = data;
+    step_us = 1000000 / update_hz;
+    runloop_max_skip = (max_skip > 0)?max_skip:0;
+
+    memset(&runloop_stats, 0, sizeof(runloop_stats));
+    renders_skipped_in_a_row = 0;
+    accumulator_us = 0;
+    paused = 0;
+    last_us = get_time_us();
+    return 0;
+}
+
+void deinit_runloop(){
+    if(runloop_update){
+        runloop_print_stats();
+        runloop_update = NULL;
+        runloop_render = NULL;
+    }
+}
+
+void runloop_set_render_load(int load_us){
+    render_load_us = (load_us > 0)?load_us:0;
+}
+
+void runloop_pause(){
+    if(!runloop_update || paused){
+        return;
+    }
+    uint64_t now_us = get_time_us();
+    runloop_stats.running_us += now_us - last_us;
+    accumulator_us += now_us - last_us;
+    last_us = now_us;
+    paused = 1;
+}
+
+void runloop_resume(){
+    if(!paused){
+        return;
+    }
+    /* Time spent paused isn't caught up, what was accumulated before is kept */
+    last_us = get_time_us();
+    paused = 0;
+}
+
+static void accumulate(){
+    uint64_t now_us = get_time_us();
+    accumulator_us += now_us - last_us;
+    runloop_stats.running_us += now_us - last_us;
+    last_us = now_us;
+}
+
+void runloop_step(){
+    if(!runloop_update || paused){
+        return;
+    }
+
+    /// ------ Wait for the next update to be due ------
+    accumulate();
+    if(accumulator_us < step_us){
+        TRACE_BEGIN("runloop: wait");
+        SDL_Delay((step_us - accumulator_us + 999)/1000);
+        accumulate();
+        TRACE_END("runloop: wait");
+        if(accumulator_us < step_us){
+            return;
+        }
+    }
+
+    /// ------ Updates due, one more for each render skipped ------
+    int nb_updates = 0;
+    while(accumulator_us >= step_us && nb_updates <= runloop_max_skip){
+        TRACE_BEGIN("runloop: update");
+        runloop_update(runloop_data);
+        TRACE_END("runloop: update");
+        accumulator_us -= step_us;
+        nb_updates++;
+    }
+    runloop_stats.nb_updates += nb_updates;
+    runloop_stats.nb_renders_skipped += nb_updates - 1;
+    renders_skipped_in_a_row += nb_updates - 1;
+    if(renders_skipped_in_a_row > runloop_stats.max_renders_skipped){
+        runloop_stats.max_renders_skipped = renders_skipped_in_a_row;
+    }
+
+    /// ------ Still behind after max_skip: slow down rather than never render ------
+    if(accumulator_us >= step_us){
+        runloop_stats.nb_updates_dropped += accumulator_us / step_us;
+        RUNLOOP_DEBUG_PRINTF("Runloop: %llu updates dropped\n", (unsigned long long)(accumulator_us / step_us));
+        accumulator_us %= step_us;
+    }
+
+    TRACE_BEGIN("runloop: render");
+    runloop_render(runloop_data);
+    if(render_load_us){
+        uint64_t load_end_us = get_time_us() + render_load_us;
+        while(get_time_us() < load_end_us);
+    }
+    TRACE_END("runloop: render");
+    runloop_stats.nb_renders++;
+    renders_skipped_in_a_row = 0;
+}
+
+void runloop_get_stats(runloop_stats_t *stats){
+    *stats = runloop_stats;
+}
+
+/**
+ * Print the update rate actually reached, it should match update_hz unless
+ * updates were dropped, and how many renders were skipped to hold it
+ */
+void runloop_print_stats(){
+    if(!runloop_stats.running_us || !runloop_stats.nb_updates){
+        return;
+    }
+    RUNLOOP_PERF_PRINTF("Runloop: %u updates in %.2fs (%.2f Hz), %u renders (%.2f Hz), %u skipped (%u in a row max), %u updates dropped\n",
+        runloop_stats.nb_updates, runloop_stats.running_us/1000000.0,
+        runloop_stats.nb_updates*1000000.0/runloop_stats.running_us, runloop_stats.nb_renders,
+        runloop_stats.nb_renders*1000000.0/runloop_stats.running_us, runloop_stats.nb_renders_skipped,
+        runloop_stats.max_renders_skipped, runloop_stats.nb_updates_dropped);
+}
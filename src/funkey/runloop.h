@@ -0,0 +1,54 @@
+/*
+ * runloop.h
+ * Fixed-timestep main loop for Funkey apps
+ *
+ * The app's update callback runs at exactly update_hz on average, from an
+ * accumulator of elapsed time, whatever rendering costs. When behind, up to
+ * max_skip renders in a row are skipped so updates catch up; past that the
+ * simulation is allowed to slow down instead of spiralling.
+ *
+ * Call runloop_step() from the app's main loop, after processing events: it
+ * waits for the next update to be due, runs the updates due, then renders
+ * once. Pause around anything that blocks the loop (the menu) so the time
+ * spent there isn't caught up afterwards.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_RUNLOOP_H
+#define FUNKEY_RUNLOOP_H
+
+#include <stdint.h>
+
+#define RUNLOOP_DEFAULT_MAX_SKIP    4                           /* Renders skipped in a row at most */
+
+typedef void (*runloop_update_t)(void *data);
+typedef void (*runloop_render_t)(void *data);
+
+typedef struct{
+    uint32_t nb_updates;
+    uint32_t nb_renders;
+    uint32_t nb_renders_skipped;                                /* Updates that weren't followed by a render */
+    uint32_t max_renders_skipped;                               /* In a row */
+    uint32_t nb_updates_dropped;                                /* Given up after max_skip, the simulation slowed down */
+    uint64_t running_us;                                        /* Not counting pauses */
+} runloop_stats_t;
+
+////------ Functions -------
+
+int init_runloop(int update_hz, int max_skip, runloop_update_t update, runloop_render_t render, void *data);
+void deinit_runloop();
+
+// Wait for the next update, run the updates due and render once (unless skipped)
+void runloop_step();
+
+void runloop_pause();
+void runloop_resume();
+
+// Busy-wait this long in every render, to check the update rate holds under load (0 to disable)
+void runloop_set_render_load(int load_us);
+
+void runloop_get_stats(runloop_stats_t *stats);
+void runloop_print_stats();
+
+#endif //FUNKEY_RUNLOOP_H
@@ -14,6 +14,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>     /* Used for running shell scripts via execlp */
 
 #include <SDL/SDL.h>
@@ -21,6 +29,16 @@
 #include <SDL/SDL_image.h>
 
 #include "sdl-menu.h"
+#include "sdl-present.h"
+#include "time-utils.h"
+#include "trace.h"
+#include "alloc-check.h"
+#include "configfile_fk.h"
+#include "blit-kernels.h"
+#include "rewind.h"
+#include "thread-pool.h"
+#include "sdl-notif.h"
+#include "crc32c.h"
 
 /// -------------- DEFINES --------------
 #define MIN(a,b) (((a)<(b))?(a):(b))
@@ -42,8 +60,17 @@
 #define MENU_ERROR_PRINTF(...)
 #endif //MENU_ERROR
 
+//#define MENU_PERF
 
-#define SCROLL_SPEED_PX             30
+#ifdef MENU_PERF
+#define MENU_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define MENU_PERF_PRINTF(...)
+#endif //MENU_PERF
+
+
+#define SCROLL_SPEED_PX             30                          /* Per frame at FPS_MENU, scroll is time based */
+#define SCROLL_DURATION_MS          (1000*MENU_ZONE_HEIGHT/SCROLL_SPEED_PX/FPS_MENU)
 #define FPS_MENU                    50
 #define ARROWS_PADDING              8                           /* UNUSED - Determined from MENU_BG_SQUARE_HEIGHT */
 
@@ -52,15 +79,16 @@
 #define MENU_BG_SQUARE_WIDTH        180
 #define MENU_BG_SQUARE_HEIGHT       140
 
-#define MENU_FONT_NAME_TITLE        "/usr/games/menu_resources/OpenSans-Bold.ttf"
+#define MENU_RESOURCES_DIR          "/usr/games/menu_resources" /* Default, see menu_set_resources_dir() */
+#define MENU_FONT_NAME_TITLE        "OpenSans-Bold.ttf"
 #define MENU_FONT_SIZE_TITLE        22
-#define MENU_FONT_NAME_INFO         "/usr/games/menu_resources/OpenSans-Bold.ttf"
+#define MENU_FONT_NAME_INFO         "OpenSans-Bold.ttf"
 #define MENU_FONT_SIZE_INFO         16
-#define MENU_FONT_NAME_SMALL_INFO   "/usr/games/menu_resources/OpenSans-Regular.ttf"
+#define MENU_FONT_NAME_SMALL_INFO   "OpenSans-Regular.ttf"
 #define MENU_FONT_SIZE_SMALL_INFO   13
-#define MENU_PNG_BG_PATH            "/usr/games/menu_resources/zone_bg.png"
-#define MENU_PNG_ARROW_TOP_PATH     "/usr/games/menu_resources/arrow_top.png"
-#define MENU_PNG_ARROW_BOTTOM_PATH  "/usr/games/menu_resources/arrow_bottom.png"
+#define MENU_PNG_BG_NAME            "zone_bg.png"
+#define MENU_PNG_ARROW_TOP_NAME     "arrow_top.png"
+#define MENU_PNG_ARROW_BOTTOM_NAME  "arrow_bottom.png"
 
 #define GRAY_MAIN_R                 85                          /* GRAY elements are text and progress bars */
 #define GRAY_MAIN_G                 85
@@ -69,9 +97,81 @@
 #define WHITE_MAIN_G                236
 #define WHITE_MAIN_B                236
 
-#define MAX_SAVE_SLOTS              9                           /* Would have to be passed in from app/emu on init */
+#define MAX_REWIND_SECONDS          10                          /* Choices in the rewind zone, if there's that much history */
 
 #define MAXPATHLEN                  512
+#define MENU_NO_PREFETCH            -2                          /* Not a slot, MENU_AUTO_SAVE_SLOT is -1 */
+#define LOAD_PREFETCH_CHUNK_SIZE    (64*1024)                   /* Cancellation is checked between chunks */
+#define MENU_ARENA_ALIGN            16
+#define MENU_MAX_PINNED             (NB_MENU_TYPES + 5)         /* Arena, zone background and overlays, widget atlas and arrows */
+#define NB_MENU_FONT_FILES          3                           /* Title, info, small info */
+#define NB_MENU_PNG_FILES           3                           /* Zone background, arrows */
+
+/* Image asset loaded by a pool task at init */
+typedef struct{
+    const char *path;
+    SDL_Surface **surface;
+} menu_image_load_t;
+
+/* Side effects of opening the menu, run concurrently once the first frame is shown */
+typedef enum{
+    MENU_TASK_KEYMAP_DEFAULT,
+    MENU_TASK_AUDIO_AMP_OFF,
+    MENU_TASK_VOLUME_GET,
+    MENU_TASK_BRIGHTNESS_GET,
+    NB_MENU_TASKS,
+} ENUM_MENU_TASK;
+
+/* Pre-rendered widget states, each drawn with a single blit from the widget atlas */
+typedef enum{
+    WIDGET_VOLUME_BAR,                                                          /* + number of full bars */
+    WIDGET_BRIGHTNESS_BAR       = WIDGET_VOLUME_BAR + 100/STEP_CHANGE_VOLUME + 1,   /* + number of full bars */
+    WIDGET_SAVE_SLOT            = WIDGET_BRIGHTNESS_BAR + 100/STEP_CHANGE_BRIGHTNESS + 1, /* + saveslot */
+    WIDGET_SAVE_SAVING          = WIDGET_SAVE_SLOT + MAX_SAVE_SLOTS,
+    WIDGET_SAVE_CONFIRM,
+    WIDGET_SAVE_STATE,
+    WIDGET_LOAD_SLOT,                                                           /* + saveslot */
+    WIDGET_LOAD_AUTO_SAVE       = WIDGET_LOAD_SLOT + MAX_SAVE_SLOTS,
+    WIDGET_LOAD_LOADING,
+    WIDGET_LOAD_CONFIRM,
+    WIDGET_LOAD_STATE,
+    WIDGET_LOAD_AUTO_SAVE_STATE,
+    WIDGET_ASPECT_RATIO,                                                        /* + aspect_ratio */
+    WIDGET_EXIT_CONFIRM         = WIDGET_ASPECT_RATIO + NB_ASPECT_RATIOS_TYPES,
+    WIDGET_POWERDOWN_CONFIRM,
+    WIDGET_REWIND_SECONDS,                                                      /* + rewind_seconds-1 */
+    WIDGET_REWIND_REWINDING     = WIDGET_REWIND_SECONDS + MAX_REWIND_SECONDS,
+    WIDGET_REWIND_CONFIRM,
+    NB_WIDGETS,
+} ENUM_WIDGET;
+
+/* A zone is the shared zone background, with the pixels that differ (title, empty progress bar) in an overlay */
+typedef struct{
+    SDL_Surface *overlay;                                       /* Zone pixels within rect, NULL if the zone is just the background */
+    SDL_Rect rect;                                              /* Position of the overlay in the zone */
+} menu_zone_t;
+
+typedef struct{
+    SDL_Rect src;                                               /* Position in widget_atlas, w=0 if not rendered */
+    Sint16 x, y;                                                /* Position on draw_screen */
+} menu_widget_t;
+
+/* How a widget is rendered at init */
+typedef struct{
+    ENUM_MENU_TYPE menu_type;                                   /* Zone providing the background under the widget */
+    TTF_Font *font;                                             /* NULL for progress bars */
+    char text[40];
+    int offset_y;                                               /* Text center from zone center */
+    uint8_t percentage;
+    uint16_t nb_bars;
+} menu_widget_desc_t;
+
+/* Hardware values written in the background, latest request wins */
+typedef enum{
+    SYSTEM_VALUE_VOLUME,
+    SYSTEM_VALUE_BRIGHTNESS,
+    NB_SYSTEM_VALUES,
+} ENUM_SYSTEM_VALUE;
 
 
 /// -------------- STATIC VARIABLES for menu --------------
@@ -81,6 +181,7 @@ static int framecount;                                          /* UNUSED - Came
 static int backup_key_repeat_delay, backup_key_repeat_interval;
 
 static SDL_Surface *hw_screen = NULL;                           /* Pointer to main emu/app SDL_Surface (what it was rendering before menu started) */
+static SDL_Surface *app_frame = NULL;                           /* Optional software copy of the app's last frame, see menu_set_app_frame() */
 static SDL_Surface * backup_hw_screen = NULL;                   
 static SDL_Surface * draw_screen = NULL;                        
 static TTF_Font *menu_title_font = NULL;
@@ -88,11 +189,15 @@ static TTF_Font *menu_info_font = NULL;
 static TTF_Font *menu_small_info_font = NULL;
 static SDL_Surface *img_arrow_top = NULL;
 static SDL_Surface *img_arrow_bottom = NULL;
-static SDL_Surface ** menu_zone_surfaces = NULL;
-static int * idx_menus = NULL;
+static SDL_Surface *menu_zone_bg = NULL;                        /* Background shared by all zones */
+static SDL_Surface *menu_zone_scratch = NULL;                   /* Full zone, only while rendering zones and widgets at init */
+static int menu_zone_scratch_idx = -1;                          /* Zone currently in menu_zone_scratch */
+static menu_zone_t * menu_zones = NULL;                         /* NB_MENU_TYPES entries, from menu_arena */
+static int * idx_menus = NULL;                                  /* NB_MENU_TYPES entries, from menu_arena */
 static int nb_menu_zones = 0;
 static int menuItem = 0;
 int stop_menu_loop = 0;
+static menu_stats_t menu_stats;                                 /* Of the last menu loop, see menu_get_stats() */
 
 static SDL_Color text_color = {GRAY_MAIN_R, GRAY_MAIN_G, GRAY_MAIN_B};
 static int padding_y_from_center_menu_zone = 18;
@@ -107,13 +212,65 @@ int volume_percentage = 0;
 int brightness_percentage = 0;
 
 static int quick_load_slot_chosen = 0;
+static int rewind_seconds = 1;
+
+static thread_pool_group_t menu_task_group;                     /* Menu open side effects, joined when the menu closes */
+static thread_pool_group_t menu_notif_group;                    /* `notif set` fallbacks, sent after the menu closed */
+static int menu_task_results[NB_MENU_TASKS];
+static int menu_tasks_done = 0;                                 /* Bitmask of finished ENUM_MENU_TASK, only accessed atomically */
+static int system_values_known = 0;                             /* Bitmask of the GET tasks that ever completed, bars are drawn from then */
+
+static uint8_t *menu_arena = NULL;                              /* All fixed size menu memory, allocated once in init_menu_SDL() */
+static size_t menu_arena_size = 0;
+static size_t menu_arena_used = 0;
+
+static SDL_Surface *widget_atlas = NULL;
+static menu_widget_t menu_widgets[NB_WIDGETS];
+
+static int pin_resources = 0;                                   /* See menu_set_pin_resources() */
+
+static menu_slot_path_t menu_slot_path = NULL;                  /* See menu_set_load_slot() */
+static menu_load_slot_t menu_load_slot = NULL;
+static int load_prefetch = 0;
+static uint8_t *load_buf = NULL;                                /* Slot file, prefetched or read on confirm */
+static size_t load_buf_size = 0;
+static thread_pool_group_t load_prefetch_group;
+static int load_prefetch_slot = MENU_NO_PREFETCH;               /* Slot being read into load_buf, or read */
+static int load_prefetch_failed_slot = MENU_NO_PREFETCH;        /* Last slot that couldn't be opened, retried once another slot or a save was */
+static int load_prefetch_fd = -1;
+static int load_prefetch_cancel = 0;                            /* Only accessed atomically */
+static ssize_t load_prefetch_size = -1;                         /* Read by the task, -1 if it failed or was cancelled */
+static uint32_t load_crc = 0;                                   /* CRC32C of what the last read got past the header */
+static uint64_t load_read_us = 0;                               /* Time it spent reading, and checksumming */
+static uint64_t load_crc_us = 0;
+
+static char notif_cmd[100];                                     /* Sent from the thread pool when toasts aren't drawn in-process */
+
+static menu_save_slot_t menu_save_slot = NULL;                  /* See menu_set_save_slot() */
+static int save_in_background = 0;
+static pid_t save_pid = 0;                                      /* Child writing a save in the background, 0 if none */
+static int save_pid_slot = 0;
+static uint64_t save_start_us = 0;
+static struct{
+    void *addr;
+    size_t size;
+} pinned_memory[MENU_MAX_PINNED];
+static int nb_pinned_memory = 0;
+static void *pinned_fonts[NB_MENU_FONT_FILES];                  /* Font files mapped and locked in the page cache */
+static size_t pinned_fonts_size[NB_MENU_FONT_FILES];
+static int nb_menu_opens = 0;
+
+static thread_pool_group_t system_value_group;                 /* Setter task, joined when the menu closes */
+static int system_value_setter_busy = 0;                        /* A setter task is queued or running, only accessed atomically */
+static int pending_system_values[NB_SYSTEM_VALUES] = {-1, -1};  /* Latest requested value, -1 if none, only accessed atomically */
+static unsigned int nb_system_value_requests[NB_SYSTEM_VALUES];
+static unsigned int nb_system_value_writes[NB_SYSTEM_VALUES];
 
 #undef X
 #define X(a, b) b,
 // const char *resume_options_str[] = {RESUME_OPTIONS};
 
-/* TODO - This was moved from configfile_fk.c, which still needs to be properly implemented
-          I should also brush on exactly what X Macros do... */
+/* Persisted by configfile_fk.c, along with saveslot */
 
 #undef X
 #define X(a, b) b,
@@ -123,72 +280,736 @@ unsigned int aspect_ratio                   = ASPECT_RATIOS_TYPE_STRETCHED;
 unsigned int aspect_ratio_factor_percent    = 50;
 
 extern int saveslot;
+extern char *cfg_file_rom;
 
 /// --------------------------------------------
 /// -------------  MENU functions  -------------
 /// --------------------------------------------
 
+static void *menu_arena_alloc(size_t size){
+    size = (size + MENU_ARENA_ALIGN-1) & ~(size_t)(MENU_ARENA_ALIGN-1);
+    if(menu_arena == NULL || menu_arena_used + size > menu_arena_size){
+        MENU_ERROR_PRINTF("ERROR in menu_arena_alloc: Out of arena memory for %zu bytes\n", size);
+        return NULL;
+    }
+    void *ptr = menu_arena + menu_arena_used;
+    menu_arena_used += size;
+    return ptr;
+}
+
+/**
+ * Screen-sized software surface with its pixels in menu_arena (freed with it)
+ */
+static SDL_Surface *create_menu_arena_surface(SDL_Surface *screen){
+    int pitch = (screen->w * screen->format->BytesPerPixel + 3) & ~3;
+    void *pixels = menu_arena_alloc(pitch * screen->h);
+    if(pixels == NULL){
+        return NULL;
+    }
+    return SDL_CreateRGBSurfaceFrom(pixels, screen->w, screen->h, screen->format->BitsPerPixel,
+        pitch, 0, 0, 0, 0);
+}
+
+/// ------ Notifications, drawn in-process by the app's present path when it set them up ------
+static void run_notif_task(void *arg){
+    TRACE_BEGIN(SHELL_CMD_NOTIF_SET);
+    system((const char*)arg);
+    TRACE_END(SHELL_CMD_NOTIF_SET);
+}
+
+static void menu_notif(const char *text){
+    if(!notif_push(text, NOTIF_SECONDS_DISP)){
+        return;
+    }
+
+    /// ------ Fallback: `notif set`, without blocking the app ------
+    thread_pool_wait(&menu_notif_group);
+    snprintf(notif_cmd, sizeof(notif_cmd), "%s %d \"%s\"", SHELL_CMD_NOTIF_SET, NOTIF_SECONDS_DISP, text);
+    thread_pool_submit(&menu_notif_group, run_notif_task, notif_cmd);
+}
+
+/// ------ Saves, optionally written by a forked child from its copy-on-write view of the app ------
+/**
+ * Let the menu save slots with save_slot. With background set, the save is
+ * written by a forked child while the app resumes, call menu_poll() every
+ * frame to collect its result.
+ */
+void menu_set_save_slot(menu_save_slot_t save_slot, int background){
+    menu_save_slot = save_slot;
+    save_in_background = background;
+}
+
+static void format_save_notif(char *text, size_t size, int slot, int res){
+    if(res){
+        snprintf(text, size, "      SAVE FAILED IN SLOT %d", slot+1);
+    }
+    else{
+        snprintf(text, size, "        SAVED IN SLOT %d", slot+1);
+    }
+}
+
+static void finish_background_save(int status){
+    int res = (WIFEXITED(status) && WEXITSTATUS(status) == 0)?0:-1;
+    TRACE_INSTANT("menu: background save collected");
+    MENU_PERF_PRINTF("Save in slot %d: written in the background in %lluus\n", save_pid_slot+1,
+        (unsigned long long)(get_time_us()-save_start_us));
+    if(res){
+        MENU_ERROR_PRINTF("ERROR Background save in slot %d failed (status %d)\n", save_pid_slot+1, status);
+    }
+    save_pid = 0;
+    load_prefetch_failed_slot = MENU_NO_PREFETCH;
+
+    /// ------ Notify without blocking the app ------
+    char notif_text[NOTIF_MAX_LEN];
+    format_save_notif(notif_text, sizeof(notif_text), save_pid_slot, res);
+    menu_notif(notif_text);
+}
+
+static void wait_background_save(){
+    int status;
+    if(save_pid && waitpid(save_pid, &status, 0) == save_pid){
+        finish_background_save(status);
+    }
+    save_pid = 0;
+}
+
+/* Returns 0 if the child was started */
+static int start_background_save(int slot){
+    /// ------ One save at a time, in order ------
+    wait_background_save();
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0){
+        MENU_ERROR_PRINTF("ERROR Could not fork for background save: %s\n", strerror(errno));
+        return -1;
+    }
+    if(pid == 0){
+        /// ------ Child: only the app state is used, no atexit handlers ------
+        _exit(menu_save_slot(slot)?1:0);
+    }
+    save_pid = pid;
+    save_pid_slot = slot;
+    save_start_us = get_time_us();
+    return 0;
+}
+
+/**
+ * Collect the result of a background save, call once per app frame
+ */
+void menu_poll(){
+    int status;
+    if(save_pid && waitpid(save_pid, &status, WNOHANG) == save_pid){
+        finish_background_save(status);
+    }
+}
+
+/// ------ Loads, the highlighted slot is read ahead in the background ------
+/**
+ * Let the menu load slots, files are read into a buffer of max_size bytes
+ * allocated now. With prefetch set, the slot highlighted in the LOAD zone is
+ * read by a pool thread while the user decides.
+ */
+void menu_set_load_slot(menu_slot_path_t slot_path, menu_load_slot_t load_slot, size_t max_size, int prefetch){
+    free(load_buf);
+    load_buf = (uint8_t*) malloc(max_size);
+    if(load_buf == NULL){
+        MENU_ERROR_PRINTF("ERROR in menu_set_load_slot: Could not allocate %zu bytes\n", max_size);
+        return;
+    }
+    load_buf_size = max_size;
+    menu_slot_path = slot_path;
+    menu_load_slot = load_slot;
+    load_prefetch = prefetch;
+}
+
+/* Read a slot file into load_buf, the CRC32C of the data is computed chunk by chunk as it comes in */
+static ssize_t read_load_slot_fd(int fd, const int *cancel){
+    size_t size = 0;
+    load_crc = 0;
+    load_read_us = load_crc_us = 0;
+    while(size < load_buf_size){
+        if(cancel && __atomic_load_n(cancel, __ATOMIC_ACQUIRE)){
+            return -1;
+        }
+        size_t chunk_size = MIN(load_buf_size - size, LOAD_PREFETCH_CHUNK_SIZE);
+        uint64_t read_start_us = get_time_us();
+        ssize_t res = read(fd, load_buf + size, chunk_size);
+        if(res < 0 && errno == EINTR){
+            continue;
+        }
+        if(res <= 0){
+            return res?-1:(ssize_t)size;
+        }
+        uint64_t crc_start_us = get_time_us();
+        load_read_us += crc_start_us - read_start_us;
+
+        /// ------ Only the data is checksummed, not the header ------
+        size_t crc_pos = MAX(size, sizeof(crc32c_header_t));
+        size += res;
+        if(size > crc_pos){
+            load_crc = crc32c(load_crc, load_buf + crc_pos, size - crc_pos);
+        }
+        load_crc_us += get_time_us() - crc_start_us;
+    }
+    return size;
+}
+
+static void load_prefetch_task(void *arg){
+    TRACE_SCOPE("menu: load prefetch");
+    load_prefetch_size = read_load_slot_fd(load_prefetch_fd, &load_prefetch_cancel);
+}
+
+/* Stop reading ahead, load_buf can be reused once this returns */
+static void cancel_load_prefetch(){
+    if(load_prefetch_slot == MENU_NO_PREFETCH){
+        return;
+    }
+    __atomic_store_n(&load_prefetch_cancel, 1, __ATOMIC_RELEASE);
+    thread_pool_wait(&load_prefetch_group);
+    close(load_prefetch_fd);
+    load_prefetch_fd = -1;
+    load_prefetch_slot = MENU_NO_PREFETCH;
+}
+
+static void start_load_prefetch(int slot){
+    /// ------ Already read or being read, missing (not retried every frame), or a background save may still be writing it ------
+    if(!load_prefetch || !menu_slot_path || slot == load_prefetch_slot || slot == load_prefetch_failed_slot || save_pid){
+        return;
+    }
+    cancel_load_prefetch();
+
+    char path[MAXPATHLEN];
+    menu_slot_path(slot, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        load_prefetch_failed_slot = slot;
+        return;
+    }
+    load_prefetch_failed_slot = MENU_NO_PREFETCH;
+
+    /// ------ Start the readahead now, a pool thread waits for the data ------
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    load_prefetch_fd = fd;
+    load_prefetch_slot = slot;
+    load_prefetch_size = -1;
+    __atomic_store_n(&load_prefetch_cancel, 0, __ATOMIC_RELEASE);
+    thread_pool_submit(&load_prefetch_group, load_prefetch_task, NULL);
+}
+
+/* Load slot, from the prefetched buffer if it holds that slot */
+static int load_menu_slot(int slot, int *prefetched){
+    *prefetched = 0;
+    if(!menu_load_slot){
+        return 0;
+    }
+    TRACE_SCOPE("menu: load slot");
+    ssize_t size = -1;
+    if(slot == load_prefetch_slot){
+        thread_pool_wait(&load_prefetch_group);
+        size = load_prefetch_size;
+    }
+    *prefetched = (size >= 0);
+    cancel_load_prefetch();
+
+    /// ------ Not prefetched (or failed), read it now ------
+    if(!*prefetched){
+        char path[MAXPATHLEN];
+        menu_slot_path(slot, path, sizeof(path));
+        int fd = open(path, O_RDONLY);
+        if(fd < 0){
+            MENU_ERROR_PRINTF("ERROR Could not open %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        size = read_load_slot_fd(fd, NULL);
+        close(fd);
+        if(size < 0){
+            MENU_ERROR_PRINTF("ERROR Could not read %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    /// ------ Refuse truncated or corrupted files ------
+    crc32c_header_t header;
+    if((size_t)size < sizeof(header)){
+        MENU_ERROR_PRINTF("ERROR Slot %d: %zd bytes file, no integrity header\n", slot, size);
+        return -1;
+    }
+    memcpy(&header, load_buf, sizeof(header));
+    size -= sizeof(header);
+    MENU_PERF_PRINTF("Load from slot %d: %zd bytes, read at %.1fMB/s, CRC32C (%s) at %.1fMB/s\n", slot, size,
+        load_read_us?size/(double)load_read_us:0.0, crc32c_kernel_name(), load_crc_us?size/(double)load_crc_us:0.0);
+    if(crc32c_header_check(&header, load_crc, size)){
+        return -1;
+    }
+    return menu_load_slot(slot, load_buf + sizeof(header), size);
+}
+
+/// ------ Zone storage: shared background + per-zone overlays ------
+/* Raw copy of a rect between surfaces of the same format, alpha included */
+static void copy_surface_rect(SDL_Surface *src, SDL_Rect *src_rect, SDL_Surface *dst, int dst_x, int dst_y){
+    int bpp = src->format->BytesPerPixel;
+    for(int y = 0; y < src_rect->h; y++){
+        memcpy((uint8_t*)dst->pixels + (dst_y+y)*dst->pitch + dst_x*bpp,
+            (uint8_t*)src->pixels + (src_rect->y+y)*src->pitch + src_rect->x*bpp, src_rect->w*bpp);
+    }
+}
+
+/**
+ * Full zone idx (background + overlay) in a scratch surface, for rendering at
+ * init. idx -1 for the background alone, to draw a new zone on.
+ */
+static SDL_Surface* get_menu_zone_scratch(int idx){
+    if(menu_zone_bg == NULL){
+        return NULL;
+    }
+    if(menu_zone_scratch == NULL){
+        SDL_PixelFormat *format = menu_zone_bg->format;
+        menu_zone_scratch = SDL_CreateRGBSurface(SDL_SWSURFACE, menu_zone_bg->w, menu_zone_bg->h,
+            format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+        if(menu_zone_scratch == NULL){
+            MENU_ERROR_PRINTF("ERROR in get_menu_zone_scratch: Could not create surface: %s\n", SDL_GetError());
+            return NULL;
+        }
+        SDL_SetAlpha(menu_zone_scratch, menu_zone_bg->flags & SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+        menu_zone_scratch_idx = -2;
+    }
+    if(idx == -1 || idx != menu_zone_scratch_idx){
+        SDL_Rect all = {0, 0, menu_zone_bg->w, menu_zone_bg->h};
+        copy_surface_rect(menu_zone_bg, &all, menu_zone_scratch, 0, 0);
+        if(idx >= 0 && menu_zones[idx].overlay != NULL){
+            SDL_Rect overlay = {0, 0, menu_zones[idx].rect.w, menu_zones[idx].rect.h};
+            copy_surface_rect(menu_zones[idx].overlay, &overlay, menu_zone_scratch,
+                menu_zones[idx].rect.x, menu_zones[idx].rect.y);
+        }
+        menu_zone_scratch_idx = idx;
+    }
+    return menu_zone_scratch;
+}
+
+/* Keep the bounding box of the pixels drawn on the background in the scratch surface */
+static void extract_menu_zone_overlay(int idx){
+    SDL_Surface *zone = menu_zone_scratch;
+    int bpp = zone->format->BytesPerPixel;
+    int x0 = zone->w, x1 = 0, y0 = zone->h, y1 = 0;
+
+    for(int y = 0; y < zone->h; y++){
+        uint8_t *row = (uint8_t*)zone->pixels + y*zone->pitch;
+        uint8_t *bg_row = (uint8_t*)menu_zone_bg->pixels + y*menu_zone_bg->pitch;
+        if(!memcmp(row, bg_row, zone->w*bpp)){
+            continue;
+        }
+        int x = 0, last = zone->w-1;
+        while(!memcmp(row + x*bpp, bg_row + x*bpp, bpp)){
+            x++;
+        }
+        while(!memcmp(row + last*bpp, bg_row + last*bpp, bpp)){
+            last--;
+        }
+        x0 = MIN(x0, x);
+        x1 = MAX(x1, last+1);
+        y0 = MIN(y0, y);
+        y1 = y+1;
+    }
+    menu_zone_scratch_idx = idx;
+    if(y0 >= y1){
+        return;
+    }
+
+    SDL_Rect rect = {x0, y0, x1-x0, y1-y0};
+    SDL_PixelFormat *format = zone->format;
+    SDL_Surface *overlay = SDL_CreateRGBSurface(SDL_SWSURFACE, rect.w, rect.h,
+        format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    if(overlay == NULL){
+        MENU_ERROR_PRINTF("ERROR in extract_menu_zone_overlay: Could not create surface: %s\n", SDL_GetError());
+        return;
+    }
+    copy_surface_rect(zone, &rect, overlay, 0, 0);
+    SDL_SetAlpha(overlay, zone->flags & SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+    menu_zones[idx].overlay = overlay;
+    menu_zones[idx].rect = rect;
+}
+
+/* Part x,y,w,h of the zone, if it is in src, taken from surface at zone position (from_x, from_y) */
+static int blit_menu_zone_part(SDL_Surface *surface, int from_x, int from_y, int x, int y, int w, int h,
+    const SDL_Rect *src, SDL_Surface *dst, int dst_x, int dst_y){
+    int part_x0 = MAX(x, src->x), part_x1 = MIN(x+w, src->x+src->w);
+    int part_y0 = MAX(y, src->y), part_y1 = MIN(y+h, src->y+src->h);
+    if(part_x0 >= part_x1 || part_y0 >= part_y1){
+        return 0;
+    }
+    SDL_Rect part = {part_x0-from_x, part_y0-from_y, part_x1-part_x0, part_y1-part_y0};
+    SDL_Rect dst_rect = {dst_x + part_x0-src->x, dst_y + part_y0-src->y, 0, 0};
+    return blit_surface_fast(surface, &part, dst, &dst_rect);
+}
+
+/**
+ * Same as blit_surface_fast() from the full zone, composited straight from
+ * the background around the overlay and from the overlay inside it
+ */
+static int blit_menu_zone(int idx, SDL_Rect *src_rect, SDL_Surface *dst, SDL_Rect *dst_rect){
+    if(menu_zone_bg == NULL){
+        return -1;
+    }
+    int w = menu_zone_bg->w, h = menu_zone_bg->h;
+    SDL_Rect src = {0, 0, w, h};
+    if(src_rect){
+        src = *src_rect;
+    }
+    int dst_x = dst_rect?dst_rect->x:0;
+    int dst_y = dst_rect?dst_rect->y:0;
+
+    menu_zone_t *zone = &menu_zones[idx];
+    if(zone->overlay == NULL){
+        return blit_menu_zone_part(menu_zone_bg, 0, 0, 0, 0, w, h, &src, dst, dst_x, dst_y);
+    }
+    SDL_Rect *o = &zone->rect;
+    int res = 0;
+    res |= blit_menu_zone_part(menu_zone_bg, 0, 0, 0, 0, w, o->y, &src, dst, dst_x, dst_y);
+    res |= blit_menu_zone_part(menu_zone_bg, 0, 0, 0, o->y, o->x, o->h, &src, dst, dst_x, dst_y);
+    res |= blit_menu_zone_part(zone->overlay, o->x, o->y, o->x, o->y, o->w, o->h, &src, dst, dst_x, dst_y);
+    res |= blit_menu_zone_part(menu_zone_bg, 0, 0, o->x+o->w, o->y, w-o->x-o->w, o->h, &src, dst, dst_x, dst_y);
+    res |= blit_menu_zone_part(menu_zone_bg, 0, 0, 0, o->y+o->h, w, h-o->y-o->h, &src, dst, dst_x, dst_y);
+    return res;
+}
+
+/* Resident menu memory, and what full zone surfaces would take */
+static void print_menu_memory(){
+#ifdef MENU_PERF
+    size_t surfaces_size = 0, zones_size = 0;
+    SDL_Surface *surfaces[] = {menu_zone_bg, widget_atlas, img_arrow_top, img_arrow_bottom};
+    for(int i = 0; i < (int)(sizeof(surfaces)/sizeof(surfaces[0])); i++){
+        surfaces_size += surfaces[i]?(size_t)surfaces[i]->pitch*surfaces[i]->h:0;
+    }
+    for(int i = 0; i < nb_menu_zones; i++){
+        SDL_Surface *overlay = menu_zones[i].overlay;
+        zones_size += overlay?(size_t)overlay->pitch*overlay->h:0;
+    }
+    size_t full_zones_size = menu_zone_bg?(size_t)nb_menu_zones*menu_zone_bg->pitch*menu_zone_bg->h:0;
+
+    long resident_kb = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if(fp != NULL){
+        long size_pages, resident_pages;
+        if(fscanf(fp, "%ld %ld", &size_pages, &resident_pages) == 2){
+            resident_kb = resident_pages * (sysconf(_SC_PAGESIZE)/1024);
+        }
+        fclose(fp);
+    }
+
+    MENU_PERF_PRINTF("Menu memory: %zu bytes (arena %zu, surfaces %zu, %d zone overlays %zu instead of %zu as full zones) - process resident %ld KB\n",
+        menu_arena_size + surfaces_size + zones_size, menu_arena_size, surfaces_size, nb_menu_zones,
+        zones_size, full_zones_size, resident_kb);
+#endif //MENU_PERF
+}
+
+/// ------ Resource files, in menu_resources_dir ------
+static char menu_resources_dir[MAXPATHLEN - 32] = MENU_RESOURCES_DIR;   /* Leaves room for the file names */
+
+static const char *menu_font_files[NB_MENU_FONT_FILES] = {
+    MENU_FONT_NAME_TITLE, MENU_FONT_NAME_INFO, MENU_FONT_NAME_SMALL_INFO
+};
+static char menu_font_paths[NB_MENU_FONT_FILES][MAXPATHLEN];
+
+static const char *menu_png_files[NB_MENU_PNG_FILES] = {
+    MENU_PNG_BG_NAME, MENU_PNG_ARROW_TOP_NAME, MENU_PNG_ARROW_BOTTOM_NAME
+};
+static char menu_png_paths[NB_MENU_PNG_FILES][MAXPATHLEN];
+
+/**
+ * Load the menu's fonts and images from dir instead of MENU_RESOURCES_DIR (call before init_menu_SDL())
+ */
+void menu_set_resources_dir(const char *dir){
+    snprintf(menu_resources_dir, sizeof(menu_resources_dir), "%s", dir);
+}
+
+/* Full paths are built once, at init */
+static void resolve_menu_resources(){
+    for(int i = 0; i < NB_MENU_FONT_FILES; i++){
+        snprintf(menu_font_paths[i], sizeof(menu_font_paths[i]), "%s/%s", menu_resources_dir, menu_font_files[i]);
+    }
+    for(int i = 0; i < NB_MENU_PNG_FILES; i++){
+        snprintf(menu_png_paths[i], sizeof(menu_png_paths[i]), "%s/%s", menu_resources_dir, menu_png_files[i]);
+    }
+}
+
+/// ------ Resource pinning, see menu_set_pin_resources() ------
+
+#ifdef MENU_PERF
+/* Minor + major page faults of the process so far */
+static long get_page_faults(){
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)){
+        return 0;
+    }
+    return usage.ru_minflt + usage.ru_majflt;
+}
+#endif //MENU_PERF
+
+/* Ask the kernel to read the asset files into the page cache while init gets going */
+static void prefetch_menu_assets(){
+    for(int i = 0; i < NB_MENU_FONT_FILES + NB_MENU_PNG_FILES; i++){
+        const char *path = (i < NB_MENU_FONT_FILES)?menu_font_paths[i]:menu_png_paths[i-NB_MENU_FONT_FILES];
+        int fd = open(path, O_RDONLY);
+        if(fd < 0){
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+/* Fault in every page of a buffer now, and keep it in RAM */
+static size_t pin_memory(void *addr, size_t size){
+    if(addr == NULL || !size || nb_pinned_memory >= MENU_MAX_PINNED){
+        return 0;
+    }
+    long page_size = sysconf(_SC_PAGESIZE);
+    for(size_t offset = 0; offset < size; offset += page_size){
+        volatile uint8_t *page = (volatile uint8_t *)addr + offset;
+        *page = *page;
+    }
+    if(mlock(addr, size)){
+        MENU_ERROR_PRINTF("ERROR in pin_menu_resources: Could not lock %zu bytes: %s\n", size, strerror(errno));
+        return 0;
+    }
+    pinned_memory[nb_pinned_memory].addr = addr;
+    pinned_memory[nb_pinned_memory].size = size;
+    nb_pinned_memory++;
+    return size;
+}
+
+static size_t pin_surface(SDL_Surface *surface){
+    return surface?pin_memory(surface->pixels, (size_t)surface->pitch * surface->h):0;
+}
+
+/* Glyphs are read from the font files lazily, keep them mapped and locked in the page cache */
+static size_t pin_font_file(int idx){
+    for(int i = 0; i < idx; i++){
+        if(!strcmp(menu_font_files[i], menu_font_files[idx])){
+            return 0;
+        }
+    }
+    int fd = open(menu_font_paths[idx], O_RDONLY);
+    if(fd < 0){
+        return 0;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(!fstat(fd, &st) && st.st_size > 0){
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED){
+        return 0;
+    }
+    pinned_fonts[idx] = map;
+    pinned_fonts_size[idx] = st.st_size;
+    if(mlock(map, st.st_size)){
+        MENU_ERROR_PRINTF("ERROR in pin_menu_resources: Could not lock %s: %s\n", menu_font_paths[idx], strerror(errno));
+        return 0;
+    }
+    return st.st_size;
+}
+
+static void pin_menu_resources(){
+    TRACE_SCOPE("init_menu_SDL: pin resources");
+#ifdef MENU_PERF
+    uint64_t start_us = get_time_us();
+    long start_faults = get_page_faults();
+#endif //MENU_PERF
+    size_t nb_bytes = 0;
+
+    nb_bytes += pin_memory(menu_arena, menu_arena_size);
+    nb_bytes += pin_surface(menu_zone_bg);
+    for(int i = 0; i < nb_menu_zones; i++){
+        nb_bytes += pin_surface(menu_zones[i].overlay);
+    }
+    nb_bytes += pin_surface(widget_atlas);
+    nb_bytes += pin_surface(img_arrow_top);
+    nb_bytes += pin_surface(img_arrow_bottom);
+    for(int i = 0; i < NB_MENU_FONT_FILES; i++){
+        nb_bytes += pin_font_file(i);
+    }
+
+    MENU_PERF_PRINTF("Menu resources: %zu bytes pinned in %lluus, %ld page faults\n", nb_bytes,
+        (unsigned long long)(get_time_us()-start_us), get_page_faults()-start_faults);
+}
+
+static void unpin_menu_resources(){
+    for(int i = 0; i < nb_pinned_memory; i++){
+        munlock(pinned_memory[i].addr, pinned_memory[i].size);
+    }
+    nb_pinned_memory = 0;
+    for(int i = 0; i < NB_MENU_FONT_FILES; i++){
+        if(pinned_fonts[i] != NULL){
+            munmap(pinned_fonts[i], pinned_fonts_size[i]);
+            pinned_fonts[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Fault in and lock all menu memory and assets at init (call before init_menu_SDL()),
+ * so the first menu open doesn't wait on page faults or disk reads
+ */
+void menu_set_pin_resources(int enable){
+    pin_resources = enable;
+}
+
+/// ------ Asset loading tasks, run on the thread pool at init ------
+static menu_image_load_t menu_image_loads[] = {
+    /* ARGB8888, so that zones and the widget atlas blend with the blit kernels */
+    {menu_png_paths[0], &menu_zone_bg},
+    {menu_png_paths[1], &img_arrow_top},
+    {menu_png_paths[2], &img_arrow_bottom},
+};
+
+/* A single task: FreeType faces of the same library can't be opened concurrently */
+static void load_menu_fonts_task(void *arg){
+    TRACE_SCOPE("init_menu_SDL: fonts");
+    menu_title_font = TTF_OpenFont(menu_font_paths[0], MENU_FONT_SIZE_TITLE);
+    menu_info_font = TTF_OpenFont(menu_font_paths[1], MENU_FONT_SIZE_INFO);
+    menu_small_info_font = TTF_OpenFont(menu_font_paths[2], MENU_FONT_SIZE_SMALL_INFO);
+}
+
+/* Decoding only creates software surfaces, fine off the main thread */
+static void load_menu_image_task(void *arg){
+    menu_image_load_t *load = (menu_image_load_t*) arg;
+    TRACE_SCOPE("init_menu_SDL: image");
+    *load->surface = convert_to_argb8888(IMG_Load(load->path));
+}
+
+static void load_menu_config_task(void *arg){
+    TRACE_SCOPE("init_menu_SDL: config");
+    configfile_load(cfg_file_rom);
+}
+
 /**
  * Initialise the menu, loading ttf/image assets and pre-rendering all non-dynamic elements
  */
 
 void init_menu_SDL(SDL_Surface* screen){
     MENU_DEBUG_PRINTF("Init Menu\n");
+    TRACE_SCOPE("init_menu_SDL");
 
-    /// ----- Loading the fonts -----
-    menu_title_font = TTF_OpenFont(MENU_FONT_NAME_TITLE, MENU_FONT_SIZE_TITLE);
-    if(!menu_title_font){
-        MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not open menu font %s, %s\n", MENU_FONT_NAME_TITLE, SDL_GetError());
-    }
-    menu_info_font = TTF_OpenFont(MENU_FONT_NAME_INFO, MENU_FONT_SIZE_INFO);
-    if(!menu_info_font){
-        MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not open menu font %s, %s\n", MENU_FONT_NAME_INFO, SDL_GetError());
+    /// ----- Select blit kernels for this CPU -----
+    init_blit_kernels();
+
+    /// ----- Start reading the assets from disk -----
+    resolve_menu_resources();
+    if(pin_resources){
+        prefetch_menu_assets();
     }
-    menu_small_info_font = TTF_OpenFont(MENU_FONT_NAME_SMALL_INFO, MENU_FONT_SIZE_SMALL_INFO);
-    if(!menu_small_info_font){
-        MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not open menu font %s, %s\n", MENU_FONT_NAME_SMALL_INFO, SDL_GetError());
+
+    /// ----- Load fonts, images and persisted settings on the thread pool, all independent -----
+#ifdef MENU_PERF
+    uint64_t assets_start_us = get_time_us();
+#endif //MENU_PERF
+    thread_pool_group_t assets_group = {0};
+    thread_pool_submit(&assets_group, load_menu_fonts_task, NULL);
+    for(int i = 0; i < (int)(sizeof(menu_image_loads)/sizeof(menu_image_loads[0])); i++){
+        thread_pool_submit(&assets_group, load_menu_image_task, &menu_image_loads[i]);
     }
+    thread_pool_submit(&assets_group, load_menu_config_task, NULL);
 
     /// ----- Copy hw_screen at init ------
+    TRACE_BEGIN("init_menu_SDL: screen surfaces");
     hw_screen = screen; /* = vid_getwindow();   CHANGE - Main screen passed in as param, rather than emu-specific global func */
 
-    backup_hw_screen = SDL_CreateRGBSurface(SDL_SWSURFACE,
-        hw_screen->w, hw_screen->h, hw_screen->format->BitsPerPixel, 0, 0, 0, 0);
+    /// ----- Single arena for zone arrays and screen copies, no per-zone realloc or per-frame malloc ------
+    int screen_size = ((hw_screen->w * hw_screen->format->BytesPerPixel + 3) & ~3) * hw_screen->h;
+    menu_arena_size = 2*(screen_size + MENU_ARENA_ALIGN) +
+        NB_MENU_TYPES*(sizeof(int) + sizeof(menu_zone_t)) + 2*MENU_ARENA_ALIGN;
+    menu_arena_used = 0;
+    menu_arena = (uint8_t*) malloc(menu_arena_size);
+    if(menu_arena == NULL){
+        MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not allocate %zu bytes menu arena\n", menu_arena_size);
+    }
+    idx_menus = (int*) menu_arena_alloc(NB_MENU_TYPES*sizeof(int));
+    menu_zones = (menu_zone_t*) menu_arena_alloc(NB_MENU_TYPES*sizeof(menu_zone_t));
+    nb_menu_zones = 0;
+
+    backup_hw_screen = create_menu_arena_surface(hw_screen);
     if(backup_hw_screen == NULL){
         MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not create backup_hw_screen: %s\n", SDL_GetError());
     }
 
-    draw_screen = SDL_CreateRGBSurface(SDL_SWSURFACE,
-        hw_screen->w, hw_screen->h, hw_screen->format->BitsPerPixel, 0, 0, 0, 0);
+    draw_screen = create_menu_arena_surface(hw_screen);
     if(draw_screen == NULL){
         MENU_ERROR_PRINTF("ERROR Could not create draw_screen: %s\n", SDL_GetError());
     }
 
-    /// ------ Load arrows imgs -------
-    img_arrow_top = IMG_Load(MENU_PNG_ARROW_TOP_PATH);
-    if(!img_arrow_top) {
-        MENU_ERROR_PRINTF("ERROR IMG_Load: %s\n", IMG_GetError());
+    TRACE_END("init_menu_SDL: screen surfaces");
+
+    /// ------ Join: zones need the fonts and the zone background (loaded once, zones only keep what they draw on it) ------
+    thread_pool_wait(&assets_group);
+    MENU_PERF_PRINTF("Menu init: assets loaded in %lluus with %d pool threads\n",
+        (unsigned long long)(get_time_us()-assets_start_us), thread_pool_size());
+    if(!menu_title_font || !menu_info_font || !menu_small_info_font){
+        MENU_ERROR_PRINTF("ERROR in init_menu_SDL: Could not open menu fonts %s, %s: %s\n",
+            menu_font_paths[0], menu_font_paths[2], TTF_GetError());
     }
-    img_arrow_bottom = IMG_Load(MENU_PNG_ARROW_BOTTOM_PATH);
-    if(!img_arrow_bottom) {
-        MENU_ERROR_PRINTF("ERROR IMG_Load: %s\n", IMG_GetError());
+    notif_set_font(menu_info_font);
+    for(int i = 0; i < (int)(sizeof(menu_image_loads)/sizeof(menu_image_loads[0])); i++){
+        if(!*menu_image_loads[i].surface){
+            MENU_ERROR_PRINTF("ERROR IMG_Load %s: %s\n", menu_image_loads[i].path, IMG_GetError());
+        }
     }
 
     /// ------ Init menu zones ------
+    TRACE_BEGIN("init_menu_zones");
     init_menu_zones();
+    TRACE_END("init_menu_zones");
+
+    /// ------ Pre-render all widget states ------
+    TRACE_BEGIN("init_menu_widgets");
+    init_menu_widgets();
+    TRACE_END("init_menu_widgets");
+
+    /// ------ Full zones aren't needed anymore ------
+    if(menu_zone_scratch != NULL){
+        SDL_FreeSurface(menu_zone_scratch);
+        menu_zone_scratch = NULL;
+    }
+    menu_zone_scratch_idx = -1;
+    print_menu_memory();
+
+    /// ------ Keep everything the menu touches in RAM ------
+    if(pin_resources){
+        pin_menu_resources();
+    }
 }
 
 void deinit_menu_SDL(){
     MENU_DEBUG_PRINTF("End Menu \n");
 
+    /// ------ Finish writing settings and saves ------
+    configfile_wait();
+    wait_background_save();
+    cancel_load_prefetch();
+    free(load_buf);
+    load_buf = NULL;
+    thread_pool_wait(&menu_notif_group);
+
     /// ------ Close font -------
+    notif_set_font(NULL);
     TTF_CloseFont(menu_title_font);
     TTF_CloseFont(menu_info_font);
     TTF_CloseFont(menu_small_info_font);
 
+    /// ------ Unlock memory before freeing it -------
+    unpin_menu_resources();
+
     /// ------ Free Surfaces -------
     for(int i=0; i < nb_menu_zones; i++){
-        SDL_FreeSurface(menu_zone_surfaces[i]);
+        if(menu_zones[i].overlay != NULL){
+            SDL_FreeSurface(menu_zones[i].overlay);
+        }
+    }
+    if(menu_zone_bg != NULL){
+        SDL_FreeSurface(menu_zone_bg);
+        menu_zone_bg = NULL;
     }
 
     if(backup_hw_screen != NULL){
@@ -201,11 +1022,19 @@ void deinit_menu_SDL(){
     SDL_FreeSurface(img_arrow_top);
     SDL_FreeSurface(img_arrow_bottom);
 
+    if(widget_atlas != NULL){
+        SDL_FreeSurface(widget_atlas);
+        widget_atlas = NULL;
+    }
+
     /// ------ Free Menu memory and reset vars -----
-    if(idx_menus){
-        free(idx_menus);
+    if(menu_arena){
+        free(menu_arena);
     }
+    menu_arena = NULL;
+    menu_arena_size = menu_arena_used = 0;
     idx_menus=NULL;
+    menu_zones=NULL;
     nb_menu_zones = 0;
 }
 
@@ -260,29 +1089,28 @@ void draw_progress_bar(SDL_Surface * surface, uint16_t x, uint16_t y, uint16_t w
 
 
 void add_menu_zone(ENUM_MENU_TYPE menu_type){
-    /// ------ Increase nb of menu zones -------
-    nb_menu_zones++;
+    TRACE_SCOPE("add_menu_zone");
 
-    /// ------ Realoc idx Menus array -------
-    if(!idx_menus){
-        idx_menus = (int*) malloc(nb_menu_zones*sizeof(int));
-        menu_zone_surfaces = (SDL_Surface**) malloc(nb_menu_zones*sizeof(SDL_Surface*));
-    }
-    else{
-        int *temp = (int*) realloc(idx_menus, nb_menu_zones*sizeof(int));
-        idx_menus = temp;
-        menu_zone_surfaces = (SDL_Surface**) realloc(menu_zone_surfaces, nb_menu_zones*sizeof(SDL_Surface*));
+    /// ------ Zone arrays are sized for every menu type in the arena -------
+    if(!idx_menus || !menu_zones || nb_menu_zones >= NB_MENU_TYPES){
+        MENU_ERROR_PRINTF("ERROR in add_menu_zone: No room for menu zone %d\n", menu_type);
+        return;
     }
+
+    /// ------ Increase nb of menu zones -------
+    nb_menu_zones++;
     idx_menus[nb_menu_zones-1] = menu_type;
 
-    /// ------ Reinit menu surface with height increased -------
-    menu_zone_surfaces[nb_menu_zones-1] = IMG_Load(MENU_PNG_BG_PATH);
-    if(!menu_zone_surfaces[nb_menu_zones-1]) {
-        MENU_ERROR_PRINTF("ERROR IMG_Load: %s\n", IMG_GetError());
+    /// ------ Draw the zone on a copy of the background -------
+    menu_zones[nb_menu_zones-1].overlay = NULL;
+    menu_zones[nb_menu_zones-1].rect.w = 0;
+    SDL_Surface *surface = get_menu_zone_scratch(-1);
+    if(surface == NULL){
+        return;
     }
+
     /// --------- Init Common Variables --------
     SDL_Surface *text_surface = NULL;
-    SDL_Surface *surface = menu_zone_surfaces[nb_menu_zones-1];
     SDL_Rect text_pos;
 
     /// --------- Add new zone ---------
@@ -329,6 +1157,14 @@ void add_menu_zone(ENUM_MENU_TYPE menu_type){
         text_pos.y = surface->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 - padding_y_from_center_menu_zone*2;
         SDL_BlitSurface(text_surface, NULL, surface, &text_pos);
         break;
+    case MENU_TYPE_REWIND:
+        MENU_DEBUG_PRINTF("Init MENU_TYPE_REWIND\n");
+        /// ------ Text ------
+        text_surface = TTF_RenderText_Blended(menu_title_font, "REWIND", text_color);
+        text_pos.x = (surface->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
+        text_pos.y = surface->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 - padding_y_from_center_menu_zone*2;
+        SDL_BlitSurface(text_surface, NULL, surface, &text_pos);
+        break;
     case MENU_TYPE_ASPECT_RATIO:
         MENU_DEBUG_PRINTF("Init MENU_TYPE_ASPECT_RATIO\n");
         /// ------ Text ------
@@ -360,6 +1196,9 @@ void add_menu_zone(ENUM_MENU_TYPE menu_type){
 
     /// ------ Free Surfaces -------
     SDL_FreeSurface(text_surface);
+
+    /// ------ Only keep what was drawn ------
+    extract_menu_zone_overlay(nb_menu_zones-1);
 }
 
 void init_menu_zones(){
@@ -371,6 +1210,10 @@ void init_menu_zones(){
     add_menu_zone(MENU_TYPE_SAVE);
     /// Init Load Menu
     add_menu_zone(MENU_TYPE_LOAD);
+    /// Init Rewind Menu, if the app keeps a state history (init_rewind() before init_menu_SDL())
+    if(rewind_running()){
+        add_menu_zone(MENU_TYPE_REWIND);
+    }
     /// Init Aspect Ratio Menu
     add_menu_zone(MENU_TYPE_ASPECT_RATIO);
     /// Init Exit Menu
@@ -379,80 +1222,410 @@ void init_menu_zones(){
     //add_menu_zone(MENU_TYPE_POWERDOWN);
 }
 
+static SDL_Surface* get_menu_zone_surface(ENUM_MENU_TYPE menu_type){
+    for(int i = 0; i < nb_menu_zones; i++){
+        if(idx_menus[i] == menu_type){
+            return get_menu_zone_scratch(i);
+        }
+    }
+    return NULL;
+}
 
-void init_menu_system_values(){
-    FILE *fp;
-    char res[100];
+static void set_text_widget(menu_widget_desc_t *desc, ENUM_MENU_TYPE menu_type, const char *text, int offset_y){
+    desc->menu_type = menu_type;
+    desc->font = menu_info_font;
+    snprintf(desc->text, sizeof(desc->text), "%s", text);
+    desc->offset_y = offset_y;
+}
 
-    /// ------- Get system volume percentage --------
-    fp = popen(SHELL_CMD_VOLUME_GET, "r");
-    if (fp == NULL) {
-        MENU_ERROR_PRINTF("Failed to run command %s\n", SHELL_CMD_VOLUME_GET );
-        volume_percentage = 50; ///wrong value: setting default to 50
+static void set_bar_widget(menu_widget_desc_t *desc, ENUM_MENU_TYPE menu_type, int nb_full_bars, int nb_bars){
+    desc->menu_type = menu_type;
+    desc->font = NULL;
+    desc->nb_bars = nb_bars;
+    desc->percentage = (nb_full_bars*100 + nb_bars-1)/nb_bars;  /* Rounded up so that draw_progress_bar() gets nb_full_bars back */
+}
+
+/**
+ * Same texts and positions as the dynamic rendering these widgets replace
+ */
+static void get_menu_widget_desc(int widget, menu_widget_desc_t *desc){
+    char text_tmp[40];
+
+    if(widget < WIDGET_BRIGHTNESS_BAR){
+        set_bar_widget(desc, MENU_TYPE_VOLUME, widget-WIDGET_VOLUME_BAR, 100/STEP_CHANGE_VOLUME);
+    }
+    else if(widget < WIDGET_SAVE_SLOT){
+        set_bar_widget(desc, MENU_TYPE_BRIGHTNESS, widget-WIDGET_BRIGHTNESS_BAR, 100/STEP_CHANGE_BRIGHTNESS);
+    }
+    else if(widget < WIDGET_SAVE_SAVING){
+        sprintf(text_tmp, "IN SLOT   < %d >", widget-WIDGET_SAVE_SLOT+1);
+        set_text_widget(desc, MENU_TYPE_SAVE, text_tmp, 0);
+    }
+    else if(widget == WIDGET_SAVE_SAVING){
+        set_text_widget(desc, MENU_TYPE_SAVE, "Saving...", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_SAVE_CONFIRM){
+        set_text_widget(desc, MENU_TYPE_SAVE, "Are you sure ?", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_SAVE_STATE){
+        set_text_widget(desc, MENU_TYPE_SAVE, "IDK", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget < WIDGET_LOAD_AUTO_SAVE){
+        sprintf(text_tmp, "FROM SLOT   < %d >", widget-WIDGET_LOAD_SLOT+1);
+        set_text_widget(desc, MENU_TYPE_LOAD, text_tmp, 0);
+    }
+    else if(widget == WIDGET_LOAD_AUTO_SAVE){
+        set_text_widget(desc, MENU_TYPE_LOAD, "FROM AUTO SAVE", 0);
+    }
+    else if(widget == WIDGET_LOAD_LOADING){
+        set_text_widget(desc, MENU_TYPE_LOAD, "Loading...", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_LOAD_CONFIRM){
+        set_text_widget(desc, MENU_TYPE_LOAD, "Are you sure ?", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_LOAD_STATE){
+        set_text_widget(desc, MENU_TYPE_LOAD, "IDK", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_LOAD_AUTO_SAVE_STATE){
+        set_text_widget(desc, MENU_TYPE_LOAD, " ", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget < WIDGET_EXIT_CONFIRM){
+        sprintf(text_tmp, "<   %s   >", aspect_ratio_name[widget-WIDGET_ASPECT_RATIO]);
+        set_text_widget(desc, MENU_TYPE_ASPECT_RATIO, text_tmp, padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_EXIT_CONFIRM){
+        set_text_widget(desc, MENU_TYPE_EXIT, "Are you sure ?", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget == WIDGET_POWERDOWN_CONFIRM){
+        set_text_widget(desc, MENU_TYPE_POWERDOWN, "Are you sure ?", 2*padding_y_from_center_menu_zone);
+    }
+    else if(widget < WIDGET_REWIND_REWINDING){
+        sprintf(text_tmp, "<   %d SEC AGO   >", widget-WIDGET_REWIND_SECONDS+1);
+        set_text_widget(desc, MENU_TYPE_REWIND, text_tmp, 0);
+    }
+    else if(widget == WIDGET_REWIND_REWINDING){
+        set_text_widget(desc, MENU_TYPE_REWIND, "Rewinding...", 2*padding_y_from_center_menu_zone);
     }
     else{
-        fgets(res, sizeof(res)-1, fp);
-    	pclose(fp);
+        set_text_widget(desc, MENU_TYPE_REWIND, "Are you sure ?", 2*padding_y_from_center_menu_zone);
+    }
+}
+
+/**
+ * Pre-render every widget state (progress bar levels, slot/aspect ratio labels,
+ * confirmation texts) over its zone background, packed in a single atlas surface
+ */
+void init_menu_widgets(){
+    menu_widget_desc_t desc;
+    SDL_Surface *zone;
+    int atlas_w = MENU_ZONE_WIDTH, atlas_h = 0;
+    int shelf_x = 0, shelf_h = 0;
+    uint64_t render_us = 0;
+    int nb_rendered = 0;
+
+    /// ------ Measure and pack widgets in shelves (1px margin for draw_progress_bar clamping) ------
+    memset(menu_widgets, 0, sizeof(menu_widgets));
+    for(int i = 0; i < NB_WIDGETS; i++){
+        get_menu_widget_desc(i, &desc);
+        zone = get_menu_zone_surface(desc.menu_type);
+        if(zone == NULL){
+            continue;
+        }
 
-        /// Check if Volume is a number (at least the first char)
-        if(res[0] < '0' || res[0] > '9'){
-            MENU_ERROR_PRINTF("Wrong return value: %s for volume cmd: %s\n",res, SHELL_CMD_VOLUME_GET);
-            volume_percentage = 50; ///wrong value: setting default to 50
+        int w = width_progress_bar, h = height_progress_bar;
+        if(desc.font){
+            if(TTF_SizeText(desc.font, desc.text, &w, &h)){
+                MENU_ERROR_PRINTF("ERROR in init_menu_widgets: Could not size text %s\n", desc.text);
+                continue;
+            }
+            menu_widgets[i].x = (zone->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - w)/2;
+            menu_widgets[i].y = zone->h - MENU_ZONE_HEIGHT/2 - h/2 + desc.offset_y;
         }
         else{
-            volume_percentage = atoi(res);
-            MENU_DEBUG_PRINTF("System volume = %d%%\n", volume_percentage);
+            menu_widgets[i].x = (desc.menu_type == MENU_TYPE_VOLUME)?x_volume_bar:x_brightness_bar;
+            menu_widgets[i].y = (desc.menu_type == MENU_TYPE_VOLUME)?y_volume_bar:y_brightness_bar;
+        }
+        w = MIN(w, atlas_w-1);
+
+        if(shelf_x + w + 1 > atlas_w){
+            atlas_h += shelf_h;
+            shelf_x = 0;
+            shelf_h = 0;
         }
+        menu_widgets[i].src.x = shelf_x;
+        menu_widgets[i].src.y = atlas_h;
+        menu_widgets[i].src.w = w;
+        menu_widgets[i].src.h = h;
+        shelf_x += w + 1;
+        shelf_h = MAX(shelf_h, h + 1);
     }
+    atlas_h += shelf_h;
 
-    /// ------- Get system brightness percentage -------
-    fp = popen(SHELL_CMD_BRIGHTNESS_GET, "r");
-    if (fp == NULL) {
-        MENU_ERROR_PRINTF("Failed to run command %s\n", SHELL_CMD_BRIGHTNESS_GET );
-        brightness_percentage = 50; ///wrong value: setting default to 50
+    /// ------ Create atlas in the zones' format, so widgets keep the zone alpha ------
+    zone = nb_menu_zones?menu_zone_bg:NULL;
+    if(zone == NULL || !atlas_h){
+        MENU_ERROR_PRINTF("ERROR in init_menu_widgets: No zones to render widgets on\n");
+        return;
+    }
+    widget_atlas = SDL_CreateRGBSurface(SDL_SWSURFACE, atlas_w, atlas_h, zone->format->BitsPerPixel,
+        zone->format->Rmask, zone->format->Gmask, zone->format->Bmask, zone->format->Amask);
+    if(widget_atlas == NULL){
+        MENU_ERROR_PRINTF("ERROR in init_menu_widgets: Could not create widget atlas: %s\n", SDL_GetError());
+        return;
     }
-    else{
-        fgets(res, sizeof(res)-1, fp);
-    	pclose(fp);
 
-        /// Check if brightness is a number (at least the first char)
-        if(res[0] < '0' || res[0] > '9'){
-            MENU_ERROR_PRINTF("Wrong return value: %s for volume cmd: %s\n",res, SHELL_CMD_BRIGHTNESS_GET);
-            brightness_percentage = 50; ///wrong value: setting default to 50
+    /// ------ Render widgets ------
+    for(int i = 0; i < NB_WIDGETS; i++){
+        SDL_Rect cell = menu_widgets[i].src;
+        if(!cell.w){
+            continue;
+        }
+        uint64_t start_us = get_time_us();
+        get_menu_widget_desc(i, &desc);
+        zone = get_menu_zone_surface(desc.menu_type);
+
+        /// Copy zone background as is, alpha included
+        Uint32 zone_alpha_flags = zone->flags & SDL_SRCALPHA;
+        SDL_Rect zone_rect = {menu_widgets[i].x, menu_widgets[i].y, cell.w, cell.h};
+        SDL_SetAlpha(zone, 0, SDL_ALPHA_OPAQUE);
+        SDL_BlitSurface(zone, &zone_rect, widget_atlas, &cell);
+        SDL_SetAlpha(zone, zone_alpha_flags, SDL_ALPHA_OPAQUE);
+
+        if(desc.font){
+            SDL_Surface *text_surface = TTF_RenderText_Blended(desc.font, desc.text, text_color);
+            if(text_surface){
+                SDL_SetClipRect(widget_atlas, &cell);
+                SDL_BlitSurface(text_surface, NULL, widget_atlas, &cell);
+                SDL_SetClipRect(widget_atlas, NULL);
+                SDL_FreeSurface(text_surface);
+            }
         }
         else{
-            brightness_percentage = atoi(res);
-            MENU_DEBUG_PRINTF("System brightness = %d%%\n", brightness_percentage);
+            draw_progress_bar(widget_atlas, cell.x, cell.y, cell.w, cell.h, desc.percentage, desc.nb_bars);
+        }
+        render_us += get_time_us() - start_us;
+        nb_rendered++;
+    }
+    SDL_SetAlpha(widget_atlas, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+
+#ifdef MENU_PERF
+    /// ------ Atlas memory vs per-frame cost of dynamic rendering ------
+    uint64_t blit_start_us = get_time_us();
+    for(int i = 0; i < NB_WIDGETS; i++){
+        if(menu_widgets[i].src.w){
+            SDL_Rect dst = {menu_widgets[i].x, menu_widgets[i].y, 0, 0};
+            blit_surface_fast(widget_atlas, &menu_widgets[i].src, draw_screen, &dst);
         }
     }
+    uint64_t blit_us = get_time_us() - blit_start_us;
+    MENU_PERF_PRINTF("Widget atlas: %d widgets, %dx%d, %d bytes - rendering %lluus/widget, atlas blit %lluus/widget\n",
+        nb_rendered, atlas_w, atlas_h, widget_atlas->pitch*widget_atlas->h,
+        (unsigned long long)(nb_rendered?render_us/nb_rendered:0), (unsigned long long)(nb_rendered?blit_us/nb_rendered:0));
+#endif //MENU_PERF
+}
 
-    /// ------ Save prev key repeat params and set new Key repeat -------
-    SDL_GetKeyRepeat(&backup_key_repeat_delay, &backup_key_repeat_interval);
-    if(SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL)){
-        MENU_ERROR_PRINTF("ERROR with SDL_EnableKeyRepeat: %s\n", SDL_GetError());
+static void blit_menu_widget(int widget){
+    if(widget_atlas == NULL || !menu_widgets[widget].src.w){
+        return;
+    }
+    SDL_Rect dst = {menu_widgets[widget].x, menu_widgets[widget].y, 0, 0};
+    if(blit_surface_fast(widget_atlas, &menu_widgets[widget].src, draw_screen, &dst)){
+        MENU_ERROR_PRINTF("ERROR Could not Blit widget %d on draw_screen: %s\n", widget, SDL_GetError());
     }
+}
 
-    /// Get save slot from game
-    saveslot = (saveslot%MAX_SAVE_SLOTS); // security
+/* Progress bar widget index, same number of full bars as draw_progress_bar() */
+static int get_bar_widget_level(int percentage, int nb_bars){
+    percentage = (percentage > 100)?100:((percentage < 0)?0:percentage);
+    return nb_bars*percentage/100;
 }
 
-void menu_screen_refresh(int menuItem, int prevItem, int scroll, uint8_t menu_confirmation, uint8_t menu_action){
-    /// --------- Vars ---------
-    int print_arrows = (scroll==0)?1:0;
+
+/**
+ * Get a percentage from a shell command (volume or brightness), 50 if it can't be read
+ */
+static int get_system_percentage(const char *shell_cmd){
+    FILE *fp;
+    char res[100] = {0};
+    int percentage = 50;
+    TRACE_SCOPE(shell_cmd);
+
+    fp = popen(shell_cmd, "r");
+    if (fp == NULL) {
+        MENU_ERROR_PRINTF("Failed to run command %s\n", shell_cmd);
+        return percentage; ///wrong value: setting default to 50
+    }
+    fgets(res, sizeof(res)-1, fp);
+    pclose(fp);
+
+    /// Check if value is a number (at least the first char)
+    if(res[0] < '0' || res[0] > '9'){
+        MENU_ERROR_PRINTF("Wrong return value: %s for cmd: %s\n", res, shell_cmd);
+    }
+    else{
+        percentage = atoi(res);
+        MENU_DEBUG_PRINTF("%s = %d%%\n", shell_cmd, percentage);
+    }
+    return percentage;
+}
+
+static void init_menu_key_repeat(){
+    /// ------ Save prev key repeat params and set new Key repeat -------
+    SDL_GetKeyRepeat(&backup_key_repeat_delay, &backup_key_repeat_interval);
+    if(SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL)){
+        MENU_ERROR_PRINTF("ERROR with SDL_EnableKeyRepeat: %s\n", SDL_GetError());
+    }
+}
+
+void init_menu_system_values(){
+    /// ------- Get system volume and brightness percentages --------
+    volume_percentage = get_system_percentage(SHELL_CMD_VOLUME_GET);
+    brightness_percentage = get_system_percentage(SHELL_CMD_BRIGHTNESS_GET);
+
+    init_menu_key_repeat();
+
+    /// Get save slot from game
+    saveslot = (saveslot%MAX_SAVE_SLOTS); // security
+}
+
+static void run_menu_task(void *data){
+    ENUM_MENU_TASK task = (ENUM_MENU_TASK)(intptr_t)data;
+#ifdef MENU_PERF
+    uint64_t start_us = get_time_us();
+#endif //MENU_PERF
+
+    switch(task){
+    case MENU_TASK_KEYMAP_DEFAULT:
+        TRACE_BEGIN(SHELL_CMD_KEYMAP_DEFAULT);
+        system(SHELL_CMD_KEYMAP_DEFAULT);
+        TRACE_END(SHELL_CMD_KEYMAP_DEFAULT);
+        break;
+    case MENU_TASK_AUDIO_AMP_OFF:
+        TRACE_BEGIN(SHELL_CMD_AUDIO_AMP_OFF);
+        system(SHELL_CMD_AUDIO_AMP_OFF);
+        TRACE_END(SHELL_CMD_AUDIO_AMP_OFF);
+        break;
+    case MENU_TASK_VOLUME_GET:
+        menu_task_results[task] = get_system_percentage(SHELL_CMD_VOLUME_GET);
+        break;
+    case MENU_TASK_BRIGHTNESS_GET:
+        menu_task_results[task] = get_system_percentage(SHELL_CMD_BRIGHTNESS_GET);
+        break;
+    default:
+        break;
+    }
+
+    MENU_PERF_PRINTF("Menu task %d done in %lluus\n", task, (unsigned long long)(get_time_us()-start_us));
+    __atomic_or_fetch(&menu_tasks_done, 1<<task, __ATOMIC_RELEASE);
+}
+
+/**
+ * Launch the menu opening side effects concurrently, results are picked up by run_menu_loop()
+ */
+static void start_menu_tasks(){
+    __atomic_store_n(&menu_tasks_done, 0, __ATOMIC_RELEASE);
+    for(int i = 0; i < NB_MENU_TASKS; i++){
+        thread_pool_submit(&menu_task_group, run_menu_task, (void*)(intptr_t)i);
+    }
+}
+
+static void wait_menu_tasks(){
+    thread_pool_wait(&menu_task_group);
+}
+
+static void write_system_value(ENUM_SYSTEM_VALUE system_value, int value){
+    char shell_cmd[100];
+    const char *shell_cmd_set = (system_value == SYSTEM_VALUE_VOLUME)?
+        SHELL_CMD_VOLUME_SET:SHELL_CMD_BRIGHTNESS_SET;
+    TRACE_SCOPE(shell_cmd_set);
+
+    sprintf(shell_cmd, "%s %d", shell_cmd_set, value);
+    system(shell_cmd);
+    nb_system_value_writes[system_value]++;
+}
+
+/* Pool task, writes the latest requested values until none is left, intermediate ones are dropped */
+static void run_system_value_setter(void *arg){
+    int pending;
+    do{
+        for(int i = 0; i < NB_SYSTEM_VALUES; i++){
+            int value = __atomic_exchange_n(&pending_system_values[i], -1, __ATOMIC_ACQ_REL);
+            if(value >= 0){
+                write_system_value(i, value);
+            }
+        }
+        __atomic_store_n(&system_value_setter_busy, 0, __ATOMIC_RELEASE);
+
+        /// ------ A value requested before busy was cleared has no task for it yet, take it unless another task did ------
+        pending = 0;
+        for(int i = 0; i < NB_SYSTEM_VALUES; i++){
+            pending |= (__atomic_load_n(&pending_system_values[i], __ATOMIC_ACQUIRE) >= 0);
+        }
+    } while(pending && !__atomic_exchange_n(&system_value_setter_busy, 1, __ATOMIC_ACQ_REL));
+}
+
+static void start_system_value_setter(){
+    for(int i = 0; i < NB_SYSTEM_VALUES; i++){
+        pending_system_values[i] = -1;
+        nb_system_value_requests[i] = 0;
+        nb_system_value_writes[i] = 0;
+    }
+}
+
+/**
+ * Wait for the setter once all pending values are written
+ */
+static void stop_system_value_setter(){
+    thread_pool_wait(&system_value_group);
+
+#if defined(MENU_DEBUG) || defined(MENU_PERF)
+    printf("Volume: %u changes, %u hardware writes - Brightness: %u changes, %u hardware writes\n",
+        nb_system_value_requests[SYSTEM_VALUE_VOLUME], nb_system_value_writes[SYSTEM_VALUE_VOLUME],
+        nb_system_value_requests[SYSTEM_VALUE_BRIGHTNESS], nb_system_value_writes[SYSTEM_VALUE_BRIGHTNESS]);
+#endif
+}
+
+/**
+ * Request a hardware volume/brightness change without waiting for the shell command
+ * The write runs on the thread pool, inline if it has no threads
+ */
+static void set_system_value(ENUM_SYSTEM_VALUE system_value, int value){
+    nb_system_value_requests[system_value]++;
+    __atomic_store_n(&pending_system_values[system_value], value, __ATOMIC_RELEASE);
+    if(!__atomic_exchange_n(&system_value_setter_busy, 1, __ATOMIC_ACQ_REL)){
+        thread_pool_submit(&system_value_group, run_system_value_setter, NULL);
+    }
+}
+
+/**
+ * Let the menu snapshot the app's last frame from this software surface,
+ * instead of reading back the (video memory) screen. NULL to reset.
+ */
+void menu_set_app_frame(SDL_Surface* frame){
+    app_frame = frame;
+}
+
+void menu_screen_refresh(int menuItem, int prevItem, int scroll, uint8_t menu_confirmation, uint8_t menu_action){
+    /// --------- Vars ---------
+    int print_arrows = (scroll==0)?1:0;
+    TRACE_SCOPE("menu_screen_refresh");
 
     /// --------- Clear HW screen ----------
-    if(SDL_BlitSurface(backup_hw_screen, NULL, draw_screen, NULL)){
+    TRACE_BEGIN("menu_screen_refresh: clear");
+    if(blit_surface_fast(backup_hw_screen, NULL, draw_screen, NULL)){
         MENU_ERROR_PRINTF("ERROR Could not Clear draw_screen: %s\n", SDL_GetError());
     }
+    TRACE_END("menu_screen_refresh: clear");
     /// --------- Setup Blit Window ----------
     SDL_Rect menu_blit_window;
     menu_blit_window.x = 0;
     menu_blit_window.w = SCREEN_HORIZONTAL_SIZE;
 
     /// --------- Blit prev menu Zone going away ----------
+    TRACE_BEGIN("menu_screen_refresh: zones");
     menu_blit_window.y = scroll;
     menu_blit_window.h = SCREEN_VERTICAL_SIZE;
-    if(SDL_BlitSurface(menu_zone_surfaces[prevItem], &menu_blit_window, draw_screen, NULL)){
+    if(blit_menu_zone(prevItem, &menu_blit_window, draw_screen, NULL)){
         MENU_ERROR_PRINTF("ERROR Could not Blit surface on draw_screen: %s\n", SDL_GetError());
     }
 
@@ -460,537 +1633,710 @@ void menu_screen_refresh(int menuItem, int prevItem, int scroll, uint8_t menu_co
     if(scroll>0){
         menu_blit_window.y = SCREEN_VERTICAL_SIZE-scroll;
         menu_blit_window.h = SCREEN_VERTICAL_SIZE;
-        if(SDL_BlitSurface(menu_zone_surfaces[menuItem], NULL, draw_screen, &menu_blit_window)){
+        if(blit_menu_zone(menuItem, NULL, draw_screen, &menu_blit_window)){
             MENU_ERROR_PRINTF("ERROR Could not Blit surface on draw_screen: %s\n", SDL_GetError());
         }
     }
     else if(scroll<0){
         menu_blit_window.y = SCREEN_VERTICAL_SIZE+scroll;
         menu_blit_window.h = SCREEN_VERTICAL_SIZE;
-        if(SDL_BlitSurface(menu_zone_surfaces[menuItem], &menu_blit_window, draw_screen, NULL)){
+        if(blit_menu_zone(menuItem, &menu_blit_window, draw_screen, NULL)){
             MENU_ERROR_PRINTF("ERROR Could not Blit surface on draw_screen: %s\n", SDL_GetError());
         }
     }
-    /// --------- No Scroll ? Blitting menu-specific info
+    /// --------- No Scroll ? Blitting menu-specific info from the widget atlas
     else{
-        SDL_Surface * text_surface = NULL;
-        char text_tmp[40];
-        SDL_Rect text_pos;
-        char fname[MAXPATHLEN];
-        memset(fname, 0, MAXPATHLEN);
-
+        TRACE_SCOPE("menu_screen_refresh: widgets");
         switch(idx_menus[menuItem]){
         case MENU_TYPE_VOLUME:
-            draw_progress_bar(draw_screen, x_volume_bar, y_volume_bar,
-                            width_progress_bar, height_progress_bar, volume_percentage, 100/STEP_CHANGE_VOLUME);
+            if(system_values_known & (1<<MENU_TASK_VOLUME_GET)){
+                blit_menu_widget(WIDGET_VOLUME_BAR +
+                    get_bar_widget_level(volume_percentage, 100/STEP_CHANGE_VOLUME));
+            }
             break;
 
         case MENU_TYPE_BRIGHTNESS:
-            draw_progress_bar(draw_screen, x_volume_bar, y_volume_bar,
-                            width_progress_bar, height_progress_bar, brightness_percentage, 100/STEP_CHANGE_BRIGHTNESS);
+            if(system_values_known & (1<<MENU_TASK_BRIGHTNESS_GET)){
+                blit_menu_widget(WIDGET_BRIGHTNESS_BAR +
+                    get_bar_widget_level(brightness_percentage, 100/STEP_CHANGE_BRIGHTNESS));
+            }
             break;
 
         case MENU_TYPE_SAVE:
             /// ---- Write slot -----
-            sprintf(text_tmp, "IN SLOT   < %d >", saveslot+1);
-            text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-            text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-            text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2;
-            SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
+            blit_menu_widget(WIDGET_SAVE_SLOT + saveslot);
 
             if(menu_action){
-                sprintf(text_tmp, "Saving...");
-                text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
+                blit_menu_widget(WIDGET_SAVE_SAVING);
+            }
+            else if(menu_confirmation){
+                blit_menu_widget(WIDGET_SAVE_CONFIRM);
             }
             else{
-                if(menu_confirmation){
-                    sprintf(text_tmp, "Are you sure ?");
-                    text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-                }
-                else{
-                    /// ---- Write current Save state ----
-            //      if(check_savefile(-1, fname)){
-            //          printf("Found Save slot: %s\n", fname);
-            //          char *p = strrchr (fname, '/');
-            //          char *basename = p ? p + 1 : (char *) fname;
-            //          char file_name_short[24];
-            //          snprintf(file_name_short, 24, "%s", basename);
-            //          text_surface = TTF_RenderText_Blended(menu_small_info_font, file_name_short, text_color);
-            //      }
-            //      else{
-            //          text_surface = TTF_RenderText_Blended(menu_info_font, "Free", text_color);
-            //      }
-                    text_surface = TTF_RenderText_Blended(menu_info_font, "IDK", text_color);
-                }
+                /// ---- Write current Save state ----
+        //      if(check_savefile(-1, fname)){
+        //          printf("Found Save slot: %s\n", fname);
+        //          char *p = strrchr (fname, '/');
+        //          char *basename = p ? p + 1 : (char *) fname;
+        //          char file_name_short[24];
+        //          snprintf(file_name_short, 24, "%s", basename);
+        //          text_surface = TTF_RenderText_Blended(menu_small_info_font, file_name_short, text_color);
+        //      }
+        //      else{
+        //          text_surface = TTF_RenderText_Blended(menu_info_font, "Free", text_color);
+        //      }
+                blit_menu_widget(WIDGET_SAVE_STATE);
             }
-            text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-            text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 + 2*padding_y_from_center_menu_zone;
-            SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
             break;
 
         case MENU_TYPE_LOAD:
             /// ---- Write slot -----
             if(quick_load_slot_chosen){
-                sprintf(text_tmp, "FROM AUTO SAVE");
+                blit_menu_widget(WIDGET_LOAD_AUTO_SAVE);
             }
             else{
-                sprintf(text_tmp, "FROM SLOT   < %d >", saveslot+1);
+                blit_menu_widget(WIDGET_LOAD_SLOT + saveslot);
             }
-            text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-            text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-            text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2;
-            SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
 
             if(menu_action){
-                sprintf(text_tmp, "Loading...");
-                text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
+                blit_menu_widget(WIDGET_LOAD_LOADING);
+            }
+            else if(menu_confirmation){
+                blit_menu_widget(WIDGET_LOAD_CONFIRM);
+            }
+            else if(quick_load_slot_chosen){
+                blit_menu_widget(WIDGET_LOAD_AUTO_SAVE_STATE);
             }
             else{
-                if(menu_confirmation){
-                    sprintf(text_tmp, "Are you sure ?");
-                    text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-                }
-                else{
-                    if(quick_load_slot_chosen){
-                        text_surface = TTF_RenderText_Blended(menu_info_font, " ", text_color);
-                    }
-                    else{
-                        /// ---- Write current Load state ----
-                //      if(check_savefile(-1, fname)){
-                //          printf("Found Load slot: %s\n", fname);
-                //          char *p = strrchr (fname, '/');
-                //          char *basename = p ? p + 1 : (char *) fname;
-                //          char file_name_short[24];
-                //          snprintf(file_name_short, 24, "%s", basename);
-                //          text_surface = TTF_RenderText_Blended(menu_small_info_font, file_name_short, text_color);
-                //      }
-                //      else{
-                //          text_surface = TTF_RenderText_Blended(menu_info_font, "Free", text_color);
-                //      }
-                        text_surface = TTF_RenderText_Blended(menu_info_font, "IDK", text_color);
-                    }
-                }
+                /// ---- Write current Load state ----
+        //      if(check_savefile(-1, fname)){
+        //          printf("Found Load slot: %s\n", fname);
+        //          char *p = strrchr (fname, '/');
+        //          char *basename = p ? p + 1 : (char *) fname;
+        //          char file_name_short[24];
+        //          snprintf(file_name_short, 24, "%s", basename);
+        //          text_surface = TTF_RenderText_Blended(menu_small_info_font, file_name_short, text_color);
+        //      }
+        //      else{
+        //          text_surface = TTF_RenderText_Blended(menu_info_font, "Free", text_color);
+        //      }
+                blit_menu_widget(WIDGET_LOAD_STATE);
+            }
+            break;
+
+        case MENU_TYPE_REWIND:
+            blit_menu_widget(WIDGET_REWIND_SECONDS + rewind_seconds-1);
+
+            if(menu_action){
+                blit_menu_widget(WIDGET_REWIND_REWINDING);
+            }
+            else if(menu_confirmation){
+                blit_menu_widget(WIDGET_REWIND_CONFIRM);
             }
-            text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-            text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 + 2*padding_y_from_center_menu_zone;
-            SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
             break;
 
         case MENU_TYPE_ASPECT_RATIO:
-            sprintf(text_tmp, "<   %s   >", aspect_ratio_name[aspect_ratio]);
-            text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-            text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-            text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 + padding_y_from_center_menu_zone;
-            SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
+            blit_menu_widget(WIDGET_ASPECT_RATIO + aspect_ratio);
             break;
 
         case MENU_TYPE_EXIT:
+            if(menu_confirmation){
+                blit_menu_widget(WIDGET_EXIT_CONFIRM);
+            }
+            break;
+
         case MENU_TYPE_POWERDOWN:
             if(menu_confirmation){
-                sprintf(text_tmp, "Are you sure ?");
-                text_surface = TTF_RenderText_Blended(menu_info_font, text_tmp, text_color);
-                text_pos.x = (draw_screen->w - MENU_ZONE_WIDTH)/2 + (MENU_ZONE_WIDTH - text_surface->w)/2;
-                text_pos.y = draw_screen->h - MENU_ZONE_HEIGHT/2 - text_surface->h/2 + 2*padding_y_from_center_menu_zone;
-                SDL_BlitSurface(text_surface, NULL, draw_screen, &text_pos);
+                blit_menu_widget(WIDGET_POWERDOWN_CONFIRM);
             }
             break;
+
         default:
             break;
         }
-
-        /// ------ Free Surfaces -------
-        if(text_surface)
-             SDL_FreeSurface(text_surface);
     }
 
+    TRACE_END("menu_screen_refresh: zones");
+
     /// --------- Print arrows --------
     if(print_arrows){
+        TRACE_SCOPE("menu_screen_refresh: arrows");
         /// Top arrow
         SDL_Rect pos_arrow_top;
         pos_arrow_top.x = (draw_screen->w - img_arrow_top->w)/2;
         pos_arrow_top.y = (draw_screen->h - MENU_BG_SQUARE_HEIGHT)/4 - img_arrow_top->h/2;
-        SDL_BlitSurface(img_arrow_top, NULL, draw_screen, &pos_arrow_top);
+        blit_surface_fast(img_arrow_top, NULL, draw_screen, &pos_arrow_top);
 
         /// Bottom arrow
         SDL_Rect pos_arrow_bottom;
         pos_arrow_bottom.x = (draw_screen->w - img_arrow_bottom->w)/2;
         pos_arrow_bottom.y = draw_screen->h -
             (draw_screen->h - MENU_BG_SQUARE_HEIGHT)/4 - img_arrow_bottom->h/2;
-        SDL_BlitSurface(img_arrow_bottom, NULL, draw_screen, &pos_arrow_bottom);
+        blit_surface_fast(img_arrow_bottom, NULL, draw_screen, &pos_arrow_bottom);
     }
 
-    /// ---- Fast blit ----
-    memcpy(hw_screen->pixels, draw_screen->pixels, hw_screen->h * hw_screen->w * hw_screen->format->BytesPerPixel);
+    /// ---- Fast blit (into a free buffer if the present thread is running) ----
+    TRACE_BEGIN("menu_screen_refresh: copy");
+    SDL_Surface *present_surface = present_begin_frame(hw_screen);
+    memcpy(present_surface->pixels, draw_screen->pixels, hw_screen->h * hw_screen->w * hw_screen->format->BytesPerPixel);
+    TRACE_END("menu_screen_refresh: copy");
 
     /// --------- Flip Screen ----------
-    SDL_Flip(hw_screen); /* vid_flip(); */
+    present_end_frame(hw_screen); /* vid_flip(); */
 }
 
 
 void run_menu_loop()
 {
     MENU_DEBUG_PRINTF("Launch Menu\n");
+    TRACE_SCOPE("run_menu_loop");
 
     SDL_Event event;
     uint32_t prev_ms = SDL_GetTicks();
     uint32_t cur_ms = SDL_GetTicks();
     int scroll=0;
-    int start_scroll=0;
+    int scroll_dir=0;                                           /* Direction of the running transition, 0 if none */
+    int queued_scroll=0;                                        /* Zones to move once the transition ends, sign is the direction */
+    uint64_t scroll_start_us=0;
+    uint64_t last_nav_press_us=0;
     uint8_t screen_refresh = 1;
-    char shell_cmd[100];
+    char notif_text[NOTIF_MAX_LEN];
     uint8_t menu_confirmation = 0;
     stop_menu_loop = 0;
     char fname[MAXPATHLEN];
-
-    /// ------ Load default keymap ------
-    system(SHELL_CMD_KEYMAP_DEFAULT);
-
-    /// ------ Get init values -------
-    init_menu_system_values();
-    int prevItem=menuItem;
-
-    /// ------ Copy currently displayed screen -------
-    if(SDL_BlitSurface(hw_screen, NULL, backup_hw_screen, NULL)){
+#ifdef MENU_PERF
+    uint64_t menu_open_us = get_time_us();
+    long menu_open_faults = get_page_faults();
+#endif //MENU_PERF
+    int tasks_applied = 0;
+    memset(&menu_stats, 0, sizeof(menu_stats));
+    menu_stats.open_zone = idx_menus[menuItem];
+
+    /// ------ Copy currently displayed screen, from RAM if the app or present path provide it -------
+    TRACE_BEGIN("run_menu_loop: screen copy");
+    SDL_Surface *snapshot_src = app_frame?app_frame:present_last_frame(hw_screen);
+#ifdef MENU_PERF
+    uint64_t snapshot_start_us = get_time_us();
+#endif //MENU_PERF
+    if(SDL_BlitSurface(snapshot_src, NULL, backup_hw_screen, NULL)){
         MENU_ERROR_PRINTF("ERROR Could not copy hw_screen: %s\n", SDL_GetError());
     }
+    MENU_PERF_PRINTF("Menu open: screen snapshot from %s in %lluus\n",
+        (snapshot_src == hw_screen)?"hw_screen":((snapshot_src == app_frame)?"app frame":"present buffer"),
+        (unsigned long long)(get_time_us()-snapshot_start_us));
+    TRACE_END("run_menu_loop: screen copy");
 
-    /* Stop Ampli */
-    system(SHELL_CMD_AUDIO_AMP_OFF);
+    /// ------ Draw first frame from pre-rendered zones, with last known values -------
+    init_menu_key_repeat();
+    saveslot = (saveslot%MAX_SAVE_SLOTS); // security
+    int prevItem=menuItem;
+    menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 0);
+    screen_refresh = 0;
+    TRACE_INSTANT("run_menu_loop: first frame");
+    nb_menu_opens++;
+    MENU_PERF_PRINTF("Menu open #%d (%s, resources %s): key pressed to first menu frame flipped in %lluus, %ld page faults\n",
+        nb_menu_opens, (nb_menu_opens == 1)?"cold":"warm", nb_pinned_memory?"pinned":"not pinned",
+        (unsigned long long)(get_time_us()-menu_open_us), get_page_faults()-menu_open_faults);
+
+    /// ------ Load default keymap, stop ampli and get init values, all concurrently -------
+    start_menu_tasks();
+    start_system_value_setter();
 
     /// -------- Main loop ---------
     while (!stop_menu_loop)
     {
-        /// -------- Handle Keyboard Events ---------
-        if(!scroll){
-            while (SDL_PollEvent(&event))
-            switch(event.type)
+        /// -------- Apply system values as their queries complete ---------
+        int tasks_done = __atomic_load_n(&menu_tasks_done, __ATOMIC_ACQUIRE) & ~tasks_applied;
+        /* LEFT/RIGHT are ignored on these zones until then, so no change is made from a stale value */
+        if(tasks_done & (1<<MENU_TASK_VOLUME_GET)){
+            volume_percentage = menu_task_results[MENU_TASK_VOLUME_GET];
+            screen_refresh = 1;
+        }
+        if(tasks_done & (1<<MENU_TASK_BRIGHTNESS_GET)){
+            brightness_percentage = menu_task_results[MENU_TASK_BRIGHTNESS_GET];
+            screen_refresh = 1;
+        }
+        tasks_applied |= tasks_done;
+        system_values_known |= tasks_done;
+
+        /// -------- Handle Keyboard Events, also during scroll animations ---------
+        trace_poll();
+        TRACE_BEGIN("run_menu_loop: events");
+        while (SDL_PollEvent(&event))
+        switch(event.type)
+        {
+            case SDL_QUIT:
+                exit(0);
+                stop_menu_loop = 1;
+        break;
+        case SDL_KEYDOWN:
+            switch (event.key.keysym.sym)
             {
-                case SDL_QUIT:
-                    exit(0);
-                    stop_menu_loop = 1;
-            break;
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.sym)
-                {
-                    case SDLK_b:
-                        if(menu_confirmation){
-                            /// ------ Reset menu confirmation ------
-                            menu_confirmation = 0;
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
-                        }
-                        /*else{
-                            stop_menu_loop = 1;
-                        }*/
-                        break;
-
-                    case SDLK_q:
-                    case SDLK_ESCAPE:
+                case SDLK_b:
+                    if(menu_confirmation){
+                        /// ------ Reset menu confirmation ------
+                        menu_confirmation = 0;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    /*else{
                         stop_menu_loop = 1;
-                        break;
+                    }*/
+                    break;
+
+                case SDLK_q:
+                case SDLK_ESCAPE:
+                    stop_menu_loop = 1;
+                    break;
 
-                    case SDLK_d:
-                    case SDLK_DOWN:
-                        MENU_DEBUG_PRINTF("DOWN\n");
+                case SDLK_d:
+                case SDLK_DOWN:
+                    MENU_DEBUG_PRINTF("DOWN\n");
 
-                        /// ------ Start scrolling to new menu -------
+                    /// ------ Start scrolling to new menu, or queue it after the running one -------
+                    last_nav_press_us = get_time_us();
+                    if(scroll_dir){
+                        queued_scroll++;
+                    }
+                    else{
+                        prevItem=menuItem;
                         menuItem++;
                         if (menuItem>=nb_menu_zones) menuItem=0;
-                        start_scroll=1;
+                        scroll_dir=1;
+                        scroll_start_us = last_nav_press_us;
+                        menu_stats.nb_transitions++;
+                    }
 
-                        /// ------ Reset menu confirmation ------
-                        menu_confirmation = 0;
+                    /// ------ Reset menu confirmation ------
+                    menu_confirmation = 0;
 
-                        /// ------ Refresh screen ------
-                        screen_refresh = 1;
-                        break;
+                    /// ------ Refresh screen ------
+                    screen_refresh = 1;
+                    break;
 
-                    case SDLK_u:
-                    case SDLK_UP:
-                        MENU_DEBUG_PRINTF("UP\n");
+                case SDLK_u:
+                case SDLK_UP:
+                    MENU_DEBUG_PRINTF("UP\n");
 
-                        /// ------ Start scrolling to new menu -------
+                    /// ------ Start scrolling to new menu, or queue it after the running one -------
+                    last_nav_press_us = get_time_us();
+                    if(scroll_dir){
+                        queued_scroll--;
+                    }
+                    else{
+                        prevItem=menuItem;
                         menuItem--;
                         if (menuItem<0) menuItem=nb_menu_zones-1;
-                        start_scroll=-1;
+                        scroll_dir=-1;
+                        scroll_start_us = last_nav_press_us;
+                        menu_stats.nb_transitions++;
+                    }
 
-                        /// ------ Reset menu confirmation ------
-                        menu_confirmation = 0;
+                    /// ------ Reset menu confirmation ------
+                    menu_confirmation = 0;
 
-                        /// ------ Refresh screen ------
-                        screen_refresh = 1;
-                        break;
+                    /// ------ Refresh screen ------
+                    screen_refresh = 1;
+                    break;
 
-                    case SDLK_l:
-                    case SDLK_LEFT:
-                        //MENU_DEBUG_PRINTF("LEFT\n");
-                        if(idx_menus[menuItem] == MENU_TYPE_VOLUME){
-                            MENU_DEBUG_PRINTF("Volume DOWN\n");
-                            /// ----- Compute new value -----
-                            volume_percentage = (volume_percentage < STEP_CHANGE_VOLUME)?
-                                                    0:(volume_percentage-STEP_CHANGE_VOLUME);
+                case SDLK_l:
+                case SDLK_LEFT:
+                    //MENU_DEBUG_PRINTF("LEFT\n");
+                    if(idx_menus[menuItem] == MENU_TYPE_VOLUME){
+                        if(!(tasks_applied & (1<<MENU_TASK_VOLUME_GET))){
+                            MENU_DEBUG_PRINTF("Volume not known yet, DOWN ignored\n");
+                            break;
+                        }
+                        MENU_DEBUG_PRINTF("Volume DOWN\n");
+                        /// ----- Compute new value -----
+                        volume_percentage = (volume_percentage < STEP_CHANGE_VOLUME)?
+                                                0:(volume_percentage-STEP_CHANGE_VOLUME);
 
-                            /// ----- Shell cmd ----
-                            sprintf(shell_cmd, "%s %d", SHELL_CMD_VOLUME_SET, volume_percentage);
-                            system(shell_cmd);
+                        /// ----- Hardware write, in the background ----
+                        set_system_value(SYSTEM_VALUE_VOLUME, volume_percentage);
 
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_BRIGHTNESS){
+                        if(!(tasks_applied & (1<<MENU_TASK_BRIGHTNESS_GET))){
+                            MENU_DEBUG_PRINTF("Brightness not known yet, DOWN ignored\n");
+                            break;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_BRIGHTNESS){
-                            MENU_DEBUG_PRINTF("Brightness DOWN\n");
-                            /// ----- Compute new value -----
-                            brightness_percentage = (brightness_percentage < STEP_CHANGE_BRIGHTNESS)?
-                                                    0:(brightness_percentage-STEP_CHANGE_BRIGHTNESS);
+                        MENU_DEBUG_PRINTF("Brightness DOWN\n");
+                        /// ----- Compute new value -----
+                        brightness_percentage = (brightness_percentage < STEP_CHANGE_BRIGHTNESS)?
+                                                0:(brightness_percentage-STEP_CHANGE_BRIGHTNESS);
 
-                            /// ----- Shell cmd ----
-                            sprintf(shell_cmd, "%s %d", SHELL_CMD_BRIGHTNESS_SET, brightness_percentage);
-                            system(shell_cmd);
+                        /// ----- Hardware write, in the background ----
+                        set_system_value(SYSTEM_VALUE_BRIGHTNESS, brightness_percentage);
 
 			    /// ------ Refresh screen ------
-                            screen_refresh = 1;
-                        }
-                        else if(idx_menus[menuItem] == MENU_TYPE_SAVE){
-                            MENU_DEBUG_PRINTF("Save Slot DOWN\n");
-                            saveslot = (!saveslot)?(MAX_SAVE_SLOTS-1):(saveslot-1);
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
-                        }
-                        else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
-                            MENU_DEBUG_PRINTF("Load Slot DOWN\n");
-
-                            /** Choose quick save file or standard saveslot for loading */
-                             if(!quick_load_slot_chosen &&
-                                 saveslot == 0 /* &&
-                                 access(quick_save_file, F_OK ) != -1 */){      /* CHANGE - Assume it always exists for now */
-                                 quick_load_slot_chosen = 1;
-                             }
-                             else if(quick_load_slot_chosen){
-                                 quick_load_slot_chosen = 0;
-                                 saveslot = MAX_SAVE_SLOTS-1;
-                             }
-                             else{
-                                 saveslot = (!saveslot)?(MAX_SAVE_SLOTS-1):(saveslot-1);
-                             }
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_SAVE){
+                        MENU_DEBUG_PRINTF("Save Slot DOWN\n");
+                        saveslot = (!saveslot)?(MAX_SAVE_SLOTS-1):(saveslot-1);
+                        configfile_changed();
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
+                        MENU_DEBUG_PRINTF("Load Slot DOWN\n");
+
+                        /** Choose quick save file or standard saveslot for loading */
+                         if(!quick_load_slot_chosen &&
+                             saveslot == 0 /* &&
+                             access(quick_save_file, F_OK ) != -1 */){      /* CHANGE - Assume it always exists for now */
+                             quick_load_slot_chosen = 1;
+                         }
+                         else if(quick_load_slot_chosen){
+                             quick_load_slot_chosen = 0;
+                             saveslot = MAX_SAVE_SLOTS-1;
+                         }
+                         else{
+                             saveslot = (!saveslot)?(MAX_SAVE_SLOTS-1):(saveslot-1);
+                         }
+                        configfile_changed();
 
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
-                        }
-                        else if(idx_menus[menuItem] == MENU_TYPE_ASPECT_RATIO){
-                            MENU_DEBUG_PRINTF("Aspect Ratio DOWN\n");
-                            aspect_ratio = (!aspect_ratio)?(NB_ASPECT_RATIOS_TYPES-1):(aspect_ratio-1);
-                            
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_REWIND){
+                        MENU_DEBUG_PRINTF("Rewind seconds DOWN\n");
+                        rewind_seconds = (rewind_seconds <= 1)?MAX_REWIND_SECONDS:(rewind_seconds-1);
+                        menu_confirmation = 0;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_ASPECT_RATIO){
+                        MENU_DEBUG_PRINTF("Aspect Ratio DOWN\n");
+                        aspect_ratio = (!aspect_ratio)?(NB_ASPECT_RATIOS_TYPES-1):(aspect_ratio-1);
+                        
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
 
-                            // Save config file
-                            //configfile_save(cfg_file_rom);
+                        // Save config file, after a debounce delay and in the background
+                        configfile_changed();
+                    }
+                    break;
+
+                case SDLK_r:
+                case SDLK_RIGHT:
+                    //MENU_DEBUG_PRINTF("RIGHT\n");
+                    if(idx_menus[menuItem] == MENU_TYPE_VOLUME){
+                        if(!(tasks_applied & (1<<MENU_TASK_VOLUME_GET))){
+                            MENU_DEBUG_PRINTF("Volume not known yet, UP ignored\n");
+                            break;
                         }
-                        break;
+                        MENU_DEBUG_PRINTF("Volume UP\n");
+                        /// ----- Compute new value -----
+                        volume_percentage = (volume_percentage > 100 - STEP_CHANGE_VOLUME)?
+                                                100:(volume_percentage+STEP_CHANGE_VOLUME);
 
-                    case SDLK_r:
-                    case SDLK_RIGHT:
-                        //MENU_DEBUG_PRINTF("RIGHT\n");
-                        if(idx_menus[menuItem] == MENU_TYPE_VOLUME){
-                            MENU_DEBUG_PRINTF("Volume UP\n");
-                            /// ----- Compute new value -----
-                            volume_percentage = (volume_percentage > 100 - STEP_CHANGE_VOLUME)?
-                                                    100:(volume_percentage+STEP_CHANGE_VOLUME);
+                        /// ----- Hardware write, in the background ----
+                        set_system_value(SYSTEM_VALUE_VOLUME, volume_percentage);
 
-                            /// ----- Shell cmd ----
-                            sprintf(shell_cmd, "%s %d", SHELL_CMD_VOLUME_SET, volume_percentage);
-                            system(shell_cmd);
-
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_BRIGHTNESS){
+                        if(!(tasks_applied & (1<<MENU_TASK_BRIGHTNESS_GET))){
+                            MENU_DEBUG_PRINTF("Brightness not known yet, UP ignored\n");
+                            break;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_BRIGHTNESS){
-                            MENU_DEBUG_PRINTF("Brightness UP\n");
-                            /// ----- Compute new value -----
-                            brightness_percentage = (brightness_percentage > 100 - STEP_CHANGE_BRIGHTNESS)?
-                                                    100:(brightness_percentage+STEP_CHANGE_BRIGHTNESS);
+                        MENU_DEBUG_PRINTF("Brightness UP\n");
+                        /// ----- Compute new value -----
+                        brightness_percentage = (brightness_percentage > 100 - STEP_CHANGE_BRIGHTNESS)?
+                                                100:(brightness_percentage+STEP_CHANGE_BRIGHTNESS);
 
-                            /// ----- Shell cmd ----
-                            sprintf(shell_cmd, "%s %d", SHELL_CMD_BRIGHTNESS_SET, brightness_percentage);
-                            system(shell_cmd);
+                        /// ----- Hardware write, in the background ----
+                        set_system_value(SYSTEM_VALUE_BRIGHTNESS, brightness_percentage);
 
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_SAVE){
+                        MENU_DEBUG_PRINTF("Save Slot UP\n");
+                        saveslot = (saveslot+1)%MAX_SAVE_SLOTS;
+                        configfile_changed();
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
+                        MENU_DEBUG_PRINTF("Load Slot UP\n");
+
+                        /** Choose quick save file or standard saveslot for loading */
+                        if(!quick_load_slot_chosen &&
+                            saveslot == MAX_SAVE_SLOTS-1 /* &&
+                            access(quick_save_file, F_OK ) != -1 */){      /* CHANGE - Assume it always exists for now */
+                            quick_load_slot_chosen = 1;
+                        }
+                        else if(quick_load_slot_chosen){
+                            quick_load_slot_chosen = 0;
+                            saveslot = 0;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_SAVE){
-                            MENU_DEBUG_PRINTF("Save Slot UP\n");
+                        else{
                             saveslot = (saveslot+1)%MAX_SAVE_SLOTS;
+                        }
+                        configfile_changed();
+
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_REWIND){
+                        MENU_DEBUG_PRINTF("Rewind seconds UP\n");
+                        rewind_seconds = (rewind_seconds >= MAX_REWIND_SECONDS)?1:(rewind_seconds+1);
+                        menu_confirmation = 0;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_ASPECT_RATIO){
+                        MENU_DEBUG_PRINTF("Aspect Ratio UP\n");
+                        aspect_ratio = (aspect_ratio+1)%NB_ASPECT_RATIOS_TYPES;
+                        /// ------ Refresh screen ------
+                        screen_refresh = 1;
+
+                        // Save config file, after a debounce delay and in the background
+                        configfile_changed();
+                    }
+                    break;
+
+                case SDLK_a:
+                case SDLK_RETURN:
+                    if(idx_menus[menuItem] == MENU_TYPE_SAVE){
+                        if(menu_confirmation){
+                            MENU_DEBUG_PRINTF("Saving in slot %d\n", saveslot);
+                            /// ------ Refresh Screen -------
+                            menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 1);
+
+                            /// ------ Save game, the app resumes right away if saving in the background ------
+#ifdef MENU_PERF
+                            uint64_t save_confirm_us = get_time_us();
+#endif //MENU_PERF
+                            TRACE_BEGIN("run_menu_loop: save pause");
+                            if(!menu_save_slot || !save_in_background || start_background_save(saveslot)){
+                                int res = menu_save_slot?menu_save_slot(saveslot):0;
+                                load_prefetch_failed_slot = MENU_NO_PREFETCH;
+
+                                /// ----- Hud Msg -----
+                                format_save_notif(notif_text, sizeof(notif_text), saveslot, res);
+                                menu_notif(notif_text);
+                            }
+                            TRACE_END("run_menu_loop: save pause");
+                            MENU_PERF_PRINTF("Save in slot %d: UI paused %lluus (%s)\n", saveslot+1,
+                                (unsigned long long)(get_time_us()-save_confirm_us), save_pid?"forked":"in place");
+                            stop_menu_loop = 1;
+                        }
+                        else{
+                            MENU_DEBUG_PRINTF("Save game - asking confirmation\n");
+                            menu_confirmation = 1;
                             /// ------ Refresh screen ------
                             screen_refresh = 1;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
-                            MENU_DEBUG_PRINTF("Load Slot UP\n");
-
-                            /** Choose quick save file or standard saveslot for loading */
-                            if(!quick_load_slot_chosen &&
-                                saveslot == MAX_SAVE_SLOTS-1 /* &&
-                                access(quick_save_file, F_OK ) != -1 */){      /* CHANGE - Assume it always exists for now */
-                                quick_load_slot_chosen = 1;
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
+                        if(menu_confirmation){
+                            MENU_DEBUG_PRINTF("Loading in slot %d\n", saveslot);
+#ifdef MENU_PERF
+                            uint64_t load_confirm_us = get_time_us();
+#endif //MENU_PERF
+                            /// ------ Refresh Screen -------
+                            menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 1);
+
+                            /// ------ Load game, once a background save is written ------
+                            wait_background_save();
+                            int prefetched;
+                            int res = load_menu_slot(quick_load_slot_chosen?MENU_AUTO_SAVE_SLOT:saveslot, &prefetched);
+                            MENU_PERF_PRINTF("Load from %s: confirm to state loaded in %lluus (%s)\n",
+                                quick_load_slot_chosen?"auto save":"slot", (unsigned long long)(get_time_us()-load_confirm_us),
+                                prefetched?"prefetched":"read on confirm");
+
+                            /// ----- Hud Msg -----
+                            if(res){
+                                sprintf(notif_text, "          LOAD FAILED");
                             }
                             else if(quick_load_slot_chosen){
-                                quick_load_slot_chosen = 0;
-                                saveslot = 0;
+                                sprintf(notif_text, "     LOADED FROM AUTO SAVE");
                             }
                             else{
-                                saveslot = (saveslot+1)%MAX_SAVE_SLOTS;
+                                sprintf(notif_text, "      LOADED FROM SLOT %d", saveslot+1);
                             }
-
-                            /// ------ Refresh screen ------
-                            screen_refresh = 1;
+                            menu_notif(notif_text);
+                            stop_menu_loop = 1;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_ASPECT_RATIO){
-                            MENU_DEBUG_PRINTF("Aspect Ratio UP\n");
-                            aspect_ratio = (aspect_ratio+1)%NB_ASPECT_RATIOS_TYPES;
+                        else{
+                            MENU_DEBUG_PRINTF("Save game - asking confirmation\n");
+                            menu_confirmation = 1;
                             /// ------ Refresh screen ------
                             screen_refresh = 1;
-
-                            // Save config file
-                            //configfile_save(cfg_file_rom);
                         }
-                        break;
-
-                    case SDLK_a:
-                    case SDLK_RETURN:
-                        if(idx_menus[menuItem] == MENU_TYPE_SAVE){
-                            if(menu_confirmation){
-                                MENU_DEBUG_PRINTF("Saving in slot %d\n", saveslot);
-                                /// ------ Refresh Screen -------
-                                menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 1);
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_REWIND){
+                        if(menu_confirmation){
+                            MENU_DEBUG_PRINTF("Rewinding %d seconds\n", rewind_seconds);
+                            /// ------ Refresh Screen -------
+                            menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 1);
 
-                                /// ------ Save game ------
-                                //state_save(-1);
+                            /// ------ Restore state from the history ------
+                            int nb_seconds = rewind_load_seconds(rewind_seconds);
 
-                                /// ----- Hud Msg -----
-                                sprintf(shell_cmd, "%s %d \"        SAVED IN SLOT %d\"",
-                                    SHELL_CMD_NOTIF_SET, NOTIF_SECONDS_DISP, saveslot+1);
-                                system(shell_cmd);
-                                stop_menu_loop = 1;
+                            /// ----- Hud Msg -----
+                            if(nb_seconds < 0){
+                                sprintf(notif_text, "      NO HISTORY TO REWIND");
                             }
                             else{
-                                MENU_DEBUG_PRINTF("Save game - asking confirmation\n");
-                                menu_confirmation = 1;
-                                /// ------ Refresh screen ------
-                                screen_refresh = 1;
+                                sprintf(notif_text, "     REWOUND %d SECONDS", nb_seconds);
                             }
+                            menu_notif(notif_text);
+                            stop_menu_loop = 1;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_LOAD){
-                            if(menu_confirmation){
-                                MENU_DEBUG_PRINTF("Loading in slot %d\n", saveslot);
-                                /// ------ Refresh Screen -------
-                                menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 1);
-
-                                /// ------ Load game ------
-                                if(quick_load_slot_chosen){
-                        //          state_file_load(quick_save_file);
-                                }
-                                else{
-                        //          state_load(-1);
-                                }
-
-                                /// ----- Hud Msg -----
-                                if(quick_load_slot_chosen){
-                                    sprintf(shell_cmd, "%s %d \"     LOADED FROM AUTO SAVE\"",
-                                        SHELL_CMD_NOTIF_SET, NOTIF_SECONDS_DISP);
-                                }
-                                else{
-                                    sprintf(shell_cmd, "%s %d \"      LOADED FROM SLOT %d\"",
-                                        SHELL_CMD_NOTIF_SET, NOTIF_SECONDS_DISP, saveslot+1);
-                                }
-                                system(shell_cmd);
-                                stop_menu_loop = 1;
-                            }
-                            else{
-                                MENU_DEBUG_PRINTF("Save game - asking confirmation\n");
-                                menu_confirmation = 1;
-                                /// ------ Refresh screen ------
-                                screen_refresh = 1;
-                            }
+                        else{
+                            MENU_DEBUG_PRINTF("Rewind - asking confirmation\n");
+                            menu_confirmation = 1;
+                            /// ------ Refresh screen ------
+                            screen_refresh = 1;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_EXIT){
-                            MENU_DEBUG_PRINTF("Exit game\n");
-                            if(menu_confirmation){
-                                MENU_DEBUG_PRINTF("Exit game - confirmed\n");
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_EXIT){
+                        MENU_DEBUG_PRINTF("Exit game\n");
+                        if(menu_confirmation){
+                            MENU_DEBUG_PRINTF("Exit game - confirmed\n");
 
-                                /// ----- The game should be saved here ----
-                        //      state_file_save(quick_save_file);
+                            /// ----- The game should be saved here ----
+                    //      state_file_save(quick_save_file);
 
-                                /// ----- Exit game and back to launcher ----
-                                exit(0);
-                                stop_menu_loop = 1;
-                            }
-                            else{
-                                MENU_DEBUG_PRINTF("Exit game - asking confirmation\n");
-                                menu_confirmation = 1;
-                                /// ------ Refresh screen ------
-                                screen_refresh = 1;
-                            }
+                            /// ----- Exit game and back to launcher ----
+                            exit(0);
+                            stop_menu_loop = 1;
+                        }
+                        else{
+                            MENU_DEBUG_PRINTF("Exit game - asking confirmation\n");
+                            menu_confirmation = 1;
+                            /// ------ Refresh screen ------
+                            screen_refresh = 1;
                         }
-                        else if(idx_menus[menuItem] == MENU_TYPE_POWERDOWN){
-                            if(menu_confirmation){
-                                MENU_DEBUG_PRINTF("Powerdown - confirmed\n");
-                                /// ----- Shell cmd ----
-                                execlp(SHELL_CMD_POWERDOWN, SHELL_CMD_POWERDOWN, NULL);
+                    }
+                    else if(idx_menus[menuItem] == MENU_TYPE_POWERDOWN){
+                        if(menu_confirmation){
+                            MENU_DEBUG_PRINTF("Powerdown - confirmed\n");
+                            /// ----- Shell cmd ----
+                            TRACE_INSTANT(SHELL_CMD_POWERDOWN);
+                            trace_dump();
+                            execlp(SHELL_CMD_POWERDOWN, SHELL_CMD_POWERDOWN, NULL);
 				MENU_ERROR_PRINTF("Failed to run command %s\n", SHELL_CMD_POWERDOWN);
 				exit(0);
-                            }
-                            else{
-                                MENU_DEBUG_PRINTF("Powerdown - asking confirmation\n");
-                                menu_confirmation = 1;
-                                /// ------ Refresh screen ------
-                                screen_refresh = 1;
-                            }
                         }
-                        break;
+                        else{
+                            MENU_DEBUG_PRINTF("Powerdown - asking confirmation\n");
+                            menu_confirmation = 1;
+                            /// ------ Refresh screen ------
+                            screen_refresh = 1;
+                        }
+                    }
+                    break;
 
-                    default:
-                        //MENU_DEBUG_PRINTF("Keydown: %d\n", event.key.keysym.sym);
-                        break;
-                }
-                break;
+                default:
+                    //MENU_DEBUG_PRINTF("Keydown: %d\n", event.key.keysym.sym);
+                    break;
             }
+            break;
         }
 
-        /// --------- Handle Scroll effect ---------
-        if ((scroll>0) || (start_scroll>0)){
-            scroll+=MIN(SCROLL_SPEED_PX, MENU_ZONE_HEIGHT-scroll);
-            start_scroll = 0;
-            screen_refresh = 1;
-        }
-        else if ((scroll<0) || (start_scroll<0)){
-            scroll-=MIN(SCROLL_SPEED_PX, MENU_ZONE_HEIGHT+scroll);
-            start_scroll = 0;
-            screen_refresh = 1;
-        }
-        if (scroll>=MENU_ZONE_HEIGHT || scroll<=-MENU_ZONE_HEIGHT) {
-            prevItem=menuItem;
-            scroll=0;
-            screen_refresh = 1;
-        }
+        TRACE_END("run_menu_loop: events");
 
         /// --------- Handle FPS ---------
+        TRACE_BEGIN("run_menu_loop: frame limit");
         cur_ms = SDL_GetTicks();
         if(cur_ms-prev_ms < 1000/FPS_MENU){
             SDL_Delay(1000/FPS_MENU - (cur_ms-prev_ms));
         }
         prev_ms = SDL_GetTicks();
+        TRACE_END("run_menu_loop: frame limit");
+
+        /// --------- Handle Scroll effect, from elapsed time so slow frames don't stretch it ---------
+        if(scroll_dir){
+            uint64_t elapsed_us = get_time_us() - scroll_start_us;
+            if(elapsed_us < SCROLL_DURATION_MS*1000ULL){
+                scroll = scroll_dir * MAX(1, (int)(elapsed_us * MENU_ZONE_HEIGHT / (SCROLL_DURATION_MS*1000ULL)));
+            }
+            else{
+                prevItem=menuItem;
+                scroll=0;
+                scroll_dir=0;
+
+                /// ------ Queued presses in one transition, skipping zones in between ------
+                if(queued_scroll){
+                    menuItem = ((menuItem + queued_scroll) % nb_menu_zones + nb_menu_zones) % nb_menu_zones;
+                    scroll_dir = (queued_scroll > 0)?1:-1;
+                    scroll_start_us = get_time_us();
+                    queued_scroll = 0;
+                }
+                if(menuItem == prevItem){
+                    /* Presses cancelled out, or went around all zones */
+                    scroll_dir = 0;
+                }
+                else if(scroll_dir){
+                    /* First step of the next transition, scroll 0 would draw the old zone with the new one's widgets */
+                    scroll = scroll_dir;
+                    menu_stats.nb_transitions++;
+                    menu_stats.nb_chained_transitions++;
+                }
+                if(!scroll_dir){
+                    uint64_t nav_latency_us = get_time_us()-last_nav_press_us;
+                    MENU_PERF_PRINTF("Navigation: last press to zone shown in %lluus\n", (unsigned long long)nav_latency_us);
+                    menu_stats.max_nav_latency_us = MAX(menu_stats.max_nav_latency_us, nav_latency_us);
+                }
+            }
+            screen_refresh = 1;
+        }
+
+        /// --------- Read the highlighted load slot ahead, cancelled when navigating away ---------
+        if(idx_menus[menuItem] == MENU_TYPE_LOAD && !queued_scroll){
+            start_load_prefetch(quick_load_slot_chosen?MENU_AUTO_SAVE_SLOT:saveslot);
+        }
+        else{
+            cancel_load_prefetch();
+        }
 
 
         /// --------- Refresh screen
         if(screen_refresh){
+#ifdef MENU_ALLOC_CHECK
+            unsigned long nb_heap_calls = get_nb_heap_calls();
+#endif //MENU_ALLOC_CHECK
             menu_screen_refresh(menuItem, prevItem, scroll, menu_confirmation, 0);
+            menu_stats.nb_frames++;
+#ifdef MENU_ALLOC_CHECK
+            if(get_nb_heap_calls() != nb_heap_calls){
+                MENU_ERROR_PRINTF("ERROR menu frame made %lu heap calls\n", get_nb_heap_calls()-nb_heap_calls);
+                menu_stats.nb_alloc_frames++;
+            }
+#endif //MENU_ALLOC_CHECK
         }
 
         /// --------- reset screen refresh ---------
         screen_refresh = 0;
+
+        /// --------- Write settings once they stopped changing ---------
+        configfile_poll();
     }
+    menu_stats.zone = idx_menus[menuItem];
+
+    /// ------ Write settings changed in this menu, in the background ------
+    configfile_flush();
+    cancel_load_prefetch();
+
+    /// ------ Opening side effects must be done before being reverted ------
+    TRACE_BEGIN("run_menu_loop: wait tasks");
+    wait_menu_tasks();
+    TRACE_END("run_menu_loop: wait tasks");
+    stop_system_value_setter();
 
     /// ------ Restore last keymap ------
+    TRACE_BEGIN(SHELL_CMD_KEYMAP_RESUME);
     system(SHELL_CMD_KEYMAP_RESUME);
+    TRACE_END(SHELL_CMD_KEYMAP_RESUME);
 
     /// ------ Reset prev key repeat params -------
     if(SDL_EnableKeyRepeat(backup_key_repeat_delay, backup_key_repeat_interval)){
@@ -998,7 +2344,13 @@ void run_menu_loop()
     }
 
     /* Start Ampli */
+    TRACE_BEGIN(SHELL_CMD_AUDIO_AMP_ON);
     system(SHELL_CMD_AUDIO_AMP_ON);
+    TRACE_END(SHELL_CMD_AUDIO_AMP_ON);
+}
+
+void menu_get_stats(menu_stats_t *stats){
+    *stats = menu_stats;
 }
 
 
@@ -1032,7 +2384,7 @@ void run_menu_loop()
 //     }
 
 //     /* Load BG */
-//     SDL_Surface *img_square_bg = IMG_Load(MENU_PNG_BG_PATH);
+//     SDL_Surface *img_square_bg = IMG_Load(menu_png_paths[0]);
 //     if(!img_square_bg) {
 //         MENU_ERROR_PRINTF("ERROR IMG_Load: %s\n", IMG_GetError());
 //     }
@@ -33,6 +33,7 @@ typedef enum{
     MENU_TYPE_BRIGHTNESS,
     MENU_TYPE_SAVE,
     MENU_TYPE_LOAD,
+    MENU_TYPE_REWIND,
     MENU_TYPE_ASPECT_RATIO,
     MENU_TYPE_EXIT,
     MENU_TYPE_POWERDOWN,
@@ -48,6 +49,7 @@ typedef enum{
 #define STEP_CHANGE_VOLUME          10
 #define STEP_CHANGE_BRIGHTNESS      10
 #define NOTIF_SECONDS_DISP          2
+#define MAX_SAVE_SLOTS              9                           /* Would have to be passed in from app/emu on init */
 
 ////------ Menu commands -------
 #define SHELL_CMD_VOLUME_GET                "volume get"
@@ -63,6 +65,30 @@ typedef enum{
 #define SHELL_CMD_KEYMAP_DEFAULT            "keymap default"
 #define SHELL_CMD_KEYMAP_RESUME             "keymap resume"
 
+// Write the app state to a save slot, returns 0 on success. When saving in the
+// background, this runs in a forked child: plain file I/O only, no SDL.
+typedef int (*menu_save_slot_t)(int slot);
+
+#define MENU_AUTO_SAVE_SLOT         -1                          /* Slot of the quick save file ("auto save") */
+
+// Path of a slot's file, MENU_AUTO_SAVE_SLOT for the quick save file
+typedef void (*menu_slot_path_t)(int slot, char *path, size_t size);
+
+// Load a slot from its file's content, read (or prefetched) by the menu. Returns 0 on success.
+// Slot files start with a crc32c_header_t, checked by the menu: data is what follows it.
+typedef int (*menu_load_slot_t)(int slot, const void *data, size_t size);
+
+// Counters of the last run_menu_loop(), for checks (tests/)
+typedef struct{
+    int nb_frames;                                              /* Refreshed after the first one */
+    int nb_alloc_frames;                                        /* Of which made heap calls, MENU_ALLOC_CHECK builds only */
+    int nb_transitions;                                         /* Scroll transitions between zones */
+    int nb_chained_transitions;                                 /* Of which started from presses queued during the previous one */
+    uint64_t max_nav_latency_us;                                /* Longest from a press to its zone being shown, transitions included */
+    ENUM_MENU_TYPE open_zone;
+    ENUM_MENU_TYPE zone;                                        /* Highlighted when closed */
+} menu_stats_t;
+
 ////------ Global variables -------
 
 // Pulled from shell command 
@@ -80,5 +106,16 @@ extern int stop_menu_loop;
 void init_menu_SDL(SDL_Surface* screen);
 void deinit_menu_SDL();
 void init_menu_zones();
+void init_menu_widgets();
 void init_menu_system_values();
 void run_menu_loop();
+void menu_set_app_frame(SDL_Surface* frame);
+void menu_set_pin_resources(int enable);
+void menu_set_resources_dir(const char *dir);
+void menu_set_save_slot(menu_save_slot_t save_slot, int background);
+void menu_poll();
+void menu_get_stats(menu_stats_t *stats);
+
+// Let the menu load slots, from files of at most max_size bytes (header included). With prefetch set,
+// the slot highlighted in the LOAD zone is read in the background, ahead of confirming.
+void menu_set_load_slot(menu_slot_path_t slot_path, menu_load_slot_t load_slot, size_t max_size, int prefetch);
@@ -0,0 +1,217 @@
+/*
+ * sdl-notif.c
+ * In-process on-screen notifications ("toasts") for apps and the overlay menu
+ *
+ * The toast surface is allocated once the font is known, in the screen's
+ * format and as wide as the screen. The text is rendered into it once when a
+ * toast starts, every frame after that is a single opaque blit.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include "sdl-notif.h"
+#include "blit-kernels.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define NOTIF_DEBUG
+#define NOTIF_ERROR
+
+#ifdef NOTIF_DEBUG
+#define NOTIF_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define NOTIF_DEBUG_PRINTF(...)
+#endif //NOTIF_DEBUG
+
+#ifdef NOTIF_ERROR
+#define NOTIF_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define NOTIF_ERROR_PRINTF(...)
+#endif //NOTIF_ERROR
+
+//#define NOTIF_PERF
+
+#ifdef NOTIF_PERF
+#define NOTIF_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define NOTIF_PERF_PRINTF(...)
+#endif //NOTIF_PERF
+
+#define NOTIF_COLOR_BG              0x20, 0x20, 0x20
+#define NOTIF_COLOR_TEXT            {255, 255, 255}
+
+typedef struct{
+    char text[NOTIF_MAX_LEN];
+    int seconds;
+} notif_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static SDL_Surface *notif_screen = NULL;                        /* Format and width of the toasts, NULL when disabled */
+static TTF_Font *notif_font = NULL;
+static SDL_Surface *notif_surface = NULL;                       /* Current toast, rendered once when it starts */
+
+static notif_t notif_queue[NOTIF_MAX_QUEUED];                   /* Ring, oldest at notif_head */
+static int notif_head = 0;
+static int nb_notifs = 0;
+
+static int notif_shown = 0;                                     /* A toast is being drawn */
+static int notif_started = 0;                                   /* Its first frame wasn't drawn yet */
+static uint64_t notif_end_us = 0;
+
+static uint32_t nb_notifs_shown = 0;
+static uint64_t start_time_us = 0;
+static uint64_t max_start_time_us = 0;
+static uint32_t nb_notif_draws = 0;
+static uint64_t draw_time_us = 0;
+static uint64_t max_draw_time_us = 0;
+
+
+/// --------------------------------------------
+/// -------------  NOTIF functions  ------------
+/// --------------------------------------------
+
+int init_notif(SDL_Surface* screen){
+    notif_screen = screen;
+    notif_head = nb_notifs = 0;
+    notif_shown = notif_started = 0;
+    nb_notifs_shown = nb_notif_draws = 0;
+    start_time_us = max_start_time_us = draw_time_us = max_draw_time_us = 0;
+    return 0;
+}
+
+void deinit_notif(){
+    notif_print_stats();
+    notif_set_font(NULL);
+    notif_screen = NULL;
+}
+
+void notif_set_font(TTF_Font *font){
+    if(notif_surface){
+        SDL_FreeSurface(notif_surface);
+        notif_surface = NULL;
+    }
+    notif_font = NULL;
+    notif_shown = 0;
+    if(!font || !notif_screen){
+        return;
+    }
+
+    notif_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, notif_screen->w, TTF_FontHeight(font) + 2*NOTIF_PADDING,
+        notif_screen->format->BitsPerPixel, notif_screen->format->Rmask, notif_screen->format->Gmask,
+        notif_screen->format->Bmask, notif_screen->format->Amask);
+    if(notif_surface == NULL){
+        NOTIF_ERROR_PRINTF("ERROR in notif_set_font: Could not create toast surface: %s\n", SDL_GetError());
+        return;
+    }
+    notif_font = font;
+}
+
+int notif_push(const char *text, int seconds){
+    if(!notif_font){
+        return -1;
+    }
+    while(*text == ' '){
+        text++;
+    }
+
+    if(nb_notifs == NOTIF_MAX_QUEUED){
+        notif_head = (notif_head + 1) % NOTIF_MAX_QUEUED;
+        nb_notifs--;
+    }
+    notif_t *notif = &notif_queue[(notif_head + nb_notifs++) % NOTIF_MAX_QUEUED];
+    snprintf(notif->text, sizeof(notif->text), "%s", text);
+    notif->seconds = seconds;
+    NOTIF_DEBUG_PRINTF("Notif: queued \"%s\" for %ds\n", notif->text, seconds);
+    return 0;
+}
+
+/* Render the oldest queued toast into notif_surface */
+static void start_notif(uint64_t now_us){
+    TRACE_SCOPE("notif: start");
+    notif_t *notif = &notif_queue[notif_head];
+    notif_head = (notif_head + 1) % NOTIF_MAX_QUEUED;
+    nb_notifs--;
+
+    SDL_Color text_color = NOTIF_COLOR_TEXT;
+    SDL_FillRect(notif_surface, NULL, SDL_MapRGB(notif_surface->format, NOTIF_COLOR_BG));
+    SDL_Surface *text_surface = TTF_RenderText_Blended(notif_font, notif->text, text_color);
+    if(text_surface == NULL){
+        NOTIF_ERROR_PRINTF("ERROR in start_notif: Could not render \"%s\": %s\n", notif->text, TTF_GetError());
+        return;
+    }
+    SDL_Rect text_rect = {(notif_surface->w - text_surface->w)/2, NOTIF_PADDING, text_surface->w, text_surface->h};
+    blit_surface_fast(text_surface, NULL, notif_surface, &text_rect);
+    SDL_FreeSurface(text_surface);
+
+    notif_shown = notif_started = 1;
+    notif_end_us = now_us + (uint64_t)notif->seconds*1000000;
+    nb_notifs_shown++;
+    uint64_t elapsed_us = get_time_us() - now_us;
+    start_time_us += elapsed_us;
+    if(elapsed_us > max_start_time_us){
+        max_start_time_us = elapsed_us;
+    }
+}
+
+int notif_update(SDL_Rect *damaged){
+    if(!notif_shown && !nb_notifs){
+        return 0;
+    }
+    uint64_t now_us = get_time_us();
+    int res = 0;
+
+    /// ------ Expired, what the toast covered must be redrawn ------
+    if(notif_shown && now_us >= notif_end_us){
+        notif_shown = 0;
+        *damaged = (SDL_Rect){0, 0, notif_surface->w, notif_surface->h};
+        res = 1;
+    }
+    if(!notif_shown && nb_notifs && notif_font){
+        start_notif(now_us);
+    }
+    return res;
+}
+
+int notif_draw(SDL_Surface *frame){
+    if(!notif_shown){
+        return 0;
+    }
+    TRACE_SCOPE("notif: draw");
+    uint64_t start_us = get_time_us();
+    SDL_Rect dst_rect = {0, 0, notif_surface->w, notif_surface->h};
+    blit_surface_fast(notif_surface, NULL, frame, &dst_rect);
+
+    uint64_t elapsed_us = get_time_us() - start_us;
+    draw_time_us += elapsed_us;
+    if(elapsed_us > max_draw_time_us){
+        max_draw_time_us = elapsed_us;
+    }
+    nb_notif_draws++;
+
+    int res = notif_started;
+    notif_started = 0;
+    return res;
+}
+
+/**
+ * Print the cost of starting a toast (text rendering) and of drawing it each
+ * frame, both are meant to stay well under a frame
+ */
+void notif_print_stats(){
+    if(!nb_notifs_shown || !nb_notif_draws){
+        return;
+    }
+    NOTIF_PERF_PRINTF("Notif: %u toasts, start %lluus on average (%lluus max), draw %lluus per frame on average (%lluus max)\n",
+        nb_notifs_shown, (unsigned long long)(start_time_us/nb_notifs_shown), (unsigned long long)max_start_time_us,
+        (unsigned long long)(draw_time_us/nb_notif_draws), (unsigned long long)max_draw_time_us);
+}
@@ -0,0 +1,54 @@
+/*
+ * sdl-notif.h
+ * In-process on-screen notifications ("toasts") for apps and the overlay menu
+ *
+ * Replaces `notif set` for the menu's messages: instead of spawning a shell,
+ * toasts are queued here and drawn over the app's frames by
+ * present_end_frame(), one at a time, each for its number of seconds of
+ * monotonic time.
+ *
+ * Toasts are drawn over what the app rendered, so the area a toast leaves
+ * must be redrawn: notif_update() returns it once per frame, before the app
+ * renders (see render_invalidate_rect()). Apps that redraw everything every
+ * frame can ignore it.
+ *
+ * Text uses the menu's cached font, given by init_menu_SDL(). notif_push()
+ * fails until both init_notif() and the font are set, the caller then falls
+ * back to the shell command.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_SDL_NOTIF_H
+#define FUNKEY_SDL_NOTIF_H
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#define NOTIF_MAX_QUEUED            4                           /* Oldest toast dropped when full */
+#define NOTIF_MAX_LEN               64
+#define NOTIF_PADDING               4                           /* Pixels around the text */
+
+////------ Functions -------
+
+int init_notif(SDL_Surface* screen);
+void deinit_notif();
+
+// Font for the toasts, NULL before it is closed. Only call from the main thread.
+void notif_set_font(TTF_Font *font);
+
+// Queue a toast, leading spaces are ignored (toasts are centered). Returns 0 if it
+// will be shown, -1 if in-process notifications aren't available.
+int notif_push(const char *text, int seconds);
+
+// Expire and start toasts, call once per frame before rendering. Returns 1 and
+// the area to redraw in damaged when a toast was removed, 0 otherwise.
+int notif_update(SDL_Rect *damaged);
+
+// Draw the current toast over frame, from the present path. Returns 1 for the
+// first frame of a toast, which must be presented even if the app's part is unchanged.
+int notif_draw(SDL_Surface *frame);
+
+void notif_print_stats();
+
+#endif //FUNKEY_SDL_NOTIF_H
@@ -0,0 +1,472 @@
+/*
+ * sdl-present.c
+ * Funkey-specific present path for apps and the overlay menu
+ *
+ * Triple buffering with a lock-free single-producer/single-consumer handoff:
+ *  - the producer (app/menu thread) owns the "back" buffer and renders into it
+ *  - the consumer (present thread) owns the "front" buffer and copies it to the screen
+ *  - the "middle" buffer index is exchanged atomically by both sides, with a
+ *    flag telling the consumer whether it holds a frame it hasn't shown yet
+ * The producer never waits: publishing a new frame before the previous one
+ * was shown simply replaces it (counted as a dropped frame).
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL/SDL.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "sdl-present.h"
+#include "time-utils.h"
+#include "trace.h"
+#include "frame-capture.h"
+#include "sdl-notif.h"
+
+/// -------------- DEFINES --------------
+//#define PRESENT_DEBUG
+#define PRESENT_ERROR
+
+#ifdef PRESENT_DEBUG
+#define PRESENT_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define PRESENT_DEBUG_PRINTF(...)
+#endif //PRESENT_DEBUG
+
+#ifdef PRESENT_ERROR
+#define PRESENT_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define PRESENT_ERROR_PRINTF(...)
+#endif //PRESENT_ERROR
+
+//#define PRESENT_PERF
+
+#ifdef PRESENT_PERF
+#define PRESENT_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define PRESENT_PERF_PRINTF(...)
+#endif //PRESENT_PERF
+
+#define PRESENT_IDX_MASK            0x3
+#define PRESENT_FRESH_FRAME         0x4                         /* Set in middle_idx when it holds a frame not shown yet */
+
+#define FRAME_HASH_PRIME            16777619
+
+/* Present interval statistics, used to compare jitter with and without the thread */
+typedef struct{
+    uint64_t first_present_us;
+    uint64_t first_present_cpu_us;
+    uint64_t last_present_us;
+    uint32_t nb_intervals;
+    double sum_interval_us;
+    double sum_sq_interval_us;
+    uint64_t min_interval_us;
+    uint64_t max_interval_us;
+} present_stats_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static SDL_Surface *present_screen = NULL;                      /* Main SDL_Surface, only flipped by the present thread once started */
+static SDL_Surface *present_buffers[NB_PRESENT_BUFFERS] = {NULL};
+static SDL_Surface *present_shadow = NULL;                      /* Software copy of the screen, when not using the thread */
+static SDL_Thread *present_thread = NULL;
+static SDL_sem *present_sem = NULL;                             /* Wakes the present thread, posting never blocks the producer */
+static volatile int present_thread_quit = 0;
+
+static int back_idx = 0;                                        /* Owned by the producer */
+static int front_idx = 1;                                       /* Owned by the present thread */
+static int middle_idx = 2;                                      /* Shared, only accessed atomically */
+static int nb_frames_published = 0;
+
+static uint32_t nb_frames_dropped = 0;                          /* Published frames replaced before being shown */
+static present_stats_t present_stats;
+
+static int present_filter_max_skipped = 0;                      /* 0 when the unchanged frames filter is disabled */
+static int present_filter_hint = 0;                             /* Set by present_frame_unchanged() for the next frame */
+static int last_frame_hash_valid = 0;
+static uint32_t last_frame_hash = 0;                            /* Of the last presented frame */
+static int nb_consecutive_skipped = 0;
+static uint32_t nb_frames_skipped = 0;
+static uint32_t nb_frames_hashed = 0;
+static uint64_t hash_time_us = 0;
+
+
+/// --------------------------------------------
+/// ------------  PRESENT functions  -----------
+/// --------------------------------------------
+
+static void copy_frame(SDL_Surface *dst, SDL_Surface *src){
+    if(SDL_MUSTLOCK(dst)){
+        SDL_LockSurface(dst);
+    }
+
+    int row_size = src->w * src->format->BytesPerPixel;
+    if(dst->pitch == src->pitch){
+        memcpy(dst->pixels, src->pixels, src->h * src->pitch);
+    }
+    else{
+        for(int y = 0; y < src->h; y++){
+            memcpy((uint8_t*)dst->pixels + y*dst->pitch, (uint8_t*)src->pixels + y*src->pitch, row_size);
+        }
+    }
+
+    if(SDL_MUSTLOCK(dst)){
+        SDL_UnlockSurface(dst);
+    }
+}
+
+static void record_present(){
+    uint64_t now_us = get_time_us();
+
+    if(!present_stats.first_present_us){
+        present_stats.first_present_us = now_us;
+        present_stats.first_present_cpu_us = get_cpu_time_us();
+    }
+    if(present_stats.last_present_us){
+        uint64_t interval_us = now_us - present_stats.last_present_us;
+        present_stats.nb_intervals++;
+        present_stats.sum_interval_us += interval_us;
+        present_stats.sum_sq_interval_us += (double)interval_us * interval_us;
+        if(!present_stats.min_interval_us || interval_us < present_stats.min_interval_us){
+            present_stats.min_interval_us = interval_us;
+        }
+        if(interval_us > present_stats.max_interval_us){
+            present_stats.max_interval_us = interval_us;
+        }
+    }
+    present_stats.last_present_us = now_us;
+}
+
+/* Two running sums per 32-bit lane (Fletcher-like, so position matters), then lanes folded together */
+static uint32_t hash_frame(SDL_Surface *frame){
+    uint32_t sum[4] = {0, 0, 0, 0};
+    uint32_t sum_of_sums[4] = {0, 0, 0, 0};
+    int row_size = frame->w * frame->format->BytesPerPixel;
+    uint32_t hash = 2166136261u;
+
+    if(SDL_MUSTLOCK(frame)){
+        SDL_LockSurface(frame);
+    }
+
+    for(int y = 0; y < frame->h; y++){
+        const uint8_t *row = (const uint8_t*)frame->pixels + y*frame->pitch;
+        int x = 0;
+#if defined(__SSE2__)
+        __m128i a = _mm_loadu_si128((const __m128i*)sum);
+        __m128i b = _mm_loadu_si128((const __m128i*)sum_of_sums);
+        for(; x + 16 <= row_size; x += 16){
+            a = _mm_add_epi32(a, _mm_loadu_si128((const __m128i*)(row + x)));
+            b = _mm_add_epi32(b, a);
+        }
+        _mm_storeu_si128((__m128i*)sum, a);
+        _mm_storeu_si128((__m128i*)sum_of_sums, b);
+#elif defined(__ARM_NEON)
+        uint32x4_t a = vld1q_u32(sum);
+        uint32x4_t b = vld1q_u32(sum_of_sums);
+        for(; x + 16 <= row_size; x += 16){
+            a = vaddq_u32(a, vreinterpretq_u32_u8(vld1q_u8(row + x)));
+            b = vaddq_u32(b, a);
+        }
+        vst1q_u32(sum, a);
+        vst1q_u32(sum_of_sums, b);
+#else
+        for(; x + 16 <= row_size; x += 16){
+            for(int lane = 0; lane < 4; lane++){
+                uint32_t v;
+                memcpy(&v, row + x + 4*lane, sizeof(v));
+                sum[lane] += v;
+                sum_of_sums[lane] += sum[lane];
+            }
+        }
+#endif
+        for(; x < row_size; x++){
+            sum[0] += row[x];
+            sum_of_sums[0] += sum[0];
+        }
+    }
+
+    if(SDL_MUSTLOCK(frame)){
+        SDL_UnlockSurface(frame);
+    }
+
+    for(int lane = 0; lane < 4; lane++){
+        hash = (hash ^ sum[lane]) * FRAME_HASH_PRIME;
+        hash = (hash ^ sum_of_sums[lane]) * FRAME_HASH_PRIME;
+    }
+    return hash;
+}
+
+/* Whether the frame just rendered can be skipped, updates the filter state */
+static int skip_unchanged_frame(SDL_Surface *frame){
+    int unchanged = present_filter_hint;
+    present_filter_hint = 0;
+
+    if(!unchanged){
+        uint64_t start_us = get_time_us();
+        TRACE_BEGIN("present: hash");
+        uint32_t hash = hash_frame(frame);
+        TRACE_END("present: hash");
+        hash_time_us += get_time_us() - start_us;
+        nb_frames_hashed++;
+
+        unchanged = last_frame_hash_valid && hash == last_frame_hash;
+        last_frame_hash = hash;
+        last_frame_hash_valid = 1;
+    }
+
+    /// ------ Present anyway once in a while ------
+    if(unchanged && nb_consecutive_skipped < present_filter_max_skipped){
+        nb_consecutive_skipped++;
+        nb_frames_skipped++;
+        TRACE_INSTANT("present: skip unchanged");
+        return 1;
+    }
+    nb_consecutive_skipped = 0;
+    return 0;
+}
+
+static int present_thread_loop(void *data){
+    PRESENT_DEBUG_PRINTF("Present thread started\n");
+
+    while(1){
+        SDL_SemWait(present_sem);
+        if(present_thread_quit){
+            break;
+        }
+
+        /// ------ Nothing new since last present (extra wake up) ------
+        if(!(__atomic_load_n(&middle_idx, __ATOMIC_ACQUIRE) & PRESENT_FRESH_FRAME)){
+            continue;
+        }
+
+        /// ------ Take the newest frame, give back the one just shown ------
+        int prev = __atomic_exchange_n(&middle_idx, front_idx, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&front_idx, prev & PRESENT_IDX_MASK, __ATOMIC_RELEASE);
+
+        TRACE_BEGIN("present: copy");
+        copy_frame(present_screen, present_buffers[front_idx]);
+        TRACE_END("present: copy");
+        TRACE_BEGIN("SDL_Flip");
+        SDL_Flip(present_screen);
+        TRACE_END("SDL_Flip");
+        record_present();
+    }
+
+    PRESENT_DEBUG_PRINTF("Present thread stopped\n");
+    return 0;
+}
+
+/**
+ * Start the present thread, the app then renders in present_begin_frame()
+ * buffers instead of the screen. Returns 0 on success, or -1 if the app
+ * should keep presenting from its own thread.
+ */
+int init_present_thread(SDL_Surface* screen){
+    if(present_thread){
+        return 0;
+    }
+    present_screen = screen;
+
+    for(int i = 0; i < NB_PRESENT_BUFFERS; i++){
+        present_buffers[i] = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h,
+            screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask,
+            screen->format->Bmask, screen->format->Amask);
+        if(present_buffers[i] == NULL){
+            PRESENT_ERROR_PRINTF("ERROR in init_present_thread: Could not create buffer %d: %s\n", i, SDL_GetError());
+            deinit_present_thread();
+            return -1;
+        }
+    }
+
+    present_sem = SDL_CreateSemaphore(0);
+    if(present_sem == NULL){
+        PRESENT_ERROR_PRINTF("ERROR in init_present_thread: Could not create semaphore: %s\n", SDL_GetError());
+        deinit_present_thread();
+        return -1;
+    }
+
+    back_idx = 0;
+    front_idx = 1;
+    middle_idx = 2;
+    nb_frames_published = 0;
+    nb_frames_dropped = 0;
+    present_thread_quit = 0;
+    memset(&present_stats, 0, sizeof(present_stats));
+
+    present_thread = SDL_CreateThread(present_thread_loop, NULL);
+    if(present_thread == NULL){
+        PRESENT_ERROR_PRINTF("ERROR in init_present_thread: Could not create thread: %s\n", SDL_GetError());
+        deinit_present_thread();
+        return -1;
+    }
+
+    return 0;
+}
+
+void deinit_present_thread(){
+    if(present_thread){
+        present_thread_quit = 1;
+        SDL_SemPost(present_sem);
+        SDL_WaitThread(present_thread, NULL);
+    }
+
+    /// ------ Report jitter for whichever path was used ------
+    present_print_stats();
+    present_thread = NULL;
+
+    if(present_sem){
+        SDL_DestroySemaphore(present_sem);
+        present_sem = NULL;
+    }
+
+    for(int i = 0; i < NB_PRESENT_BUFFERS; i++){
+        if(present_buffers[i]){
+            SDL_FreeSurface(present_buffers[i]);
+            present_buffers[i] = NULL;
+        }
+    }
+}
+
+int present_thread_running(){
+    return present_thread != NULL;
+}
+
+/**
+ * Render frames in a software shadow buffer copied to the screen on present,
+ * keeping the last frame readable from RAM. Returns 0 on success.
+ */
+int init_present_shadow(SDL_Surface* screen){
+    if(present_shadow){
+        return 0;
+    }
+    present_shadow = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h,
+        screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask,
+        screen->format->Bmask, screen->format->Amask);
+    if(present_shadow == NULL){
+        PRESENT_ERROR_PRINTF("ERROR in init_present_shadow: Could not create shadow buffer: %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+void deinit_present_shadow(){
+    if(present_shadow){
+        SDL_FreeSurface(present_shadow);
+        present_shadow = NULL;
+    }
+}
+
+void present_set_filter(int max_skipped){
+    present_filter_max_skipped = (max_skipped > 0)?max_skipped:0;
+    present_filter_hint = 0;
+    last_frame_hash_valid = 0;
+    nb_consecutive_skipped = 0;
+}
+
+void present_frame_unchanged(){
+    present_filter_hint = 1;
+}
+
+SDL_Surface* present_begin_frame(SDL_Surface* screen){
+    if(!present_thread){
+        return present_shadow?present_shadow:screen;
+    }
+    return present_buffers[back_idx];
+}
+
+void present_end_frame(SDL_Surface* screen){
+    /// ------ Toast over the app's frame, a new one is presented even if the app's part is unchanged ------
+    if(notif_draw(present_begin_frame(screen))){
+        present_filter_hint = 0;
+    }
+
+    /// ------ Same as what is already shown, the back buffer stays ours ------
+    if(present_filter_max_skipped && skip_unchanged_frame(present_begin_frame(screen))){
+        return;
+    }
+
+    /// ------ Record the frame if capture is enabled, never blocks ------
+    frame_capture_push(present_begin_frame(screen));
+
+    if(!present_thread){
+        if(present_shadow){
+            TRACE_BEGIN("present: copy");
+            copy_frame(screen, present_shadow);
+            TRACE_END("present: copy");
+        }
+        TRACE_BEGIN("SDL_Flip");
+        SDL_Flip(screen);
+        TRACE_END("SDL_Flip");
+        record_present();
+        return;
+    }
+
+    /// ------ Publish back buffer, take whichever buffer was in the middle ------
+    int prev = __atomic_exchange_n(&middle_idx, back_idx | PRESENT_FRESH_FRAME, __ATOMIC_ACQ_REL);
+    back_idx = prev & PRESENT_IDX_MASK;
+    if(prev & PRESENT_FRESH_FRAME){
+        nb_frames_dropped++;
+    }
+    nb_frames_published++;
+    TRACE_INSTANT("present: publish");
+
+    SDL_SemPost(present_sem);
+}
+
+SDL_Surface* present_last_frame(SDL_Surface* screen){
+    if(!present_thread){
+        return present_shadow?present_shadow:screen;
+    }
+    if(!nb_frames_published){
+        return screen;
+    }
+
+    /* Only the producer writes buffers, so reading the published ones from here is safe */
+    int middle = __atomic_load_n(&middle_idx, __ATOMIC_ACQUIRE);
+    if(middle & PRESENT_FRESH_FRAME){
+        return present_buffers[middle & PRESENT_IDX_MASK];
+    }
+    return present_buffers[__atomic_load_n(&front_idx, __ATOMIC_ACQUIRE)];
+}
+
+/**
+ * Print present interval statistics, run the app with and without the present
+ * thread to compare the jitter of both paths
+ */
+void present_print_stats(){
+    if(!present_stats.nb_intervals){
+        return;
+    }
+
+#ifdef PRESENT_PERF
+    double mean_us = present_stats.sum_interval_us / present_stats.nb_intervals;
+    double variance = present_stats.sum_sq_interval_us / present_stats.nb_intervals - mean_us*mean_us;
+#endif //PRESENT_PERF
+    PRESENT_PERF_PRINTF("Present (%s): %u intervals, mean %.0fus, jitter (stddev) %.0fus, min %lluus, max %lluus, %u dropped\n",
+        present_thread?"present thread":"single thread", present_stats.nb_intervals,
+        mean_us, sqrt(variance > 0 ? variance : 0),
+        (unsigned long long)present_stats.min_interval_us, (unsigned long long)present_stats.max_interval_us,
+        nb_frames_dropped);
+
+    /// ------ CPU usage since the first present, to compare with/without the filter ------
+#ifdef PRESENT_PERF
+    uint64_t wall_us = get_time_us() - present_stats.first_present_us;
+    uint64_t cpu_us = get_cpu_time_us() - present_stats.first_present_cpu_us;
+#endif //PRESENT_PERF
+    PRESENT_PERF_PRINTF("Present: CPU %.1f%% over %.1fs", wall_us?100.0*cpu_us/wall_us:0.0, wall_us/1000000.0);
+    if(present_filter_max_skipped){
+        PRESENT_PERF_PRINTF(", %u unchanged frames skipped, %u hashed in %lluus on average",
+            nb_frames_skipped, nb_frames_hashed,
+            (unsigned long long)(nb_frames_hashed?hash_time_us/nb_frames_hashed:0));
+    }
+    PRESENT_PERF_PRINTF("\n");
+}
@@ -0,0 +1,60 @@
+/*
+ * sdl-present.h
+ * Funkey-specific present path for apps and the overlay menu
+ *
+ * By default frames are drawn straight into the main SDL_Surface and flipped
+ * from the calling thread, exactly like a plain SDL app. Optionally, a
+ * dedicated present thread can own SDL_Flip(): the app renders into one of
+ * three software buffers and publishes it without waiting, and the present
+ * thread always shows the newest published frame.
+ *
+ * Without the thread, a software shadow buffer can also be enabled: the app
+ * renders in RAM and the present path copies it to the screen, so that
+ * snapshots (menu opening) never read back from video memory.
+ *
+ * An optional filter skips presenting frames identical to the last presented
+ * one, either hinted by the app (present_frame_unchanged(), e.g. when the
+ * renderer redrew nothing) or detected by hashing the frame. Hashing reads
+ * the whole frame back, so it is best used with the thread or shadow buffer.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_SDL_PRESENT_H
+#define FUNKEY_SDL_PRESENT_H
+
+#include <SDL/SDL.h>
+
+#define NB_PRESENT_BUFFERS          3
+
+////------ Functions -------
+
+int init_present_thread(SDL_Surface* screen);
+void deinit_present_thread();
+int present_thread_running();
+
+int init_present_shadow(SDL_Surface* screen);
+void deinit_present_shadow();
+
+// Surface to render the next frame into: a free triple buffer when the present
+// thread is running, the shadow buffer if enabled, otherwise the screen itself
+SDL_Surface* present_begin_frame(SDL_Surface* screen);
+
+// Publish the frame rendered since present_begin_frame(), never blocks
+// when the present thread is running, otherwise SDL_Flip()s the screen
+void present_end_frame(SDL_Surface* screen);
+
+// Skip presenting frames identical to the last presented one, still presenting
+// after max_skipped frames in a row. 0 disables the filter (default).
+void present_set_filter(int max_skipped);
+
+// Hint that the frame about to be presented is identical to the previous one,
+// skips hashing it. Only applies to the next present_end_frame().
+void present_frame_unchanged();
+
+// Most recent complete frame (published buffer, shadow buffer or the screen), for snapshots
+SDL_Surface* present_last_frame(SDL_Surface* screen);
+
+void present_print_stats();
+
+#endif //FUNKEY_SDL_PRESENT_H
@@ -0,0 +1,247 @@
+/*
+ * thread-pool.c
+ * Small pool of worker threads for the menu's background work
+ *
+ * A fixed ring of tasks under a single mutex: tasks are a few per menu open
+ * or init, so contention doesn't matter, the point is not creating threads
+ * every time.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <SDL/SDL.h>
+
+#include "thread-pool.h"
+#include "time-utils.h"
+#include "trace.h"
+
+/// -------------- DEFINES --------------
+//#define POOL_DEBUG
+#define POOL_ERROR
+
+#ifdef POOL_DEBUG
+#define POOL_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define POOL_DEBUG_PRINTF(...)
+#endif //POOL_DEBUG
+
+#ifdef POOL_ERROR
+#define POOL_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define POOL_ERROR_PRINTF(...)
+#endif //POOL_ERROR
+
+//#define POOL_PERF
+
+#ifdef POOL_PERF
+#define POOL_PERF_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define POOL_PERF_PRINTF(...)
+#endif //POOL_PERF
+
+typedef struct{
+    thread_pool_task_t task;
+    void *arg;
+    thread_pool_group_t *group;
+} pool_task_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+static SDL_mutex *pool_mutex = NULL;                            /* NULL when tasks run inline */
+static SDL_cond *pool_work_cond = NULL;                         /* Tasks were queued, or quitting */
+static SDL_cond *pool_done_cond = NULL;                         /* A group reached 0 pending tasks */
+static SDL_Thread *pool_threads[THREAD_POOL_MAX_THREADS];
+static int nb_pool_threads = 0;
+static int pool_quit = 0;
+
+static pool_task_t pool_tasks[THREAD_POOL_MAX_TASKS];           /* Ring, oldest at pool_head */
+static int pool_head = 0;
+static int nb_pool_tasks = 0;
+
+static uint32_t nb_tasks_run = 0;
+static uint32_t nb_tasks_inline = 0;                            /* Run by thread_pool_wait(), without a pool or because the ring was full */
+static uint64_t tasks_time_us = 0;
+
+
+/// --------------------------------------------
+/// -----------  THREAD POOL functions  --------
+/// --------------------------------------------
+
+/* Called with pool_mutex locked, if there's one */
+static void count_task(uint64_t elapsed_us, int is_worker){
+    nb_tasks_run++;
+    nb_tasks_inline += !is_worker;
+    tasks_time_us += elapsed_us;
+}
+
+/* Run the queued task at index pos from the oldest, keeping the others in order. Called and returns with pool_mutex locked */
+static void run_task(int pos, int is_worker){
+    pool_task_t task = pool_tasks[(pool_head + pos) % THREAD_POOL_MAX_TASKS];
+    for(; pos > 0; pos--){
+        pool_tasks[(pool_head + pos) % THREAD_POOL_MAX_TASKS] = pool_tasks[(pool_head + pos - 1) % THREAD_POOL_MAX_TASKS];
+    }
+    pool_head = (pool_head + 1) % THREAD_POOL_MAX_TASKS;
+    nb_pool_tasks--;
+
+    SDL_mutexV(pool_mutex);
+    uint64_t start_us = get_time_us();
+    task.task(task.arg);
+    uint64_t elapsed_us = get_time_us() - start_us;
+    SDL_mutexP(pool_mutex);
+
+    count_task(elapsed_us, is_worker);
+    if(--task.group->nb_pending == 0){
+        SDL_CondBroadcast(pool_done_cond);
+    }
+}
+
+/* Index from the oldest of the first queued task of group, -1 if none. Called with pool_mutex locked */
+static int find_group_task(thread_pool_group_t *group){
+    for(int pos = 0; pos < nb_pool_tasks; pos++){
+        if(pool_tasks[(pool_head + pos) % THREAD_POOL_MAX_TASKS].group == group){
+            return pos;
+        }
+    }
+    return -1;
+}
+
+static int pool_worker_loop(void *data){
+    SDL_mutexP(pool_mutex);
+    while(!pool_quit || nb_pool_tasks){
+        if(nb_pool_tasks){
+            run_task(0, 1);
+        }
+        else{
+            SDL_CondWait(pool_work_cond, pool_mutex);
+        }
+    }
+    SDL_mutexV(pool_mutex);
+    return 0;
+}
+
+int init_thread_pool(int nb_threads){
+    if(pool_mutex){
+        return 0;
+    }
+    if(nb_threads < 0){
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        nb_threads = (nb_threads < 1)?1:nb_threads;
+    }
+    nb_threads = (nb_threads > THREAD_POOL_MAX_THREADS)?THREAD_POOL_MAX_THREADS:nb_threads;
+    nb_tasks_run = nb_tasks_inline = 0;
+    tasks_time_us = 0;
+    if(!nb_threads){
+        return 0;
+    }
+
+    pool_mutex = SDL_CreateMutex();
+    pool_work_cond = SDL_CreateCond();
+    pool_done_cond = SDL_CreateCond();
+    if(!pool_mutex || !pool_work_cond || !pool_done_cond){
+        POOL_ERROR_PRINTF("ERROR in init_thread_pool: Could not create mutex/conds: %s\n", SDL_GetError());
+        deinit_thread_pool();
+        return -1;
+    }
+
+    pool_quit = 0;
+    pool_head = nb_pool_tasks = 0;
+    for(nb_pool_threads = 0; nb_pool_threads < nb_threads; nb_pool_threads++){
+        pool_threads[nb_pool_threads] = SDL_CreateThread(pool_worker_loop, NULL);
+        if(pool_threads[nb_pool_threads] == NULL){
+            POOL_ERROR_PRINTF("ERROR in init_thread_pool: Could not create thread: %s\n", SDL_GetError());
+            break;
+        }
+    }
+    if(!nb_pool_threads){
+        deinit_thread_pool();
+        return -1;
+    }
+    POOL_DEBUG_PRINTF("Thread pool: %d threads\n", nb_pool_threads);
+    return 0;
+}
+
+void deinit_thread_pool(){
+    if(pool_mutex){
+        /// ------ Workers finish the queued tasks first ------
+        SDL_mutexP(pool_mutex);
+        pool_quit = 1;
+        SDL_CondBroadcast(pool_work_cond);
+        SDL_mutexV(pool_mutex);
+        for(int i = 0; i < nb_pool_threads; i++){
+            SDL_WaitThread(pool_threads[i], NULL);
+        }
+        SDL_DestroyMutex(pool_mutex);
+        pool_mutex = NULL;
+    }
+    if(pool_work_cond){
+        SDL_DestroyCond(pool_work_cond);
+        pool_work_cond = NULL;
+    }
+    if(pool_done_cond){
+        SDL_DestroyCond(pool_done_cond);
+        pool_done_cond = NULL;
+    }
+
+    if(nb_tasks_run){
+        POOL_PERF_PRINTF("Thread pool: %d threads, %u tasks (%u inline or by waiting threads), %lluus per task on average\n",
+            nb_pool_threads, nb_tasks_run, nb_tasks_inline, (unsigned long long)(tasks_time_us/nb_tasks_run));
+    }
+    nb_pool_threads = 0;
+}
+
+int thread_pool_size(){
+    return nb_pool_threads;
+}
+
+void thread_pool_submit(thread_pool_group_t *group, thread_pool_task_t task, void *arg){
+    if(pool_mutex){
+        SDL_mutexP(pool_mutex);
+        if(nb_pool_tasks < THREAD_POOL_MAX_TASKS){
+            pool_tasks[(pool_head + nb_pool_tasks) % THREAD_POOL_MAX_TASKS] = (pool_task_t){task, arg, group};
+            nb_pool_tasks++;
+            group->nb_pending++;
+            SDL_CondSignal(pool_work_cond);
+            SDL_mutexV(pool_mutex);
+            return;
+        }
+        SDL_mutexV(pool_mutex);
+        POOL_DEBUG_PRINTF("Thread pool: queue full, running task inline\n");
+    }
+
+    /// ------ No pool, or queue full ------
+    TRACE_SCOPE("thread pool: inline task");
+    uint64_t start_us = get_time_us();
+    task(arg);
+    uint64_t elapsed_us = get_time_us() - start_us;
+    if(pool_mutex){
+        SDL_mutexP(pool_mutex);
+    }
+    count_task(elapsed_us, 0);
+    if(pool_mutex){
+        SDL_mutexV(pool_mutex);
+    }
+}
+
+void thread_pool_wait(thread_pool_group_t *group){
+    if(!pool_mutex){
+        return;
+    }
+    TRACE_SCOPE("thread pool: wait");
+    SDL_mutexP(pool_mutex);
+    while(group->nb_pending){
+        /// ------ Only this group's tasks: others may block (shell commands) for longer than the caller can wait ------
+        int pos = find_group_task(group);
+        if(pos >= 0){
+            run_task(pos, 0);
+        }
+        else{
+            SDL_CondWait(pool_done_cond, pool_mutex);
+        }
+    }
+    SDL_mutexV(pool_mutex);
+}
@@ -0,0 +1,41 @@
+/*
+ * thread-pool.h
+ * Small pool of worker threads for the menu's background work
+ *
+ * Tasks are submitted to a group and thread_pool_wait() is the join barrier
+ * for that group. The waiting thread runs the group's queued tasks itself
+ * instead of sleeping, never other groups' ones (which may block on shell
+ * commands). A pool of 0 threads (or one never initialized) simply runs
+ * every task inline, in submission order.
+ *
+ * Tasks must not touch the screen: only software surfaces can be created
+ * from workers, SDL video calls stay on the main thread.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_THREAD_POOL_H
+#define FUNKEY_THREAD_POOL_H
+
+#define THREAD_POOL_MAX_THREADS     4
+#define THREAD_POOL_MAX_TASKS       32                          /* Queued at once, extra tasks run inline */
+
+typedef void (*thread_pool_task_t)(void *arg);
+
+typedef struct{
+    int nb_pending;                                             /* Submitted and not finished, under the pool mutex */
+} thread_pool_group_t;
+
+////------ Functions -------
+
+// nb_threads < 0 picks one per CPU but the calling one (at least 1), 0 runs tasks inline
+int init_thread_pool(int nb_threads);
+void deinit_thread_pool();
+int thread_pool_size();
+
+void thread_pool_submit(thread_pool_group_t *group, thread_pool_task_t task, void *arg);
+
+// Wait until all tasks of the group are done, running its queued tasks meanwhile
+void thread_pool_wait(thread_pool_group_t *group);
+
+#endif //FUNKEY_THREAD_POOL_H
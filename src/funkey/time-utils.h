@@ -0,0 +1,31 @@
+/*
+ * time-utils.h
+ * Monotonic time helpers shared by the Funkey integration files
+ *
+ * SDL_GetTicks() only has millisecond resolution, which isn't enough to
+ * measure frame jitter or short shell commands, so use CLOCK_MONOTONIC.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_TIME_UTILS_H
+#define FUNKEY_TIME_UTILS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Monotonic time in microseconds, unaffected by wall clock changes */
+static inline uint64_t get_time_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* CPU time used by the whole process (all threads) in microseconds */
+static inline uint64_t get_cpu_time_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+#endif //FUNKEY_TIME_UTILS_H
@@ -0,0 +1,172 @@
+/*
+ * trace.c
+ * Lightweight trace points for the Funkey integration and apps
+ *
+ * Writers claim a slot with an atomic increment and publish it with a
+ * sequence number, so any thread can trace without locks. The dump skips
+ * slots that are being rewritten while it reads them.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "time-utils.h"
+
+/// -------------- DEFINES --------------
+//#define TRACE_DEBUG
+#define TRACE_ERROR
+
+#ifdef TRACE_DEBUG
+#define TRACE_DEBUG_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define TRACE_DEBUG_PRINTF(...)
+#endif //TRACE_DEBUG
+
+#ifdef TRACE_ERROR
+#define TRACE_ERROR_PRINTF(...)   printf(__VA_ARGS__);
+#else
+#define TRACE_ERROR_PRINTF(...)
+#endif //TRACE_ERROR
+
+#define TRACE_RING_MASK             (TRACE_RING_SIZE-1)
+#define TRACE_MAX_PATH_LEN          512
+
+typedef struct{
+    uint32_t seq;                                               /* Event index+1 once written, 0 while being written */
+    char phase;                                                 /* Chrome trace phase: B(egin), E(nd), i(nstant) */
+    int tid;
+    uint64_t ts_us;
+    const char *name;
+} trace_entry_t;
+
+
+/// -------------- STATIC VARIABLES --------------
+int trace_enabled = 0;
+
+static trace_entry_t trace_ring[TRACE_RING_SIZE];
+static uint32_t trace_write_idx = 0;                            /* Only accessed atomically */
+static volatile sig_atomic_t trace_dump_requested = 0;
+static char trace_output_path[TRACE_MAX_PATH_LEN];
+static uint64_t trace_start_us = 0;
+
+
+/// --------------------------------------------
+/// -------------  TRACE functions  ------------
+/// --------------------------------------------
+
+static void handle_sigusr2(int sig){
+    /* Only flag it, the dump itself isn't async-signal-safe */
+    trace_dump_requested = 1;
+}
+
+/**
+ * Start recording trace events, dumped to output_path on SIGUSR2 (see trace_poll()) and at exit
+ */
+void init_trace(const char *output_path){
+    if(trace_enabled){
+        return;
+    }
+    snprintf(trace_output_path, sizeof(trace_output_path), "%s", output_path);
+    trace_start_us = get_time_us();
+
+    signal(SIGUSR2, handle_sigusr2);
+    atexit(trace_dump);
+
+    __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+    TRACE_DEBUG_PRINTF("Tracing to %s\n", trace_output_path);
+}
+
+void trace_event(const char *name, char phase){
+    static __thread int tid = 0;
+    if(!tid){
+        tid = (int)syscall(SYS_gettid);
+    }
+
+    uint32_t idx = __atomic_fetch_add(&trace_write_idx, 1, __ATOMIC_RELAXED);
+    trace_entry_t *entry = &trace_ring[idx & TRACE_RING_MASK];
+
+    __atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->phase = phase;
+    entry->tid = tid;
+    entry->ts_us = get_time_us();
+    entry->name = name;
+    __atomic_store_n(&entry->seq, idx+1, __ATOMIC_RELEASE);
+}
+
+const char *trace_scope_begin(const char *name){
+    if(!trace_enabled){
+        return NULL;
+    }
+    trace_event(name, 'B');
+    return name;
+}
+
+void trace_scope_end(const char **name){
+    if(*name){
+        trace_event(*name, 'E');
+    }
+}
+
+/**
+ * Dump the trace if SIGUSR2 was received, to be called regularly from the app/menu loops
+ */
+void trace_poll(){
+    if(trace_dump_requested){
+        trace_dump_requested = 0;
+        trace_dump();
+    }
+}
+
+/**
+ * Write the events currently in the ring as Chrome trace JSON
+ */
+void trace_dump(){
+    if(!trace_enabled){
+        return;
+    }
+
+    FILE *fp = fopen(trace_output_path, "w");
+    if(fp == NULL){
+        TRACE_ERROR_PRINTF("ERROR in trace_dump: Could not open %s\n", trace_output_path);
+        return;
+    }
+
+    uint32_t end = __atomic_load_n(&trace_write_idx, __ATOMIC_ACQUIRE);
+    uint32_t start = (end > TRACE_RING_SIZE)?(end - TRACE_RING_SIZE):0;
+    int pid = (int)getpid();
+    int nb_events = 0;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for(uint32_t idx = start; idx != end; idx++){
+        trace_entry_t *entry = &trace_ring[idx & TRACE_RING_MASK];
+        trace_entry_t event;
+
+        /// ------ Copy, then make sure it wasn't rewritten meanwhile ------
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        event = *entry;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(seq != idx+1 || __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq || event.name == NULL){
+            continue;
+        }
+
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d%s}",
+            nb_events?",\n":"", event.name, event.phase,
+            (unsigned long long)(event.ts_us - trace_start_us), pid, event.tid,
+            (event.phase == 'i')?",\"s\":\"t\"":"");
+        nb_events++;
+    }
+    /* Timestamps are relative to init_trace(), the CLOCK_MONOTONIC origin lets tools line them up with outside events */
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"monotonic_start_us\":%llu}}\n",
+        (unsigned long long)trace_start_us);
+    fclose(fp);
+
+    TRACE_DEBUG_PRINTF("Dumped %d trace events to %s\n", nb_events, trace_output_path);
+}
@@ -0,0 +1,47 @@
+/*
+ * trace.h
+ * Lightweight trace points for the Funkey integration and apps
+ *
+ * Events go into a fixed-size lock-free ring buffer with monotonic timestamps,
+ * and are dumped as Chrome trace JSON (chrome://tracing, Perfetto) on SIGUSR2
+ * or at exit. Tracing is off until init_trace() is called, trace points then
+ * only cost a branch.
+ *
+ * Event names must be string literals (or otherwise outlive the trace),
+ * only the pointer is recorded.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_TRACE_H
+#define FUNKEY_TRACE_H
+
+#define TRACE_RING_SIZE             8192                        /* Must be a power of 2 */
+
+////------ Trace points -------
+
+#define TRACE_BEGIN(name)   do{ if(trace_enabled) trace_event(name, 'B'); }while(0)
+#define TRACE_END(name)     do{ if(trace_enabled) trace_event(name, 'E'); }while(0)
+#define TRACE_INSTANT(name) do{ if(trace_enabled) trace_event(name, 'i'); }while(0)
+
+// Begin now, end when leaving the enclosing block
+#define TRACE_SCOPE(name)   TRACE_SCOPE_(name, __LINE__)
+#define TRACE_SCOPE_(name, line)    TRACE_SCOPE__(name, line)
+#define TRACE_SCOPE__(name, line)   \
+    const char *trace_scope_##line __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+
+////------ Global variables -------
+
+extern int trace_enabled;
+
+////------ Functions -------
+
+void init_trace(const char *output_path);
+void trace_event(const char *name, char phase);
+void trace_poll();
+void trace_dump();
+
+const char *trace_scope_begin(const char *name);
+void trace_scope_end(const char **name);
+
+#endif //FUNKEY_TRACE_H
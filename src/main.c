@@ -1,12 +1,49 @@
 #include <SDL/SDL.h>
 #include <SDL/SDL_ttf.h>
 
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <signal.h> // ** INSTANT RELOAD INTEGRATION ** - Ability to check for SIGUSR1 (console closed)
 
 #include "funkey/sdl-menu.h"
+#include "funkey/sdl-present.h"
+#include "funkey/trace.h"
+#include "funkey/frame-capture.h"
+#include "funkey/render.h"
+#include "funkey/rewind.h"
+#include "funkey/quick-save.h"
+#include "funkey/thread-pool.h"
+#include "funkey/instant-play.h"
+#include "funkey/sdl-notif.h"
+#include "funkey/runloop.h"
+#include "funkey/crc32c.h"
+#include "funkey/blit-kernels.h"
 
 #define FPS_GAME 50
 
+// ** REWIND INTEGRATION ** - History of the app state, for the menu's REWIND zone
+#define REWIND_ARENA_SIZE       (1024*1024)
+#define REWIND_CAPTURE_INTERVAL 10              // frames
+
+// ** INSTANT RELOAD INTEGRATION ** - Default time between SIGUSR1 and the power being cut
+// Kept below the hardware's window so powerdown still runs, FUNKEY_QUICK_SAVE_DEADLINE_MS overrides it
+#define QUICK_SAVE_DEADLINE_MS  2000
+#define QUICK_SAVE_PATH         "/mnt/funkey-testapp.state"
+#define QUICK_SAVE_THUMB_PATH   "/mnt/funkey-testapp.thumb"
+
+// MENU INTEGRATION - Save slot files written from the menu's SAVE zone, FUNKEY_SAVE_DIR overrides the directory
+#define SAVE_SLOT_DIR           "/mnt"
+#define SAVE_SLOT_PATH          "%s/funkey-testapp.s%d"
+
+// Stand-in app state size, FUNKEY_APP_STATE_KB overrides it (e.g. a few MB, as an emulator's)
+#define APP_STATE_SIZE          (64*1024)
+
+// ** SAVE BENCH ** - Keys pushed once the first frame is flipped: open the menu, go to SAVE, confirm twice
+#define SAVE_BENCH_KEY_DELAY_MS 400             // longer than a scroll transition
+
 // Global Variable
 int should_quick_save = 0;
 
@@ -15,6 +52,126 @@ int should_quick_save = 0;
 // TODO - Pass a pointer to this on initialization if save/load is available!
 int saveslot = 0;
 
+// MENU INTEGRATION - Path of the app's binary config, persisting the menu settings
+// (aspect ratio, save slot). Read in init_menu_SDL(), NULL to not persist anything.
+char *cfg_file_rom = "/mnt/funkey-testapp.cfg";
+
+// Stand-in for an emulator's state: some RAM, of which a few bytes change every frame
+static uint8_t *app_ram = NULL;
+static size_t app_ram_size = APP_STATE_SIZE;
+static uint32_t app_frame_count = 0;
+static const char *save_slot_dir = SAVE_SLOT_DIR;
+
+// ** REWIND INTEGRATION ** - Copy the whole app state in and out of the history
+static void save_app_state(void *buf, size_t size)
+{
+    memcpy(buf, app_ram, size);
+}
+
+static void load_app_state(const void *buf, size_t size)
+{
+    memcpy(app_ram, buf, size);
+}
+
+// MENU INTEGRATION - Write the app state to a save slot, possibly from a forked child (plain file I/O only)
+// Behind a crc32c_header_t, which the menu checks when loading the slot. Written to a temp file
+// renamed over the slot, so the previous save survives a write cut short.
+static int save_app_slot(int slot)
+{
+    char path[512];
+    char tmp_path[512 + 8];
+    crc32c_header_t header;
+    crc32c_header_set(&header, crc32c(0, app_ram, app_ram_size), app_ram_size);
+    snprintf(path, sizeof(path), SAVE_SLOT_PATH, save_slot_dir, slot);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return -1;
+    }
+    int res = (write(fd, &header, sizeof(header)) == sizeof(header) &&
+        write(fd, app_ram, app_ram_size) == (ssize_t)app_ram_size && !fsync(fd))?0:-1;
+    close(fd);
+    res = res?res:rename(tmp_path, path);
+    if(res){
+        unlink(tmp_path);
+    }
+    return res;
+}
+
+// MENU INTEGRATION - Files the menu loads slots from, MENU_AUTO_SAVE_SLOT being the quick save
+static void app_slot_path(int slot, char *path, size_t size)
+{
+    if(slot == MENU_AUTO_SAVE_SLOT){
+        snprintf(path, size, "%s", QUICK_SAVE_PATH);
+    }
+    else{
+        snprintf(path, size, SAVE_SLOT_PATH, save_slot_dir, slot);
+    }
+}
+
+// MENU INTEGRATION - Load a slot from its file's content, read (possibly ahead) and checked by the menu
+static int load_app_slot(int slot, const void *data, size_t size)
+{
+    if(slot == MENU_AUTO_SAVE_SLOT){
+        return quick_save_decode_state(data, size, app_ram, app_ram_size);
+    }
+    if(size != app_ram_size){
+        return -1;
+    }
+    memcpy(app_ram, data, size);
+    return 0;
+}
+
+// ** RUNLOOP INTEGRATION ** - Update the app state, then let the rewind history capture it (a bit every update)
+// Runs at exactly FPS_GAME, whatever rendering costs
+static void update_app(void *data)
+{
+    app_frame_count++;
+    memcpy(&app_ram[(app_frame_count*64) % app_ram_size], &app_frame_count, sizeof(app_frame_count));
+    rewind_frame();
+}
+
+// ** RUNLOOP INTEGRATION ** - Draw and present the current state, skipped when updates are behind
+static void render_app(void *data)
+{
+    SDL_Surface* hw_surface = (SDL_Surface*)data;
+    Uint32 black = SDL_MapRGB(hw_surface->format, 0, 0, 0);
+    Uint32 green = SDL_MapRGB(hw_surface->format, 0, 255, 0);
+
+    // ** NOTIFICATION INTEGRATION ** - Expire toasts, redrawing what the last one covered
+    SDL_Rect notif_rect;
+    if(notif_update(&notif_rect)){
+        render_invalidate_rect(&notif_rect);
+    }
+
+    // Get the surface to draw into, hw_surface itself unless the present thread is running
+    TRACE_BEGIN("main: draw");
+    SDL_Surface* draw_surface = present_begin_frame(hw_surface);
+    render_begin_frame();
+
+    // Clear screen
+    render_fill(NULL, black);
+
+    // Draw a green square
+    SDL_Rect draw_rect = {.x=70, .y=70, .w=100, .h=100};
+    render_fill(&draw_rect, green);
+
+    // Redraw what changed, and update draw_surface
+    render_end_frame(draw_surface);
+
+    // Nothing redrawn, let the present filter skip it without hashing
+    if(!render_last_frame_changed()){
+        present_frame_unchanged();
+    }
+
+    TRACE_END("main: draw");
+
+    // Flip the screen buffer (or hand it to the present thread, without waiting)
+    TRACE_BEGIN("main: present");
+    present_end_frame(hw_surface);
+    TRACE_END("main: present");
+}
+
 // ** INSTANT RELOAD INTEGRATION **
 void handle_sigusr1(int sig)
 {
@@ -22,10 +179,25 @@ void handle_sigusr1(int sig)
     // Otherwise we'll never process the bool below, which is in the application main loop
 	stop_menu_loop = 1;
 
-	/* Signal to quick save and poweroff after next loop */
+	/* Signal to quick save and poweroff after next loop, the deadline starts now */
+	quick_save_signal();
 	should_quick_save = 1;
 }
 
+// ** SAVE BENCH ** - Drives the menu like a user would, the menu only polls events between its frames
+static int save_bench_keys(void *data)
+{
+    static const SDLKey keys[] = {SDLK_ESCAPE, SDLK_DOWN, SDLK_DOWN, SDLK_a, SDLK_a};
+    for(int i = 0; i < (int)(sizeof(keys)/sizeof(keys[0])); i++){
+        SDL_Delay(SAVE_BENCH_KEY_DELAY_MS);
+        SDL_Event key_event = {0};
+        key_event.type = SDL_KEYDOWN;
+        key_event.key.keysym.sym = keys[i];
+        SDL_PushEvent(&key_event);
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {  
     //
@@ -42,17 +214,61 @@ int main(int argc, char *argv[])
 
     int quit_main_loop = 0;
     SDL_Event event;
-    uint32_t prev_ms = SDL_GetTicks();
-    uint32_t cur_ms = SDL_GetTicks();
+
+    // ** INSTANT PLAY CHECK ** - FUNKEY_INSTANT_PLAY_RECORD=<file> writes the record a quick save would
+    // write for this command line and exits, see tools/instant-play-compare.sh
+    if(getenv("FUNKEY_INSTANT_PLAY_RECORD")){
+        const char *instant_play_args[] = {argv[0], "-loadStateFile", QUICK_SAVE_PATH};
+        return instant_play_write(getenv("FUNKEY_INSTANT_PLAY_RECORD"), 3, instant_play_args)?1:0;
+    }
+
+    // ** INTEGRITY CHECK ** - Selects the CRC32C kernel before pool threads and forked saves use it
+    // FUNKEY_CRC32C_BENCH=<file> prints read and CRC32C throughputs on that file (e.g. a multi-MB state) and exits
+    int nb_self_test_errors = init_crc32c();
+    if(getenv("FUNKEY_CRC32C_BENCH")){
+        return crc32c_bench_file(getenv("FUNKEY_CRC32C_BENCH"))?1:0;
+    }
+
+    // ** SELF TEST ** - FUNKEY_SELF_TEST=1 runs the kernel self-tests built in (make check) and exits, 1 on a mismatch
+    if(getenv("FUNKEY_SELF_TEST")){
+        nb_self_test_errors += init_blit_kernels();
+        return nb_self_test_errors?1:0;
+    }
+
+    // Stand-in app state, written to so it's resident like an emulator's RAM (forking pays for it)
+    // FUNKEY_APP_STATE_KB=<kb> sets its size, FUNKEY_SAVE_DIR=<dir> where save slots are written
+    if(getenv("FUNKEY_APP_STATE_KB") && atoi(getenv("FUNKEY_APP_STATE_KB")) > 0){
+        app_ram_size = (size_t)atoi(getenv("FUNKEY_APP_STATE_KB"))*1024;
+    }
+    app_ram = (uint8_t*) malloc(app_ram_size);
+    if(app_ram == NULL){
+        printf("ERROR Could not allocate %zu bytes of app state\n", app_ram_size);
+        return 1;
+    }
+    memset(app_ram, 0, app_ram_size);
+    if(getenv("FUNKEY_SAVE_DIR")){
+        save_slot_dir = getenv("FUNKEY_SAVE_DIR");
+    }
 
 	/* Init USR1 Signal (for quick save and poweroff) */
 	signal(SIGUSR1, handle_sigusr1);
 
+    // ** TRACE INTEGRATION ** - Optional, records trace points into a ring buffer
+    // Dumped as Chrome trace JSON to the given file on SIGUSR2 (see trace_poll()) and at exit
+    if(getenv("FUNKEY_TRACE")){
+        init_trace(getenv("FUNKEY_TRACE"));
+    }
+    TRACE_BEGIN("init");
+
     // Init SDL Video
+    TRACE_BEGIN("SDL_Init");
     SDL_Init(SDL_INIT_VIDEO);
+    TRACE_END("SDL_Init");
 
     // Open HW screen and set video mode 240x240, with double buffering 
+    TRACE_BEGIN("SDL_SetVideoMode");
     SDL_Surface* hw_surface = SDL_SetVideoMode(240, 240, 32, SDL_HWSURFACE | SDL_DOUBLEBUF | SDL_FULLSCREEN);
+    TRACE_END("SDL_SetVideoMode");
 
     // Hide the cursor, FunKey doesn't come with a mouse
     SDL_ShowCursor(0);
@@ -61,13 +277,121 @@ int main(int argc, char *argv[])
     // Also pre-renders all non-dynamic elements of each menu page, trying to reduce dynamic rendering
     // Should be placed after SDL_Init, and also requires the main SDL_Surface to be accessible
     // TTF_Init() should probably move within init_menu_SDL(), wrapped in a TTF_WasInit() guard?
+    TRACE_BEGIN("TTF_Init");
     TTF_Init();
+    TRACE_END("TTF_Init");
+
+    // ** REWIND INTEGRATION ** - Optional, keeps a history of recent states in memory
+    // Must be initialized before the menu, which then shows its REWIND zone
+    if(getenv("FUNKEY_REWIND")){
+        init_rewind(app_ram_size, REWIND_ARENA_SIZE, REWIND_CAPTURE_INTERVAL, FPS_GAME,
+            save_app_state, load_app_state);
+    }
+
+    // ** THREAD POOL INTEGRATION ** - Workers for the menu's asset loading and background tasks
+    // One per CPU but this one by default, FUNKEY_POOL_THREADS=<n> overrides it (0 runs tasks inline)
+    init_thread_pool(getenv("FUNKEY_POOL_THREADS")?atoi(getenv("FUNKEY_POOL_THREADS")):-1);
+
+    // ** INSTANT RELOAD INTEGRATION ** - Buffers for the quick save are allocated now, not on SIGUSR1
+    // FUNKEY_QUICK_SAVE_DEADLINE_MS changes the time budget, FUNKEY_QUICK_SAVE_DELAY_MS simulates slow storage,
+    // FUNKEY_QUICK_SAVE_DRY_RUN keeps the app running
+    init_quick_save(QUICK_SAVE_PATH, QUICK_SAVE_THUMB_PATH, app_ram_size, save_app_state,
+        getenv("FUNKEY_QUICK_SAVE_DEADLINE_MS")?atoi(getenv("FUNKEY_QUICK_SAVE_DEADLINE_MS")):QUICK_SAVE_DEADLINE_MS);
+    if(getenv("FUNKEY_QUICK_SAVE_DELAY_MS")){
+        quick_save_set_write_delay(atoi(getenv("FUNKEY_QUICK_SAVE_DELAY_MS")));
+    }
+    if(getenv("FUNKEY_QUICK_SAVE_DRY_RUN")){
+        quick_save_set_dry_run(1);
+    }
+
+    // ** MENU PINNING INTEGRATION ** - Optional, faults in and locks the menu's memory and assets at init
+    // Trades a few hundred KB of locked RAM for a first menu open without page faults
+    if(getenv("FUNKEY_MENU_PIN")){
+        menu_set_pin_resources(1);
+    }
+
+    // ** NOTIFICATION INTEGRATION ** - The menu's toasts are drawn by present_end_frame() instead of `notif set`
+    // Must be initialized before the menu, which gives it its font. FUNKEY_NOTIF_SHELL=1 keeps the shell command
+    if(!getenv("FUNKEY_NOTIF_SHELL")){
+        init_notif(hw_surface);
+    }
+
+    // ** QUICK MENU INTEGRATION ** - FUNKEY_MENU_RESOURCES=<dir> loads the fonts and images from there
+    // instead of /usr/games/menu_resources (e.g. stand-ins on a desktop, see tools/startup-bench.py)
+    if(getenv("FUNKEY_MENU_RESOURCES")){
+        menu_set_resources_dir(getenv("FUNKEY_MENU_RESOURCES"));
+    }
+
     init_menu_SDL(hw_surface);
 
+    // MENU INTEGRATION - Saving from the menu, FUNKEY_SAVE_FORK=1 writes saves from a forked child
+    // so the app resumes right away, menu_poll() then collects the result and shows the notification
+    menu_set_save_slot(save_app_slot, getenv("FUNKEY_SAVE_FORK") != NULL);
+
+    // MENU INTEGRATION - Loading from the menu, the highlighted slot is read ahead while the user decides
+    // Buffer fits a raw quick save, the largest file. FUNKEY_LOAD_PREFETCH=0 reads on confirm instead
+    menu_set_load_slot(app_slot_path, load_app_slot, sizeof(crc32c_header_t) + sizeof(quick_save_header_t) + app_ram_size,
+        getenv("FUNKEY_LOAD_PREFETCH")?atoi(getenv("FUNKEY_LOAD_PREFETCH")):1);
+
+    // ** PRESENT THREAD INTEGRATION ** - Optional, moves SDL_Flip() to its own thread with triple buffering
+    // Draw into present_begin_frame() and call present_end_frame() instead of SDL_Flip(), which works either way
+    if(getenv("FUNKEY_PRESENT_THREAD")){
+        init_present_thread(hw_surface);
+    }
+
+    // ** PRESENT SHADOW INTEGRATION ** - Optional, render in RAM and copy to the screen on present
+    // The menu then snapshots the last frame without reading back from video memory
+    // Apps with their own software frame can pass it to menu_set_app_frame() instead
+    else if(getenv("FUNKEY_PRESENT_SHADOW")){
+        init_present_shadow(hw_surface);
+    }
+
+    // ** FRAME CAPTURE INTEGRATION ** - Optional, records every presented frame (app and menu) to a file
+    // Convert the recording with tools/capture-convert.py
+    if(getenv("FUNKEY_CAPTURE")){
+        init_frame_capture(hw_surface, getenv("FUNKEY_CAPTURE"));
+    }
+
+    // ** PRESENT FILTER INTEGRATION ** - Optional, skips presenting frames identical to the last one
+    // Value is the max nb of frames skipped in a row, the frame is presented anyway after that
+    if(getenv("FUNKEY_PRESENT_FILTER")){
+        present_set_filter(atoi(getenv("FUNKEY_PRESENT_FILTER")));
+    }
+
+    // ** RENDERER INTEGRATION ** - Submit draw commands instead of drawing directly
+    // Only what changed since the previous frame is redrawn and copied to the surface
+    init_renderer(hw_surface);
+
+    // ** RUNLOOP INTEGRATION ** - Updates at exactly FPS_GAME, renders skipped (up to a max in a row) when behind
+    // FUNKEY_RUNLOOP_MAX_SKIP=<n> changes the max (0 never skips), FUNKEY_RUNLOOP_LOAD_US=<us> adds CPU load to renders
+    init_runloop(FPS_GAME, getenv("FUNKEY_RUNLOOP_MAX_SKIP")?atoi(getenv("FUNKEY_RUNLOOP_MAX_SKIP")):RUNLOOP_DEFAULT_MAX_SKIP,
+        update_app, render_app, hw_surface);
+    if(getenv("FUNKEY_RUNLOOP_LOAD_US")){
+        runloop_set_render_load(atoi(getenv("FUNKEY_RUNLOOP_LOAD_US")));
+    }
+    TRACE_END("init");
+
+    // ** STARTUP BENCH ** - FUNKEY_STARTUP_BENCH=1 (with FUNKEY_TRACE) marks the first frame, opens the menu
+    // with an injected ESC, closes it after its first frame and exits, see tools/startup-bench.py
+    int startup_bench = (getenv("FUNKEY_STARTUP_BENCH") != NULL);
+    int first_frame_shown = 0;
+
+    // ** SAVE BENCH ** - FUNKEY_SAVE_BENCH=1 (with FUNKEY_TRACE) saves in the current slot from the menu once the
+    // first frame is flipped, then exits once the save is written, see tools/save-bench.py
+    int save_bench = (getenv("FUNKEY_SAVE_BENCH") != NULL);
+    SDL_Thread *save_bench_thread = NULL;
+
     //Main loop
     while(!quit_main_loop)
     {
+        // Dump trace if requested by SIGUSR2
+        trace_poll();
+
+        // Collect background saves started from the menu
+        menu_poll();
+
         // Process event queue
+        TRACE_BEGIN("main: events");
         while(SDL_PollEvent(&event))
         {
             switch(event.type)
@@ -85,7 +409,16 @@ int main(int argc, char *argv[])
                             // ** QUICK MENU INTEGRATION ** - Start the menu update, effectively pausing the main loop
                             // Handles input events, scrolling anim, and rendering of dynamic elements if needed
                             // Hook this up to a press of the Q or ESC key in however the app processes inputs
+                            // The runloop is paused meanwhile, so updates don't try to catch up on the time spent in it
+                            runloop_pause();
                             run_menu_loop();
+                            runloop_resume();
+                            if(startup_bench || save_bench){
+                                quit_main_loop = 1;
+                            }
+
+                            // ** RENDERER INTEGRATION ** - The menu drew over our frames, redraw everything
+                            render_invalidate();
                             break;
 
                         default:
@@ -96,35 +429,62 @@ int main(int argc, char *argv[])
             }
         }
 
-        // Limit frame rate
-        cur_ms = SDL_GetTicks();
-        if(cur_ms-prev_ms < 1000/FPS_GAME){
-            SDL_Delay(1000/FPS_GAME - (cur_ms-prev_ms));
-        }
-        prev_ms = SDL_GetTicks();
-
-        // Clear screen
-        SDL_FillRect(hw_surface, NULL, 0x000000);
-
-        // Draw a green square
-        SDL_Rect draw_rect = {.x=70, .y=70, .w=100, .h=100};
-        Uint32 color = SDL_MapRGB(hw_surface->format, 0, 255, 0);
-        SDL_FillRect(hw_surface, &draw_rect, color);
+        TRACE_END("main: events");
 
-        // Flip the screen buffer
-        SDL_Flip(hw_surface);
+        // ** RUNLOOP INTEGRATION ** - Wait for the next update, run the updates due and render once
+        runloop_step();
 
+        // ** STARTUP BENCH ** - Once the first frame is flipped: ESC opens the menu, the second one closes it
+        // The menu only polls events after drawing its first frame
+        if(startup_bench && !first_frame_shown){
+            runloop_stats_t runloop_stats;
+            runloop_get_stats(&runloop_stats);
+            if(runloop_stats.nb_renders){
+                TRACE_INSTANT("main: first frame");
+                first_frame_shown = 1;
+                SDL_Event key_event = {0};
+                key_event.type = SDL_KEYDOWN;
+                key_event.key.keysym.sym = SDLK_ESCAPE;
+                SDL_PushEvent(&key_event);
+                SDL_PushEvent(&key_event);
+            }
+        }
+        if(save_bench && !save_bench_thread){
+            runloop_stats_t runloop_stats;
+            runloop_get_stats(&runloop_stats);
+            if(runloop_stats.nb_renders){
+                save_bench_thread = SDL_CreateThread(save_bench_keys, NULL);
+            }
+        }
 
         // ** INSTANT RELOAD INTEGRATION **
         if (should_quick_save)
         {
-            //quick_save_and_poweroff();
+            // Doesn't return, unless on a dry run or if powering down failed
+            quick_save_and_poweroff(argv[0], present_last_frame(hw_surface));
+            should_quick_save = 0;
         }
     }
 
-    // ** QUICK MENU INTEGRATION ** - Standard shutdown, deallocating ttf/image assets
+    if(save_bench_thread){
+        SDL_WaitThread(save_bench_thread, NULL);
+    }
+
+    // ** QUICK MENU INTEGRATION ** - Standard shutdown, deallocating ttf/image assets, after background saves
     // If we do move TTF_Init() into the menu init, cache off and shutdown that in here as well
     deinit_menu_SDL();
+    deinit_thread_pool();
+
+    // ** PRESENT THREAD INTEGRATION ** - Stops the thread if running, and prints present jitter either way
+    deinit_present_thread();
+    deinit_present_shadow();
+    deinit_frame_capture();
+    deinit_runloop();
+    deinit_renderer();
+    deinit_notif();
+    deinit_rewind();
+    deinit_quick_save();
+    free(app_ram);
 
     SDL_Quit();
     return 0;
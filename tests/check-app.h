@@ -0,0 +1,16 @@
+/*
+ * check-app.h
+ * Globals src/funkey expects from the app (see src/main.c), for checks linked without it
+ *
+ * Include from the check's .c file, once. No config file is read or written.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_CHECK_APP_H
+#define FUNKEY_CHECK_APP_H
+
+int saveslot = 0;
+char *cfg_file_rom = NULL;
+
+#endif //FUNKEY_CHECK_APP_H
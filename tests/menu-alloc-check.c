@@ -0,0 +1,46 @@
+/*
+ * menu-alloc-check.c
+ * Check that steady-state menu frames make no heap calls
+ *
+ * Built with MENU_ALLOC_CHECK (make check): run_menu_loop() counts the frames
+ * whose menu_screen_refresh() called malloc/calloc/realloc/free on the UI
+ * thread. Every zone is visited and its value changed both ways, with single
+ * and chained scroll transitions, then the menu is closed. Fails if any frame
+ * allocated, or if no frame was drawn at all.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include "menu-check.h"
+
+#define KEY_DELAY_MS                100
+#define TRANSITION_DELAY_MS         400                         /* Longer than a scroll transition */
+#define NB_ZONES_VISITED            NB_MENU_TYPES               /* Wraps around to the first zone */
+
+int main(){
+#ifndef MENU_ALLOC_CHECK
+    printf("menu-alloc-check: built without MENU_ALLOC_CHECK, nothing to check (make check defines it)\n");
+    return 1;
+#endif //MENU_ALLOC_CHECK
+
+    /// ------ RIGHT and LEFT on every zone, then DOWN, then two chained UPs and a close ------
+    menu_check_key_t keys[3*NB_ZONES_VISITED + 3];
+    int nb_keys = 0;
+    for(int i = 0; i < NB_ZONES_VISITED; i++){
+        keys[nb_keys++] = (menu_check_key_t){SDLK_RIGHT, i?TRANSITION_DELAY_MS:KEY_DELAY_MS};
+        keys[nb_keys++] = (menu_check_key_t){SDLK_LEFT, KEY_DELAY_MS};
+        keys[nb_keys++] = (menu_check_key_t){SDLK_DOWN, KEY_DELAY_MS};
+    }
+    keys[nb_keys++] = (menu_check_key_t){SDLK_UP, TRANSITION_DELAY_MS};
+    keys[nb_keys++] = (menu_check_key_t){SDLK_UP, 20};
+    keys[nb_keys++] = (menu_check_key_t){SDLK_ESCAPE, 2*TRANSITION_DELAY_MS};
+
+    init_menu_check();
+    run_menu_check(keys, nb_keys);
+    menu_stats_t stats;
+    menu_get_stats(&stats);
+    deinit_menu_check();
+
+    printf("menu-alloc-check: %d frames, %d with heap calls\n", stats.nb_frames, stats.nb_alloc_frames);
+    return (stats.nb_frames && !stats.nb_alloc_frames)?0:1;
+}
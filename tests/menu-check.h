@@ -0,0 +1,81 @@
+/*
+ * menu-check.h
+ * Shared setup of the menu checks: the menu on a 240x240 screen, driven by injected keys
+ *
+ * Checks run under SDL's dummy video driver, with stand-in menu resources and
+ * shell commands, see tools/check.py. Keys are pushed with SDL_PushEvent()
+ * from a thread, at set intervals, while run_menu_loop() runs as in the app.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#ifndef FUNKEY_MENU_CHECK_H
+#define FUNKEY_MENU_CHECK_H
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "funkey/sdl-menu.h"
+#include "funkey/thread-pool.h"
+#include "check-app.h"
+
+typedef struct{
+    SDLKey sym;
+    int delay_ms;                                               /* After the previous key (or the menu opening) */
+} menu_check_key_t;
+
+static const menu_check_key_t *menu_check_keys = NULL;
+static int nb_menu_check_keys = 0;
+
+static SDL_Surface *init_menu_check(){
+    if(SDL_Init(SDL_INIT_VIDEO)){
+        printf("ERROR SDL_Init: %s\n", SDL_GetError());
+        exit(1);
+    }
+    SDL_Surface *screen = SDL_SetVideoMode(240, 240, 32, SDL_HWSURFACE | SDL_DOUBLEBUF);
+    if(screen == NULL){
+        printf("ERROR SDL_SetVideoMode: %s\n", SDL_GetError());
+        exit(1);
+    }
+    TTF_Init();
+    init_thread_pool(-1);
+    if(getenv("FUNKEY_MENU_RESOURCES")){
+        menu_set_resources_dir(getenv("FUNKEY_MENU_RESOURCES"));
+    }
+    init_menu_SDL(screen);
+    return screen;
+}
+
+static void deinit_menu_check(){
+    deinit_menu_SDL();
+    deinit_thread_pool();
+    SDL_Quit();
+}
+
+static void push_menu_check_key(SDLKey sym){
+    SDL_Event event = {0};
+    event.type = SDL_KEYDOWN;
+    event.key.keysym.sym = sym;
+    SDL_PushEvent(&event);
+}
+
+static int menu_check_keys_thread(void *data){
+    for(int i = 0; i < nb_menu_check_keys; i++){
+        SDL_Delay(menu_check_keys[i].delay_ms);
+        push_menu_check_key(menu_check_keys[i].sym);
+    }
+    return 0;
+}
+
+/* Run the menu while keys are pressed, returns once it's closed: the last key should be SDLK_ESCAPE */
+static void run_menu_check(const menu_check_key_t *keys, int nb_keys){
+    menu_check_keys = keys;
+    nb_menu_check_keys = nb_keys;
+    SDL_Thread *keys_thread = SDL_CreateThread(menu_check_keys_thread, NULL);
+    run_menu_loop();
+    SDL_WaitThread(keys_thread, NULL);
+}
+
+#endif //FUNKEY_MENU_CHECK_H
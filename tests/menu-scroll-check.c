@@ -0,0 +1,59 @@
+/*
+ * menu-scroll-check.c
+ * Check that UP/DOWN presses queued during a scroll transition chain into the next one
+ *
+ * From the VOLUME zone, presses are pushed faster than a transition lasts:
+ * three DOWNs (one transition, then one chained over two zones), an UP on
+ * its own, then DOWN and UP (one transition, then one chained back). The
+ * menu must end on the SAVE zone, after 5 transitions of which 2 chained,
+ * and each zone must show within NAV_LATENCY_MAX_MS of its last press.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include "menu-check.h"
+
+#define SCROLL_DURATION_MS          160                         /* As in sdl-menu.c, at FPS_MENU */
+#define CHAIN_DELAY_MS              20                          /* Within a transition */
+#define TRANSITION_DELAY_MS         400                         /* Longer than a transition */
+#define NAV_LATENCY_MAX_MS          (2*SCROLL_DURATION_MS + 100)/* Rest of a transition, the chained one, and some frames */
+
+#define NB_TRANSITIONS              5
+#define NB_CHAINED_TRANSITIONS      2
+
+int main(){
+    const menu_check_key_t keys[] = {
+        {SDLK_DOWN, TRANSITION_DELAY_MS},
+        {SDLK_DOWN, CHAIN_DELAY_MS},
+        {SDLK_DOWN, CHAIN_DELAY_MS},
+        {SDLK_UP, TRANSITION_DELAY_MS},
+        {SDLK_DOWN, TRANSITION_DELAY_MS},
+        {SDLK_UP, CHAIN_DELAY_MS},
+        {SDLK_ESCAPE, TRANSITION_DELAY_MS},
+    };
+
+    init_menu_check();
+    run_menu_check(keys, sizeof(keys)/sizeof(keys[0]));
+    menu_stats_t stats;
+    menu_get_stats(&stats);
+    deinit_menu_check();
+
+    printf("menu-scroll-check: zone %d -> %d, %d transitions (%d chained), press to zone shown in %lluus at most\n",
+        stats.open_zone, stats.zone, stats.nb_transitions, stats.nb_chained_transitions,
+        (unsigned long long)stats.max_nav_latency_us);
+
+    int res = 0;
+    if(stats.open_zone != MENU_TYPE_VOLUME || stats.zone != MENU_TYPE_SAVE){
+        printf("ERROR expected zone %d -> %d\n", MENU_TYPE_VOLUME, MENU_TYPE_SAVE);
+        res = 1;
+    }
+    if(stats.nb_transitions != NB_TRANSITIONS || stats.nb_chained_transitions != NB_CHAINED_TRANSITIONS){
+        printf("ERROR expected %d transitions (%d chained)\n", NB_TRANSITIONS, NB_CHAINED_TRANSITIONS);
+        res = 1;
+    }
+    if(!stats.max_nav_latency_us || stats.max_nav_latency_us > NAV_LATENCY_MAX_MS*1000ULL){
+        printf("ERROR expected press to zone shown within %dms\n", NAV_LATENCY_MAX_MS);
+        res = 1;
+    }
+    return res;
+}
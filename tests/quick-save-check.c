@@ -0,0 +1,114 @@
+/*
+ * quick-save-check.c
+ * Check the quick save fallback levels, and that the rename leaves only a good save
+ *
+ * Dry runs of quick_save_and_poweroff() (no Instant Play record, no powerdown)
+ * of a 1MB state that doesn't compress, in the working directory:
+ *   - fast storage and time to spare:            QUICK_SAVE_FULL, with a thumbnail
+ *   - slow storage (write delay) eating the time: QUICK_SAVE_NO_THUMBNAIL
+ *   - too little time to even compress:          QUICK_SAVE_RAW_STATE
+ * Each one must reach its level, leave a save that loads back to the state
+ * just saved, a thumbnail only if the level has one, and no temporary file.
+ * Attempts are logged in the working directory too.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <SDL/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "funkey/quick-save.h"
+#include "check-app.h"
+
+#define STATE_SIZE                  (1024*1024)
+#define SAVE_PATH                   "quick-save-check.state"
+#define SAVE_TMP_PATH               SAVE_PATH ".tmp"
+#define THUMBNAIL_PATH              "quick-save-check.thumb"
+#define LOG_PATH                    "quick-save-check.log"
+
+typedef struct{
+    const char *name;
+    int write_delay_ms;                                         /* Before each 64KB write() */
+    int deadline_ms;                                            /* 300ms of which kept for the powerdown */
+    ENUM_QUICK_SAVE_LEVEL level;
+} quick_save_check_t;
+
+static const quick_save_check_t checks[] = {
+    {"fast storage", 0, 2000, QUICK_SAVE_FULL},
+    {"slow storage", 100, 2000, QUICK_SAVE_NO_THUMBNAIL},         /* 18 writes: no time left for the thumbnail */
+    {"short deadline", 0, 400, QUICK_SAVE_RAW_STATE},
+};
+
+static uint8_t *state = NULL;
+static uint8_t *loaded = NULL;
+
+static void save_state(void *buf, size_t size){
+    memcpy(buf, state, size);
+}
+
+/* Different each time, so a save left over from the previous check doesn't pass */
+static void fill_state(uint32_t seed){
+    for(size_t i = 0; i < STATE_SIZE; i++){
+        seed = seed*1103515245 + 12345;
+        state[i] = seed >> 24;
+    }
+}
+
+static int run_check(const quick_save_check_t *check, SDL_Surface *frame, int index){
+    int res = 0;
+    fill_state(index + 1);
+    unlink(THUMBNAIL_PATH);
+
+    if(init_quick_save(SAVE_PATH, THUMBNAIL_PATH, STATE_SIZE, save_state, check->deadline_ms)){
+        return 1;
+    }
+    quick_save_set_dry_run(1);
+    quick_save_set_log_path(LOG_PATH);
+    quick_save_set_write_delay(check->write_delay_ms);
+    quick_save_signal();
+    int level = quick_save_and_poweroff("quick-save-check", frame);
+    deinit_quick_save();
+
+    printf("quick-save-check: %s (%dms write delay, %dms deadline): level %d\n",
+        check->name, check->write_delay_ms, check->deadline_ms, level);
+    if(level != (int)check->level){
+        printf("ERROR expected level %d\n", check->level);
+        res = 1;
+    }
+    if(quick_save_load_state(SAVE_PATH, loaded, STATE_SIZE) || memcmp(loaded, state, STATE_SIZE)){
+        printf("ERROR %s doesn't load back to the state saved\n", SAVE_PATH);
+        res = 1;
+    }
+    if(!access(SAVE_TMP_PATH, F_OK)){
+        printf("ERROR %s left behind the rename\n", SAVE_TMP_PATH);
+        res = 1;
+    }
+    if(!access(THUMBNAIL_PATH, F_OK) != (check->level < QUICK_SAVE_NO_THUMBNAIL)){
+        printf("ERROR expected %s thumbnail\n", (check->level < QUICK_SAVE_NO_THUMBNAIL)?"a":"no");
+        res = 1;
+    }
+    return res;
+}
+
+int main(){
+    state = (uint8_t*) malloc(STATE_SIZE);
+    loaded = (uint8_t*) malloc(STATE_SIZE);
+    SDL_Surface *frame = SDL_CreateRGBSurface(SDL_SWSURFACE, 240, 240, 32, 0, 0, 0, 0);
+    if(state == NULL || loaded == NULL || frame == NULL){
+        printf("ERROR quick-save-check: Could not allocate\n");
+        return 1;
+    }
+
+    int res = 0;
+    for(int i = 0; i < (int)(sizeof(checks)/sizeof(checks[0])); i++){
+        res |= run_check(&checks[i], frame, i);
+    }
+
+    SDL_FreeSurface(frame);
+    free(loaded);
+    free(state);
+    return res;
+}
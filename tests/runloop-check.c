@@ -0,0 +1,63 @@
+/*
+ * runloop-check.c
+ * Check that the fixed-timestep loop holds its update rate when rendering is over the frame budget
+ *
+ * Renders are loaded with runloop_set_render_load() to 1.5 times the update
+ * period, for a few seconds. Updates must still run at UPDATE_HZ within
+ * RATE_TOLERANCE_PERCENT, with renders skipped instead (one in 3, some slack
+ * kept) and no update dropped.
+ *
+ * Licensed under the GPLv2, or later.
+ */
+
+#include <stdio.h>
+
+#include "funkey/runloop.h"
+#include "check-app.h"
+
+#define UPDATE_HZ                   60
+#define RENDER_LOAD_US              (1500000/UPDATE_HZ)         /* 25ms, a frame is 16.7ms */
+#define RUN_US                      3000000
+#define RATE_TOLERANCE_PERCENT      2
+
+static void update(void *data){
+}
+
+static void render(void *data){
+}
+
+int main(){
+    if(init_runloop(UPDATE_HZ, RUNLOOP_DEFAULT_MAX_SKIP, update, render, NULL)){
+        return 1;
+    }
+    runloop_set_render_load(RENDER_LOAD_US);
+
+    runloop_stats_t stats;
+    do{
+        runloop_step();
+        runloop_get_stats(&stats);
+    } while(stats.running_us < RUN_US);
+    deinit_runloop();
+
+    double update_hz = stats.nb_updates * 1e6 / stats.running_us;
+    double render_hz = stats.nb_renders * 1e6 / stats.running_us;
+    printf("runloop-check: %d updates (%.2fHz), %d renders (%.2fHz) of %dus over %.2fs, %d updates dropped\n",
+        stats.nb_updates, update_hz, stats.nb_renders, render_hz, RENDER_LOAD_US, stats.running_us/1e6,
+        stats.nb_updates_dropped);
+
+    int res = 0;
+    if(update_hz < UPDATE_HZ*(100-RATE_TOLERANCE_PERCENT)/100.0 ||
+        update_hz > UPDATE_HZ*(100+RATE_TOLERANCE_PERCENT)/100.0){
+        printf("ERROR expected %dHz updates within %d%%\n", UPDATE_HZ, RATE_TOLERANCE_PERCENT);
+        res = 1;
+    }
+    if(stats.nb_renders > stats.nb_updates*3/4){
+        printf("ERROR expected about one render skipped every 3 updates\n");
+        res = 1;
+    }
+    if(stats.nb_updates_dropped){
+        printf("ERROR expected no update dropped\n");
+        res = 1;
+    }
+    return res;
+}
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+capture-convert.py
+Converts a frame capture (FUNKEY_CAPTURE, see src/funkey/frame-capture.h)
+to a PNG sequence, or to a video through ffmpeg.
+
+  capture-convert.py capture.bin png out_dir/
+  capture-convert.py capture.bin video out.mp4 [--fps 50]
+
+Dropped frames (gaps in frame_idx) are filled with the previous frame in
+videos, so playback keeps the original timing.
+
+Licensed under the GPLv2, or later.
+"""
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import zlib
+
+HEADER = struct.Struct('<8sHHB3xIII')
+FRAME = struct.Struct('<QII')
+MAGIC = b'FKCAPTR1'
+
+
+def read_capture(path):
+    with open(path, 'rb') as f:
+        magic, width, height, bpp, rmask, gmask, bmask = HEADER.unpack(f.read(HEADER.size))
+        if magic != MAGIC:
+            sys.exit('%s: not a frame capture' % path)
+        masks = (rmask, gmask, bmask)
+        yield width, height, bpp, masks
+        while True:
+            data = f.read(FRAME.size)
+            if len(data) < FRAME.size:
+                break
+            timestamp_us, frame_idx, size = FRAME.unpack(data)
+            pixels = f.read(size)
+            if len(pixels) < size:
+                break
+            yield timestamp_us, frame_idx, pixels
+
+
+def channel(value, mask):
+    if not mask:
+        return 0
+    shift = (mask & -mask).bit_length() - 1
+    bits = bin(mask).count('1')
+    return ((value & mask) >> shift) * 255 // ((1 << bits) - 1)
+
+
+def to_rgb24(pixels, width, height, bpp, masks):
+    if bpp == 4 and masks == (0xff0000, 0x00ff00, 0x0000ff):
+        # Fast path for XRGB8888, little endian pixels are B, G, R, X
+        out = bytearray(width * height * 3)
+        out[0::3] = pixels[2::4]
+        out[1::3] = pixels[1::4]
+        out[2::3] = pixels[0::4]
+        return bytes(out)
+    out = bytearray()
+    for i in range(0, width * height * bpp, bpp):
+        value = int.from_bytes(pixels[i:i + bpp], 'little')
+        out += bytes(channel(value, m) for m in masks)
+    return bytes(out)
+
+
+def write_png(path, rgb, width, height):
+    def chunk(kind, data):
+        return (struct.pack('>I', len(data)) + kind + data +
+                struct.pack('>I', zlib.crc32(kind + data) & 0xffffffff))
+    stride = width * 3
+    raw = b''.join(b'\x00' + rgb[y * stride:(y + 1) * stride] for y in range(height))
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b'IDAT', zlib.compress(raw, 6)))
+        f.write(chunk(b'IEND', b''))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[1])
+    parser.add_argument('capture')
+    parser.add_argument('format', choices=('png', 'video'))
+    parser.add_argument('output')
+    parser.add_argument('--fps', type=int, default=50)
+    args = parser.parse_args()
+
+    frames = read_capture(args.capture)
+    width, height, bpp, masks = next(frames)
+
+    ffmpeg = None
+    if args.format == 'png':
+        os.makedirs(args.output, exist_ok=True)
+    else:
+        ffmpeg = subprocess.Popen(['ffmpeg', '-y', '-loglevel', 'error', '-f', 'rawvideo',
+                                   '-pix_fmt', 'rgb24', '-s', '%dx%d' % (width, height),
+                                   '-r', str(args.fps), '-i', '-', '-pix_fmt', 'yuv420p',
+                                   args.output], stdin=subprocess.PIPE)
+
+    nb_frames = nb_dropped = 0
+    prev_idx = prev_rgb = None
+    for timestamp_us, frame_idx, pixels in frames:
+        rgb = to_rgb24(pixels, width, height, bpp, masks)
+        if prev_idx is not None and frame_idx > prev_idx + 1:
+            nb_dropped += frame_idx - prev_idx - 1
+            if ffmpeg:
+                for _ in range(frame_idx - prev_idx - 1):
+                    ffmpeg.stdin.write(prev_rgb)
+        if ffmpeg:
+            ffmpeg.stdin.write(rgb)
+        else:
+            write_png(os.path.join(args.output, 'frame_%06d_%dus.png' % (frame_idx, timestamp_us)),
+                      rgb, width, height)
+        prev_idx, prev_rgb = frame_idx, rgb
+        nb_frames += 1
+
+    if ffmpeg:
+        ffmpeg.stdin.close()
+        ffmpeg.wait()
+    print('%d frames converted, %d dropped during capture' % (nb_frames, nb_dropped))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+check.py
+Run the checks built from tests/ by `make check`, each one a program
+exiting non-zero on failure.
+
+  check.py build/check/tests/<check> [...]
+
+Each check runs under SDL's dummy video driver, with stand-in menu resources
+and shell commands (see funkey_env.py), in its own temporary directory as
+working directory for the files it writes. Their output is printed as they
+run, then a summary. Exits 1 if any check failed.
+
+Licensed under the GPLv2, or later.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+from funkey_env import make_env
+
+CHECK_TIMEOUT_S = 120
+
+
+def run_check(path, env, work_dir):
+    name = os.path.basename(path)
+    print('--- %s' % name, flush=True)
+    start = time.monotonic()
+    try:
+        res = subprocess.run([os.path.abspath(path)], env=env, cwd=work_dir, timeout=CHECK_TIMEOUT_S).returncode
+    except subprocess.TimeoutExpired:
+        print('%s: timed out after %ds' % (name, CHECK_TIMEOUT_S))
+        res = -1
+    print('--- %s %s in %.1fs' % (name, 'passed' if res == 0 else 'FAILED (%d)' % res, time.monotonic() - start),
+          flush=True)
+    return res == 0
+
+
+def main():
+    checks = sys.argv[1:]
+    if not checks:
+        sys.exit('usage: check.py <check> [...]')
+
+    failed = []
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        env = make_env(tmp_dir)
+        for path in checks:
+            work_dir = tempfile.mkdtemp(dir=tmp_dir)
+            if not run_check(path, env, work_dir):
+                failed.append(os.path.basename(path))
+
+    print('%d/%d checks passed%s' % (len(checks) - len(failed), len(checks),
+                                     (', failed: ' + ' '.join(failed)) if failed else ''))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,93 @@
+"""
+funkey_env.py
+Stand-ins to run funkey-testapp and its checks on a desktop, shared by the tools
+
+The menu resources are taken from /usr/games/menu_resources when present,
+otherwise stand-ins are made from a system font and flat PNGs
+(FUNKEY_MENU_RESOURCES). The system's shell commands (volume, brightness,
+notif, keymap...) are replaced by no-op stand-ins, first in PATH.
+
+Licensed under the GPLv2, or later.
+"""
+
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import zlib
+
+MENU_RESOURCES_DIR = '/usr/games/menu_resources'        # MENU_RESOURCES_DIR in src/funkey/sdl-menu.c
+MENU_FONTS = ('OpenSans-Bold.ttf', 'OpenSans-Regular.ttf')
+MENU_PNGS = {'zone_bg.png': (180, 140), 'arrow_top.png': (16, 8), 'arrow_bottom.png': (16, 8)}
+SYSTEM_FONTS = (
+    '/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf',
+    '/usr/share/fonts/TTF/DejaVuSans-Bold.ttf',
+    '/usr/share/fonts/dejavu/DejaVuSans-Bold.ttf',
+    '/usr/share/fonts/truetype/liberation/LiberationSans-Bold.ttf',
+)
+
+# Shell commands the menu and the app may run, "get" ones print a value
+STUB_COMMANDS = {
+    'volume': 'if [ "$1" = get ]; then echo 50; fi',
+    'brightness': 'if [ "$1" = get ]; then echo 50; fi',
+    'notif': 'exit 0',
+    'audio_amp': 'exit 0',
+    'keymap': 'exit 0',
+    'powerdown': 'exit 0',
+    'instant_play': 'exit 0',
+}
+
+
+def png(width, height, rgba):
+    def chunk(kind, data):
+        return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data))
+    raw = b''.join(b'\0' + bytes(rgba) * width for _ in range(height))
+    return (b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0)) +
+            chunk(b'IDAT', zlib.compress(raw)) + chunk(b'IEND', b''))
+
+
+def make_resources(tmp_dir):
+    if all(os.path.exists(os.path.join(MENU_RESOURCES_DIR, f)) for f in MENU_FONTS + tuple(MENU_PNGS)):
+        return MENU_RESOURCES_DIR
+    font = next((f for f in SYSTEM_FONTS if os.path.exists(f)), None)
+    if font is None:
+        try:
+            font = subprocess.run(['fc-match', '-f', '%{file}', 'sans:bold'], capture_output=True,
+                                  text=True).stdout.strip() or None
+        except OSError:
+            pass
+    if font is None:
+        sys.exit('No menu resources in %s and no system font to stand in for them' % MENU_RESOURCES_DIR)
+
+    res_dir = os.path.join(tmp_dir, 'menu_resources')
+    os.makedirs(res_dir)
+    for name in MENU_FONTS:
+        shutil.copy(font, os.path.join(res_dir, name))
+    for name, (width, height) in MENU_PNGS.items():
+        with open(os.path.join(res_dir, name), 'wb') as f:
+            f.write(png(width, height, (236, 236, 236, 255)))
+    return res_dir
+
+
+def make_stub_commands(tmp_dir):
+    bin_dir = os.path.join(tmp_dir, 'bin')
+    os.makedirs(bin_dir)
+    for name, body in STUB_COMMANDS.items():
+        path = os.path.join(bin_dir, name)
+        with open(path, 'w') as f:
+            f.write('#!/bin/sh\n%s\n' % body)
+        os.chmod(path, 0o755)
+    return bin_dir
+
+
+def make_env(tmp_dir):
+    """ Environment to run the app (or a check) on a desktop: no screen, stand-in resources and commands """
+    env = dict(os.environ)
+    env.update({
+        'SDL_VIDEODRIVER': 'dummy',
+        'SDL_AUDIODRIVER': 'dummy',
+        'FUNKEY_MENU_RESOURCES': make_resources(tmp_dir),
+        'PATH': make_stub_commands(tmp_dir) + os.pathsep + os.environ.get('PATH', ''),
+    })
+    return env
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# instant-play-compare.sh
+# Checks that the app's native Instant Play record (funkey/instant-play.h) is
+# byte for byte what the instant_play script writes for the same command line.
+#
+#   instant-play-compare.sh [instant_play script] [funkey-testapp]
+#
+# The script runs from a copy with /mnt/ redirected to a scratch directory and
+# the commands it runs after writing the record (pid, powerdown, sync...)
+# replaced by no-ops, so it doesn't shut the console down.
+#
+# Licensed under the GPLv2, or later.
+#
+
+SCRIPT="${1:-$(command -v instant_play)}"
+APP="${2:-./build/funkey-testapp}"
+STATE_PATH="/mnt/funkey-testapp.state"         # QUICK_SAVE_PATH in src/main.c
+
+if [ ! -f "${SCRIPT}" ] || [ ! -x "${APP}" ]; then
+    >&2 echo "Usage: ${0} [instant_play script] [funkey-testapp]"
+    exit 2
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+mkdir -p "${TMP_DIR}/mnt" "${TMP_DIR}/bin"
+
+# No-op stand-ins for everything that would stop the app or the console
+for cmd in pid powerdown shutdown_funkey sync killall kill start-stop-daemon poweroff reboot halt; do
+    printf '#!/bin/sh\nexit 0\n' > "${TMP_DIR}/bin/${cmd}"
+    chmod +x "${TMP_DIR}/bin/${cmd}"
+done
+sed "s|/mnt/|${TMP_DIR}/mnt/|g" "${SCRIPT}" > "${TMP_DIR}/instant_play"
+
+# Same command line for both: argv[0] is the app path as launched
+PATH="${TMP_DIR}/bin:${PATH}" timeout 10 sh "${TMP_DIR}/instant_play" save "${APP}" -loadStateFile "${STATE_PATH}"
+if [ ! -f "${TMP_DIR}/mnt/instant_play" ]; then
+    >&2 echo "The script didn't write ${TMP_DIR}/mnt/instant_play"
+    exit 1
+fi
+FUNKEY_INSTANT_PLAY_RECORD="${TMP_DIR}/native" "${APP}" || exit 1
+
+if cmp "${TMP_DIR}/mnt/instant_play" "${TMP_DIR}/native"; then
+    echo "OK: $(wc -c < "${TMP_DIR}/native") bytes, identical"
+else
+    echo "--- script"; od -c "${TMP_DIR}/mnt/instant_play"
+    echo "--- native"; od -c "${TMP_DIR}/native"
+    exit 1
+fi
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+save-bench.py
+Save benchmark of funkey-testapp: the UI pause on confirming a save from the
+menu, and the time until the slot is written, forked and in place side by side.
+
+  save-bench.py [build/funkey-testapp] [--runs 10] [--state-mb 16]
+
+Each run launches the app under SDL's dummy video driver with
+FUNKEY_SAVE_BENCH=1 and FUNKEY_TRACE (see src/main.c): once its first frame is
+flipped, it opens the menu, goes to the SAVE zone, confirms the save and exits
+once the slot is written. The app state is FUNKEY_APP_STATE_KB, resident, and
+slots are written in a temporary FUNKEY_SAVE_DIR. Runs alternate between
+FUNKEY_SAVE_FORK=1 and saving in place, medians are printed.
+
+The system's shell commands and, unless installed, the menu resources are
+replaced by stand-ins (see funkey_env.py).
+
+Licensed under the GPLv2, or later.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+from funkey_env import make_env
+
+MODES = (
+    ('forked', {'FUNKEY_SAVE_FORK': '1'}),
+    ('in place', {}),
+)
+
+
+def run_once(app, env, trace_path):
+    if os.path.exists(trace_path):
+        os.unlink(trace_path)
+    subprocess.run([app], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=60, check=True)
+    with open(trace_path) as f:
+        return parse_trace(json.load(f))
+
+
+def parse_trace(trace):
+    """ UI pause and confirm to save written, in us """
+    pause_begin = pause_end = collected = None
+    for event in trace['traceEvents']:
+        name, phase, ts = event['name'], event['ph'], event['ts']
+        if name == 'run_menu_loop: save pause':
+            if phase == 'B':
+                pause_begin = ts
+            elif phase == 'E':
+                pause_end = ts
+        elif name == 'menu: background save collected' and phase == 'i':
+            collected = ts
+    if pause_begin is None or pause_end is None:
+        raise ValueError('trace is missing the save pause')
+    # In place, the slot is written when the pause ends
+    written = collected if collected is not None else pause_end
+    return {
+        'UI pause': pause_end - pause_begin,
+        'confirm to slot written': written - pause_begin,
+    }
+
+
+def report(state_mb, results):
+    nb_runs = len(next(iter(results.values())))
+    print('Save of a %dMB state, %d runs each (median / max, ms):' % (state_mb, nb_runs))
+    print('  %-26s' % '' + ''.join('%20s' % label for label in results))
+    for name in next(iter(results.values()))[0]:
+        line = '  %-26s' % name
+        for runs in results.values():
+            values = [run[name] for run in runs]
+            line += '%11.2f %8.2f' % (statistics.median(values) / 1000, max(values) / 1000)
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Save benchmark of funkey-testapp, forked and in place')
+    parser.add_argument('app', nargs='?', default='./build/funkey-testapp')
+    parser.add_argument('--runs', type=int, default=10)
+    parser.add_argument('--state-mb', type=int, default=16, help='app state size')
+    args = parser.parse_args()
+    if not os.access(args.app, os.X_OK):
+        sys.exit('%s: not an executable, build it with make first' % args.app)
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        trace_path = os.path.join(tmp_dir, 'trace.json')
+        save_dir = os.path.join(tmp_dir, 'saves')
+        os.mkdir(save_dir)
+        env = make_env(tmp_dir)
+        env.update({
+            'FUNKEY_SAVE_BENCH': '1',
+            'FUNKEY_TRACE': trace_path,
+            'FUNKEY_APP_STATE_KB': str(args.state_mb * 1024),
+            'FUNKEY_SAVE_DIR': save_dir,
+        })
+        env.pop('FUNKEY_SAVE_FORK', None)
+
+        results = {label: [] for label, _ in MODES}
+        for _ in range(args.runs):
+            for label, mode_env in MODES:
+                results[label].append(run_once(args.app, dict(env, **mode_env), trace_path))
+        report(args.state_mb, results)
+
+
+if __name__ == '__main__':
+    main()
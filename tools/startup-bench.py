@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+startup-bench.py
+Cold-start benchmark of funkey-testapp: from exec to the first game frame,
+then to the first menu frame after an injected ESC.
+
+  startup-bench.py [build/funkey-testapp] [--runs 20] [--cold] [--warm]
+
+Each run launches the app under SDL's dummy video driver with
+FUNKEY_STARTUP_BENCH=1 and FUNKEY_TRACE (see src/main.c): it opens the menu
+once its first frame is flipped, closes it after the menu's first frame and
+exits. Phases are taken from the trace, lined up with the launch time
+through the trace's CLOCK_MONOTONIC origin, and medians are printed.
+
+The system's shell commands and, unless installed, the menu resources are
+replaced by stand-ins (see funkey_env.py).
+
+Cold runs drop the page cache before each launch, which needs root.
+
+Licensed under the GPLv2, or later.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from funkey_env import make_env
+
+# Spans reported in order: trace name, label
+SPANS = (
+    ('SDL_Init', 'SDL_Init'),
+    ('SDL_SetVideoMode', 'SDL_SetVideoMode'),
+    ('TTF_Init', 'TTF_Init'),
+    ('init_menu_SDL', 'init_menu_SDL'),
+    ('init_menu_SDL: screen surfaces', '  screen surfaces'),
+    ('init_menu_SDL: fonts', '  fonts (pool)'),
+    ('init_menu_SDL: image', '  images (pool, summed)'),
+    ('init_menu_SDL: config', '  config (pool)'),
+    ('init_menu_zones', '  init_menu_zones'),
+    ('add_menu_zone', '    add_menu_zone (summed)'),
+    ('init_menu_widgets', '  init_menu_widgets'),
+    ('init_menu_SDL: pin resources', '  pin resources'),
+    ('init', 'init (total)'),
+)
+
+
+def drop_caches():
+    os.sync()
+    with open('/proc/sys/vm/drop_caches', 'w') as f:
+        f.write('3\n')
+
+
+def run_once(app, env, trace_path):
+    if os.path.exists(trace_path):
+        os.unlink(trace_path)
+    launch_us = time.monotonic_ns() // 1000
+    subprocess.run([app], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=30, check=True)
+    with open(trace_path) as f:
+        trace = json.load(f)
+    return parse_trace(trace, trace['otherData']['monotonic_start_us'] - launch_us)
+
+
+def parse_trace(trace, exec_us):
+    """ Durations of SPANS (summed over occurrences) and milestones, in us since launch """
+    spans = {}
+    stacks = {}
+    first = {}
+    for event in trace['traceEvents']:
+        name, phase, ts, tid = event['name'], event['ph'], event['ts'] + exec_us, event['tid']
+        if phase == 'B':
+            stacks.setdefault(tid, []).append((name, ts))
+        elif phase == 'E' and stacks.get(tid):
+            begin_name, begin_ts = stacks[tid].pop()
+            spans[begin_name] = spans.get(begin_name, 0) + ts - begin_ts
+            first.setdefault(begin_name + ' end', ts)
+        elif phase == 'i':
+            first.setdefault(name, ts)
+
+    game_frame = first.get('SDL_Flip end')
+    menu_frame = first.get('run_menu_loop: first frame')
+    key = first.get('main: first frame')
+    if game_frame is None or menu_frame is None or key is None:
+        raise ValueError('trace is missing the first game or menu frame')
+    milestones = {
+        'exec to main': exec_us,
+        'exec to first SDL_Flip': game_frame,
+        'ESC to first menu frame': menu_frame - key,
+        'exec to first menu frame': menu_frame,
+    }
+    return spans, milestones
+
+
+def report(label, results):
+    print('%s, %d runs (median / max, ms):' % (label, len(results)))
+    for name, text in SPANS:
+        values = [spans.get(name, 0) for spans, _ in results]
+        if any(values):
+            print('  %-32s %8.2f %8.2f' % (text, statistics.median(values) / 1000, max(values) / 1000))
+    for name in results[0][1]:
+        values = [milestones[name] for _, milestones in results]
+        print('  %-32s %8.2f %8.2f' % (name, statistics.median(values) / 1000, max(values) / 1000))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Cold-start benchmark of funkey-testapp')
+    parser.add_argument('app', nargs='?', default='./build/funkey-testapp')
+    parser.add_argument('--runs', type=int, default=20)
+    parser.add_argument('--cold', action='store_true', help='only cold runs (page cache dropped, needs root)')
+    parser.add_argument('--warm', action='store_true', help='only warm runs')
+    args = parser.parse_args()
+    if not os.access(args.app, os.X_OK):
+        sys.exit('%s: not an executable, build it with make first' % args.app)
+
+    modes = ['warm', 'cold']
+    if args.cold != args.warm:
+        modes = ['cold'] if args.cold else ['warm']
+    if 'cold' in modes and os.geteuid() != 0:
+        print('Not root, cold runs skipped (the page cache can\'t be dropped)', file=sys.stderr)
+        modes.remove('cold')
+        if not modes:
+            sys.exit(1)
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        trace_path = os.path.join(tmp_dir, 'trace.json')
+        env = make_env(tmp_dir)
+        env.update({
+            'FUNKEY_STARTUP_BENCH': '1',
+            'FUNKEY_TRACE': trace_path,
+        })
+
+        # One untimed run, so warm runs really start warm
+        run_once(args.app, env, trace_path)
+        for mode in modes:
+            results = []
+            for _ in range(args.runs):
+                if mode == 'cold':
+                    drop_caches()
+                results.append(run_once(args.app, env, trace_path))
+            report(mode.capitalize(), results)
+
+
+if __name__ == '__main__':
+    main()